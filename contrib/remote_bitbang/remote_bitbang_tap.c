@@ -0,0 +1,237 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+  This is a reference remote bitbang server for testing the OpenOCD
+  remote_bitbang interface driver without hardware. It simulates a single
+  JTAG TAP with a 4 bit instruction register, an IDCODE and a BYPASS
+  instruction, and supports both the classic protocol and the binary scan
+  extension ('V', 'X' and 'Y' commands).
+
+  To compile run:
+  gcc -Wall -std=c99 -o remote_bitbang_tap remote_bitbang_tap.c
+
+  Usage example:
+
+  socat TCP-LISTEN:3335,reuseaddr,fork EXEC:"./remote_bitbang_tap [-classic] [idcode]"
+
+  openocd -c "adapter driver remote_bitbang; remote_bitbang_port 3335" \
+	  -c "remote_bitbang_host localhost; jtag newtap sim tap -irlen 4" \
+	  -c "init; scan_chain; shutdown"
+
+  With -classic the server behaves like a server without the scan
+  extension, which exercises the fallback of the driver.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IR_LENGTH		4
+#define IR_IDCODE		0x1
+#define IR_BYPASS		0xf
+
+enum tap_state {
+	TEST_LOGIC_RESET, RUN_TEST_IDLE,
+	SELECT_DR, CAPTURE_DR, SHIFT_DR, EXIT1_DR, PAUSE_DR, EXIT2_DR, UPDATE_DR,
+	SELECT_IR, CAPTURE_IR, SHIFT_IR, EXIT1_IR, PAUSE_IR, EXIT2_IR, UPDATE_IR,
+};
+
+/* next state for TMS low and high */
+static const enum tap_state next_state[][2] = {
+	[TEST_LOGIC_RESET] = { RUN_TEST_IDLE, TEST_LOGIC_RESET },
+	[RUN_TEST_IDLE] = { RUN_TEST_IDLE, SELECT_DR },
+	[SELECT_DR] = { CAPTURE_DR, SELECT_IR },
+	[CAPTURE_DR] = { SHIFT_DR, EXIT1_DR },
+	[SHIFT_DR] = { SHIFT_DR, EXIT1_DR },
+	[EXIT1_DR] = { PAUSE_DR, UPDATE_DR },
+	[PAUSE_DR] = { PAUSE_DR, EXIT2_DR },
+	[EXIT2_DR] = { SHIFT_DR, UPDATE_DR },
+	[UPDATE_DR] = { RUN_TEST_IDLE, SELECT_DR },
+	[SELECT_IR] = { CAPTURE_IR, TEST_LOGIC_RESET },
+	[CAPTURE_IR] = { SHIFT_IR, EXIT1_IR },
+	[SHIFT_IR] = { SHIFT_IR, EXIT1_IR },
+	[EXIT1_IR] = { PAUSE_IR, UPDATE_IR },
+	[PAUSE_IR] = { PAUSE_IR, EXIT2_IR },
+	[EXIT2_IR] = { SHIFT_IR, UPDATE_IR },
+	[UPDATE_IR] = { RUN_TEST_IDLE, SELECT_DR },
+};
+
+static struct {
+	enum tap_state state;
+	uint32_t ir;
+	uint32_t ir_shift;
+	uint32_t dr_shift;
+	unsigned int dr_length;
+	uint32_t idcode;
+	int tck;
+	int tms;
+	int tdi;
+} tap;
+
+static void tap_reset(void)
+{
+	tap.state = TEST_LOGIC_RESET;
+	tap.ir = IR_IDCODE;
+}
+
+static int tap_tdo(void)
+{
+	if (tap.state == SHIFT_DR)
+		return tap.dr_shift & 1;
+	if (tap.state == SHIFT_IR)
+		return tap.ir_shift & 1;
+	return 0;
+}
+
+static void tap_rising_edge(void)
+{
+	switch (tap.state) {
+	case TEST_LOGIC_RESET:
+		tap.ir = IR_IDCODE;
+		break;
+	case CAPTURE_DR:
+		if (tap.ir == IR_IDCODE) {
+			tap.dr_shift = tap.idcode;
+			tap.dr_length = 32;
+		} else {
+			tap.dr_shift = 0;
+			tap.dr_length = 1;
+		}
+		break;
+	case SHIFT_DR:
+		tap.dr_shift = (tap.dr_shift >> 1) |
+			((uint32_t)tap.tdi << (tap.dr_length - 1));
+		break;
+	case CAPTURE_IR:
+		tap.ir_shift = 0x1;
+		break;
+	case SHIFT_IR:
+		tap.ir_shift = (tap.ir_shift >> 1) |
+			((uint32_t)tap.tdi << (IR_LENGTH - 1));
+		break;
+	case UPDATE_IR:
+		tap.ir = tap.ir_shift;
+		break;
+	default:
+		break;
+	}
+
+	tap.state = next_state[tap.state][tap.tms];
+}
+
+static void tap_write(int tck, int tms, int tdi)
+{
+	tap.tms = tms;
+	tap.tdi = tdi;
+	if (tck && !tap.tck)
+		tap_rising_edge();
+	tap.tck = tck;
+}
+
+static bool read_bytes(uint8_t *buf, size_t size)
+{
+	return fread(buf, 1, size, stdin) == size;
+}
+
+/* 'X' and 'Y' commands of the scan extension */
+static bool process_scan(bool capture)
+{
+	uint8_t header[4];
+	static uint8_t tms[1024], tdi[1024], tdo[1024];
+
+	if (!read_bytes(header, sizeof(header)))
+		return false;
+
+	uint32_t bits = header[0] | header[1] << 8 | header[2] << 16 |
+		(uint32_t)header[3] << 24;
+	size_t bytes = (bits + 7) / 8;
+
+	if (bytes > sizeof(tms)) {
+		fprintf(stderr, "Scan of %u bits too long\n", bits);
+		return false;
+	}
+
+	if (!read_bytes(tms, bytes) || !read_bytes(tdi, bytes))
+		return false;
+
+	memset(tdo, 0, bytes);
+	for (uint32_t i = 0; i < bits; i++) {
+		tap_write(0, (tms[i / 8] >> (i % 8)) & 1, (tdi[i / 8] >> (i % 8)) & 1);
+		if (tap_tdo())
+			tdo[i / 8] |= 1 << (i % 8);
+		tap_write(1, tap.tms, tap.tdi);
+	}
+
+	if (capture) {
+		fwrite(tdo, 1, bytes, stdout);
+		fflush(stdout);
+	}
+
+	return true;
+}
+
+static void process_remote_protocol(bool classic)
+{
+	int c;
+	while (1) {
+		c = getchar();
+		if (c == EOF || c == 'Q') /* Quit */
+			break;
+		else if (c == 'b' || c == 'B') /* Blink */
+			continue;
+		else if (c >= 'r' && c <= 'r' + 3) { /* Reset */
+			if ((c - 'r') & 2)
+				tap_reset();
+		} else if (c >= '0' && c <= '0' + 7) { /* Write */
+			char d = c - '0';
+			tap_write(!!(d & 4), !!(d & 2), d & 1);
+		} else if (c == 'R') {
+			putchar('0' + tap_tdo());
+			fflush(stdout);
+		} else if (c == 'V' && !classic) {
+			fputs("V1", stdout);
+			fflush(stdout);
+		} else if ((c == 'X' || c == 'Y') && !classic) {
+			if (!process_scan(c == 'Y'))
+				break;
+		} else
+			fprintf(stderr, "Unknown command '%c' received\n", c);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	bool classic = false;
+
+	tap.idcode = 0x10000001;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-classic"))
+			classic = true;
+		else
+			tap.idcode = strtoul(argv[i], NULL, 0) | 1;
+	}
+
+	fprintf(stderr, "remote_bitbang TAP simulation, IDCODE 0x%08x%s\n",
+		tap.idcode, classic ? ", classic protocol only" : "");
+
+	tap_reset();
+	process_remote_protocol(classic);
+
+	return 0;
+}
@@ -27,6 +27,7 @@
 #include <flash/nor/core.h>
 #include <flash/nor/imp.h>
 #include <target/image.h>
+#include <target/memcache.h>
 
 /**
  * @file
@@ -43,6 +44,8 @@ int flash_driver_erase(struct flash_bank *bank, unsigned int first,
 	int retval;
 
 	retval = bank->driver->erase(bank, first, last);
+	/* flash controllers change memory without going through target writes */
+	memcache_invalidate(bank->target);
 	if (retval != ERROR_OK)
 		LOG_ERROR("failed erasing sectors %u to %u", first, last);
 
@@ -99,6 +102,7 @@ int flash_driver_write(struct flash_bank *bank,
 	int retval;
 
 	retval = bank->driver->write(bank, buffer, offset, count);
+	memcache_invalidate(bank->target);
 	if (retval != ERROR_OK) {
 		LOG_ERROR(
 			"error writing to flash at address " TARGET_ADDR_FMT
@@ -734,8 +738,123 @@ static bool flash_write_check_gap(struct flash_bank *bank,
 }
 
 
+/* unlock, erase, write and verify one contiguous run of a flash bank */
+static int flash_write_run(struct flash_bank *c, const uint8_t *buffer,
+	target_addr_t address, uint32_t size,
+	bool erase, bool unlock, bool write, bool verify)
+{
+	int retval = ERROR_OK;
+
+	if (unlock)
+		retval = flash_unlock_address_range(c->target, address, size);
+	if (retval == ERROR_OK) {
+		if (erase) {
+			/* calculate and erase sectors */
+			retval = flash_erase_address_range(c->target,
+					true, address, size);
+		}
+	}
+
+	if (retval == ERROR_OK) {
+		if (write) {
+			/* write flash sectors */
+			retval = flash_driver_write(c, buffer, address - c->base, size);
+		}
+	}
+
+	if (retval == ERROR_OK) {
+		if (verify) {
+			/* verify flash sectors */
+			retval = flash_driver_verify(c, buffer, address - c->base, size);
+		}
+	}
+
+	return retval;
+}
+
+/* Check whether flash already holds the given data. Anything that keeps us
+ * from proving the contents identical counts as a difference, so the worst
+ * case is a needless rewrite. Unlike flash_driver_verify() a mismatch is
+ * expected here and not logged as an error. */
+static bool flash_contents_match(struct flash_bank *c, const uint8_t *buffer,
+	uint32_t offset, uint32_t count)
+{
+	if (c->driver->verify)
+		return c->driver->verify(c, buffer, offset, count) == ERROR_OK;
+
+	return default_flash_verify(c, buffer, offset, count) == ERROR_OK;
+}
+
+/* Like flash_write_run(), but leave sectors which already hold the wanted
+ * data alone. Runs of differing sectors are merged so that drivers still see
+ * as few and as large writes as possible. */
+static int flash_write_run_incremental(struct flash_bank *c,
+	const uint8_t *buffer, target_addr_t address, uint32_t size,
+	bool erase, bool unlock, bool verify, uint32_t *skipped)
+{
+	uint32_t run_start = address - c->base;
+	uint32_t run_end = run_start + size;
+	uint32_t dirty_start = 0, dirty_end = 0;
+	uint32_t covered = 0, same = 0;
+	int retval;
+
+	/* make sure the sector list describes the whole run before trusting it */
+	for (unsigned int i = 0; i < c->num_sectors; i++) {
+		uint32_t start = MAX(c->sectors[i].offset, run_start);
+		uint32_t end = MIN(c->sectors[i].offset + c->sectors[i].size, run_end);
+		if (start < end)
+			covered += end - start;
+	}
+	if (covered != size) {
+		LOG_DEBUG("sector layout does not cover the run, writing all of it");
+		return flash_write_run(c, buffer, address, size,
+				erase, unlock, true, verify);
+	}
+
+	for (unsigned int i = 0; i < c->num_sectors; i++) {
+		uint32_t start = MAX(c->sectors[i].offset, run_start);
+		uint32_t end = MIN(c->sectors[i].offset + c->sectors[i].size, run_end);
+		if (start >= end)
+			continue;
+
+		if (!flash_contents_match(c, buffer + (start - run_start),
+				start, end - start)) {
+			if (dirty_start == dirty_end)
+				dirty_start = start;
+			dirty_end = end;
+			continue;
+		}
+
+		same += end - start;
+		if (dirty_start != dirty_end) {
+			retval = flash_write_run(c, buffer + (dirty_start - run_start),
+					c->base + dirty_start, dirty_end - dirty_start,
+					erase, unlock, true, verify);
+			if (retval != ERROR_OK)
+				return retval;
+			dirty_start = dirty_end = 0;
+		}
+	}
+
+	if (dirty_start != dirty_end) {
+		retval = flash_write_run(c, buffer + (dirty_start - run_start),
+				c->base + dirty_start, dirty_end - dirty_start,
+				erase, unlock, true, verify);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	LOG_DEBUG("bank %s: %" PRIu32 " of %" PRIu32 " bytes at " TARGET_ADDR_FMT
+		" already up to date", c->name, same, size, address);
+	if (skipped)
+		*skipped += same;
+
+	return ERROR_OK;
+}
+
 int flash_write_unlock_verify(struct target *target, struct image *image,
-	uint32_t *written, bool erase, bool unlock, bool write, bool verify)
+	uint32_t *written, uint32_t *skipped, bool erase, bool unlock,
+	bool write, bool verify, bool incremental)
 {
 	int retval = ERROR_OK;
 
@@ -749,6 +868,8 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 
 	if (written)
 		*written = 0;
+	if (skipped)
+		*skipped = 0;
 
 	if (erase) {
 		/* assume all sectors need erasing - stops any problems
@@ -956,31 +1077,13 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 			}
 		}
 
-		retval = ERROR_OK;
-
-		if (unlock)
-			retval = flash_unlock_address_range(target, run_address, run_size);
-		if (retval == ERROR_OK) {
-			if (erase) {
-				/* calculate and erase sectors */
-				retval = flash_erase_address_range(target,
-						true, run_address, run_size);
-			}
-		}
-
-		if (retval == ERROR_OK) {
-			if (write) {
-				/* write flash sectors */
-				retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
-			}
-		}
-
-		if (retval == ERROR_OK) {
-			if (verify) {
-				/* verify flash sectors */
-				retval = flash_driver_verify(c, buffer, run_address - c->base, run_size);
-			}
-		}
+		uint32_t run_skipped = 0;
+		if (incremental && write)
+			retval = flash_write_run_incremental(c, buffer, run_address,
+					run_size, erase, unlock, verify, &run_skipped);
+		else
+			retval = flash_write_run(c, buffer, run_address, run_size,
+					erase, unlock, write, verify);
 
 		free(buffer);
 
@@ -989,8 +1092,11 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 			goto done;
 		}
 
+		/* only count what was actually programmed */
 		if (written != NULL)
-			*written += run_size;	/* add run size to total written counter */
+			*written += run_size - run_skipped;
+		if (skipped != NULL)
+			*skipped += run_skipped;
 	}
 
 done:
@@ -1003,7 +1109,8 @@ done:
 int flash_write(struct target *target, struct image *image,
 	uint32_t *written, bool erase)
 {
-	return flash_write_unlock_verify(target, image, written, erase, false, true, false);
+	return flash_write_unlock_verify(target, image, written, NULL, erase,
+			false, true, false, false);
 }
 
 struct flash_sector *alloc_block_array(uint32_t offset, uint32_t size,
@@ -48,8 +48,12 @@ int flash_driver_read(struct flash_bank *bank,
 int flash_driver_verify(struct flash_bank *bank,
 		const uint8_t *buffer, uint32_t offset, uint32_t count);
 
-/* write (optional verify) an image to flash memory of the given target */
+/* write (optional verify) an image to flash memory of the given target;
+ * with incremental set, sectors already holding the image data are skipped.
+ * *written counts the bytes actually programmed, *skipped the bytes left
+ * alone */
 int flash_write_unlock_verify(struct target *target, struct image *image,
-		uint32_t *written, bool erase, bool unlock, bool write, bool verify);
+		uint32_t *written, uint32_t *skipped, bool erase, bool unlock,
+		bool write, bool verify, bool incremental);
 
 #endif /* OPENOCD_FLASH_NOR_IMP_H */
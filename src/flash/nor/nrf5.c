@@ -945,9 +945,11 @@ static int nrf5_ll_flash_write(struct nrf5_info *chip, uint32_t address, const u
 	LOG_DEBUG("Writing buffer to flash address=0x%"PRIx32" bytes=0x%"PRIx32, address, bytes);
 	assert(bytes % 4 == 0);
 
-	/* allocate working area with flash programming code */
-	if (target_alloc_working_area(target, sizeof(nrf5_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	/* allocate working area with flash programming code and memory buffer */
+	retval = target_alloc_flash_algorithm(target, nrf5_flash_write_code,
+			sizeof(nrf5_flash_write_code), bytes, 4, 256, buffer_size,
+			&write_algorithm, &source);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
 		LOG_WARNING("no working area available, falling back to slow memory writes");
 
 		for (; bytes > 0; bytes -= 4) {
@@ -965,26 +967,9 @@ static int nrf5_ll_flash_write(struct nrf5_info *chip, uint32_t address, const u
 
 		return ERROR_OK;
 	}
-
-	retval = target_write_buffer(target, write_algorithm->address,
-				sizeof(nrf5_flash_write_code),
-				nrf5_flash_write_code);
 	if (retval != ERROR_OK)
 		return retval;
 
-	/* memory buffer */
-	while (target_alloc_working_area(target, buffer_size, &source) != ERROR_OK) {
-		buffer_size /= 2;
-		buffer_size &= ~3UL; /* Make sure it's 4 byte aligned */
-		if (buffer_size <= 256) {
-			/* free working area, write algorithm already allocated */
-			target_free_working_area(target, write_algorithm);
-
-			LOG_WARNING("No large enough working area available, can't do block memory writes");
-			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-		}
-	}
-
 	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
 	armv7m_info.core_mode = ARM_MODE_THREAD;
 
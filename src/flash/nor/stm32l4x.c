@@ -1148,7 +1148,6 @@ static int stm32l4_write_block(struct flash_bank *bank, const uint8_t *buffer,
 	uint32_t offset, uint32_t count)
 {
 	struct target *target = bank->target;
-	uint32_t buffer_size;
 	struct working_area *write_algorithm;
 	struct working_area *source;
 	uint32_t address = bank->base + offset;
@@ -1160,35 +1159,17 @@ static int stm32l4_write_block(struct flash_bank *bank, const uint8_t *buffer,
 #include "../../../contrib/loaders/flash/stm32/stm32l4x.inc"
 	};
 
-	if (target_alloc_working_area(target, sizeof(stm32l4_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
-		LOG_WARNING("no working area available, can't do block memory writes");
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(stm32l4_flash_write_code),
-			stm32l4_flash_write_code);
+	/* memory buffer, size *must* be multiple of dword plus one dword for rp and one for wp,
+	 * probably won't benefit from more than 16k ... */
+	retval = target_alloc_flash_algorithm(target, stm32l4_flash_write_code,
+			sizeof(stm32l4_flash_write_code), count * 8, 8, 256, 16384,
+			&write_algorithm, &source);
 	if (retval != ERROR_OK) {
-		target_free_working_area(target, write_algorithm);
+		if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+			LOG_WARNING("large enough working area not available, can't do block memory writes");
 		return retval;
 	}
 
-	/* memory buffer, size *must* be multiple of dword plus one dword for rp and one for wp */
-	buffer_size = target_get_working_area_avail(target) & ~(2 * sizeof(uint32_t) - 1);
-	if (buffer_size < 256) {
-		LOG_WARNING("large enough working area not available, can't do block memory writes");
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	} else if (buffer_size > 16384) {
-		/* probably won't benefit from more than 16k ... */
-		buffer_size = 16384;
-	}
-
-	if (target_alloc_working_area_try(target, buffer_size, &source) != ERROR_OK) {
-		LOG_ERROR("allocating working area failed");
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
 	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
 	armv7m_info.core_mode = ARM_MODE_THREAD;
 
@@ -406,13 +406,14 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	struct target *target = get_current_target(CMD_CTX);
 
 	struct image image;
-	uint32_t written;
+	uint32_t written, skipped;
 
 	int retval;
 
 	/* flash auto-erase is disabled by default*/
 	int auto_erase = 0;
 	bool auto_unlock = false;
+	bool incremental = false;
 
 	while (CMD_ARGC) {
 		if (strcmp(CMD_ARGV[0], "erase") == 0) {
@@ -425,6 +426,11 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 			CMD_ARGV++;
 			CMD_ARGC--;
 			command_print(CMD, "auto unlock enabled");
+		} else if (strcmp(CMD_ARGV[0], "incremental") == 0) {
+			incremental = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+			command_print(CMD, "unchanged sectors will be skipped");
 		} else
 			break;
 	}
@@ -454,8 +460,8 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = flash_write_unlock_verify(target, &image, &written, auto_erase,
-		auto_unlock, true, false);
+	retval = flash_write_unlock_verify(target, &image, &written, &skipped,
+		auto_erase, auto_unlock, true, false, incremental);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
@@ -465,6 +471,9 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 		command_print(CMD, "wrote %" PRIu32 " bytes from file %s "
 			"in %fs (%0.3f KiB/s)", written, CMD_ARGV[0],
 			duration_elapsed(&bench), duration_kbps(&bench, written));
+		if (incremental)
+			command_print(CMD, "skipped %" PRIu32 " bytes already in flash",
+				skipped);
 	}
 
 	image_close(&image);
@@ -506,8 +515,8 @@ COMMAND_HANDLER(handle_flash_verify_image_command)
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = flash_write_unlock_verify(target, &image, &verified, false,
-		false, false, true);
+	retval = flash_write_unlock_verify(target, &image, &verified, NULL, false,
+		false, false, true, false);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
@@ -1193,7 +1202,7 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.name = "write_image",
 		.handler = handle_flash_write_image_command,
 		.mode = COMMAND_EXEC,
-		.usage = "[erase] [unlock] filename [offset [file_type]]",
+		.usage = "[erase] [unlock] [incremental] filename [offset [file_type]]",
 		.help = "Write an image to flash.  Optionally first unprotect "
 			"and/or erase the region to be used. Allow optional "
 			"offset from beginning of bank (defaults to zero)",
@@ -234,8 +234,16 @@ int bit_copy_queued(struct bit_copy_queue *q, uint8_t *dst, unsigned dst_offset,
 void bit_copy_execute(struct bit_copy_queue *q);
 void bit_copy_discard(struct bit_copy_queue *q);
 
+extern const int8_t hex_digit_table[256];
+
+/* value of a hexadecimal digit, -1 if @a c is not one */
+static inline int hex_digit_value(char c)
+{
+	return hex_digit_table[(uint8_t)c];
+}
+
 /* functions to convert to/from hex encoded buffer
- * used in ti-icdi driver and gdb server */
+ * used in ti-icdi driver, gdb server and image loader */
 size_t unhexify(uint8_t *bin, const char *hex, size_t count);
 size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t out_maxlen);
 void buffer_shr(void *_buf, unsigned buf_len, unsigned count);
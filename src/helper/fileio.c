@@ -30,12 +30,17 @@
 #include "configuration.h"
 #include "fileio.h"
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 struct fileio {
 	char *url;
 	size_t size;
 	enum fileio_type type;
 	enum fileio_access access;
 	FILE *file;
+	void *map;		/* read only mapping of the whole file, if any */
 };
 
 static inline int fileio_close_local(struct fileio *fileio)
@@ -122,7 +127,7 @@ int fileio_open(struct fileio **fileio, const char *url,
 	int retval;
 	struct fileio *tmp;
 
-	tmp = malloc(sizeof(struct fileio));
+	tmp = calloc(1, sizeof(struct fileio));
 
 	tmp->type = type;
 	tmp->access = access_type;
@@ -145,6 +150,11 @@ int fileio_close(struct fileio *fileio)
 {
 	int retval;
 
+#ifdef HAVE_SYS_MMAN_H
+	if (fileio->map)
+		munmap(fileio->map, fileio->size);
+#endif
+
 	retval = fileio_close_local(fileio);
 
 	free(fileio->url);
@@ -172,6 +182,54 @@ int fileio_seek(struct fileio *fileio, size_t position)
 	return ERROR_OK;
 }
 
+int fileio_tell(struct fileio *fileio, size_t *position)
+{
+	long retval = ftell(fileio->file);
+
+	if (retval < 0) {
+		LOG_ERROR("couldn't get position in file %s: %s", fileio->url, strerror(errno));
+		return ERROR_FILEIO_OPERATION_FAILED;
+	}
+
+	*position = retval;
+
+	return ERROR_OK;
+}
+
+/**
+ * Map a file opened for binary reading into memory, so its contents can be
+ * accessed without a seek and a read call for every chunk. The mapping
+ * stays valid until the file is closed. Where mapping is not supported
+ * (no mmap(), empty file, file not on a local file system) callers must
+ * fall back to fileio_seek() and fileio_read().
+ */
+int fileio_map(struct fileio *fileio, const uint8_t **data)
+{
+#ifdef HAVE_SYS_MMAN_H
+	if (fileio->access != FILEIO_READ || fileio->type != FILEIO_BINARY)
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+
+	if (!fileio->map) {
+		if (fileio->size == 0)
+			return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+
+		void *map = mmap(NULL, fileio->size, PROT_READ, MAP_PRIVATE,
+				fileno(fileio->file), 0);
+		if (map == MAP_FAILED) {
+			LOG_DEBUG("couldn't map %s: %s", fileio->url, strerror(errno));
+			return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+		}
+		fileio->map = map;
+	}
+
+	*data = fileio->map;
+
+	return ERROR_OK;
+#else
+	return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+#endif
+}
+
 static int fileio_local_read(struct fileio *fileio, size_t size, void *buffer,
 		size_t *size_read)
 {
@@ -49,6 +49,8 @@ int fileio_close(struct fileio *fileio);
 int fileio_feof(struct fileio *fileio);
 
 int fileio_seek(struct fileio *fileio, size_t position);
+int fileio_tell(struct fileio *fileio, size_t *position);
+int fileio_map(struct fileio *fileio, const uint8_t **data);
 int fileio_fgets(struct fileio *fileio, size_t size, void *buffer);
 
 int fileio_read(struct fileio *fileio,
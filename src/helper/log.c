@@ -61,6 +61,16 @@ static const char * const log_strings[6] = {
 
 static int count;
 
+/* optional output buffer, written out in bulk instead of once per message */
+static char *log_buf;
+static size_t log_buf_size;
+static size_t log_buf_used;
+static int64_t log_buf_flushed;
+static uint64_t log_buf_writes;
+
+/* buffered messages are written out at least this often */
+#define LOG_BUFFER_FLUSH_MS		100
+
 /* forward the log to the listeners */
 static void log_forward(const char *file, unsigned line, const char *function, const char *string)
 {
@@ -74,6 +84,111 @@ static void log_forward(const char *file, unsigned line, const char *function, c
 	}
 }
 
+static void log_buffer_write(void)
+{
+	if (log_buf_used) {
+		fwrite(log_buf, 1, log_buf_used, log_output);
+		log_buf_used = 0;
+		log_buf_writes++;
+	}
+}
+
+void log_flush(void)
+{
+	if (!log_output)
+		return;
+
+	if (log_buf) {
+		log_buffer_write();
+		log_buf_flushed = timeval_ms();
+	}
+	fflush(log_output);
+}
+
+static void log_vwrite(const char *format, va_list ap)
+{
+	if (!log_buf) {
+		vfprintf(log_output, format, ap);
+		return;
+	}
+
+	size_t space = log_buf_size - log_buf_used;
+	va_list aq;
+	va_copy(aq, ap);
+	int len = vsnprintf(log_buf + log_buf_used, space, format, aq);
+	va_end(aq);
+
+	if (len < 0)
+		return;
+
+	if ((size_t)len < space) {
+		log_buf_used += len;
+		return;
+	}
+
+	/* does not fit anymore, make room or bypass the buffer for huge messages */
+	log_buffer_write();
+	if ((size_t)len < log_buf_size) {
+		vsnprintf(log_buf, log_buf_size, format, ap);
+		log_buf_used = len;
+	} else {
+		vfprintf(log_output, format, ap);
+	}
+}
+
+static void log_write(const char *format, ...)
+	__attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 1, 2)));
+
+static void log_write(const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	log_vwrite(format, ap);
+	va_end(ap);
+}
+
+/* Without buffering every message is flushed right away. With buffering
+ * only messages the user must see immediately are, the rest is written out
+ * when the buffer fills up, after LOG_BUFFER_FLUSH_MS or when the server
+ * loop goes idle. */
+static void log_message_done(enum log_levels level)
+{
+	if (!log_buf || level <= LOG_LVL_WARNING ||
+			timeval_ms() - log_buf_flushed >= LOG_BUFFER_FLUSH_MS)
+		log_flush();
+}
+
+static void log_header(enum log_levels level, const char *file, int line,
+		const char *function)
+{
+	const char *f = strrchr(file, '/');
+	if (f)
+		file = f + 1;
+
+	if (debug_level >= LOG_LVL_DEBUG) {
+		/* print with count and time information */
+		int64_t t = timeval_ms() - start;
+#ifdef _DEBUG_FREE_SPACE_
+		struct mallinfo info;
+		info = mallinfo();
+#endif
+		log_write("%s%d %" PRId64 " %s:%d %s()"
+#ifdef _DEBUG_FREE_SPACE_
+			" %d"
+#endif
+			": ", log_strings[level + 1], count, t, file, line, function
+#ifdef _DEBUG_FREE_SPACE_
+			, info.fordblks
+#endif
+			);
+	} else if (level > LOG_LVL_USER) {
+		/* if we are using gdb through pipes then we do not want any output
+		 * to the pipe otherwise we get repeated strings */
+		log_write("%s", log_strings[level + 1]);
+	}
+}
+
 /* The log_puts() serves two somewhat different goals:
  *
  * - logging
@@ -101,8 +216,8 @@ static void log_puts(enum log_levels level,
 
 	if (level == LOG_LVL_OUTPUT) {
 		/* do not prepend any headers, just print out what we were given and return */
-		fputs(string, log_output);
-		fflush(log_output);
+		log_write("%s", string);
+		log_message_done(level);
 		return;
 	}
 
@@ -111,34 +226,14 @@ static void log_puts(enum log_levels level,
 		file = f + 1;
 
 	if (strlen(string) > 0) {
-		if (debug_level >= LOG_LVL_DEBUG) {
-			/* print with count and time information */
-			int64_t t = timeval_ms() - start;
-#ifdef _DEBUG_FREE_SPACE_
-			struct mallinfo info;
-			info = mallinfo();
-#endif
-			fprintf(log_output, "%s%d %" PRId64 " %s:%d %s()"
-#ifdef _DEBUG_FREE_SPACE_
-				" %d"
-#endif
-				": %s", log_strings[level + 1], count, t, file, line, function,
-#ifdef _DEBUG_FREE_SPACE_
-				info.fordblks,
-#endif
-				string);
-		} else {
-			/* if we are using gdb through pipes then we do not want any output
-			 * to the pipe otherwise we get repeated strings */
-			fprintf(log_output, "%s%s",
-				(level > LOG_LVL_USER) ? log_strings[level + 1] : "", string);
-		}
+		log_header(level, file, line, function);
+		log_write("%s", string);
 	} else {
 		/* Empty strings are sent to log callbacks to keep e.g. gdbserver alive, here we do
 		 *nothing. */
 	}
 
-	fflush(log_output);
+	log_message_done(level);
 
 	/* Never forward LOG_LVL_DEBUG, too verbose and they can be found in the log if need be */
 	if (level <= LOG_LVL_INFO)
@@ -180,6 +275,16 @@ void log_vprintf_lf(enum log_levels level, const char *file, unsigned line,
 	if (level > debug_level)
 		return;
 
+	/* messages that are not forwarded to the listeners are formatted
+	 * straight into the output buffer, without an intermediate copy */
+	if (log_buf && log_output && level > LOG_LVL_INFO) {
+		log_header(level, file, line, function);
+		log_vwrite(format, args);
+		log_write("\n");
+		log_message_done(level);
+		return;
+	}
+
 	tmp = alloc_vprintf(format, args);
 
 	if (!tmp)
@@ -228,6 +333,8 @@ COMMAND_HANDLER(handle_debug_level_command)
 
 COMMAND_HANDLER(handle_log_output_command)
 {
+	log_flush();
+
 	if (CMD_ARGC == 0 || (CMD_ARGC == 1 && strcmp(CMD_ARGV[0], "default") == 0)) {
 		if (log_output != stderr && log_output != NULL) {
 			/* Close previous log file, if it was open and wasn't stderr. */
@@ -255,6 +362,52 @@ COMMAND_HANDLER(handle_log_output_command)
 	return ERROR_COMMAND_SYNTAX_ERROR;
 }
 
+COMMAND_HANDLER(handle_log_buffer_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int size_kb = 0;
+		if (strcmp(CMD_ARGV[0], "off") != 0) {
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size_kb);
+			if (size_kb > 65536) {
+				command_print(CMD, "log buffer size must not exceed 65536 KiB");
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+		}
+
+		char *buf = NULL;
+		if (size_kb) {
+			buf = malloc(size_kb * 1024);
+			if (!buf) {
+				LOG_ERROR("Out of memory");
+				return ERROR_FAIL;
+			}
+		}
+
+		log_flush();
+		free(log_buf);
+		log_buf = buf;
+		log_buf_size = size_kb * 1024;
+		log_buf_writes = 0;
+
+		static bool exit_flush_registered;
+		if (log_buf && !exit_flush_registered) {
+			atexit(log_flush);
+			exit_flush_registered = true;
+		}
+	}
+
+	if (log_buf)
+		command_print(CMD, "log buffer: %zu KiB, %" PRIu64 " bulk writes",
+				log_buf_size / 1024, log_buf_writes);
+	else
+		command_print(CMD, "log buffer: off");
+
+	return ERROR_OK;
+}
+
 static const struct command_registration log_command_handlers[] = {
 	{
 		.name = "log_output",
@@ -263,6 +416,13 @@ static const struct command_registration log_command_handlers[] = {
 		.help = "redirect logging to a file (default: stderr)",
 		.usage = "[file_name | \"default\"]",
 	},
+	{
+		.name = "log_buffer",
+		.handler = handle_log_buffer_command,
+		.mode = COMMAND_ANY,
+		.help = "buffer log output in memory and write it out in bulk",
+		.usage = "[size_kb | \"off\"]",
+	},
 	{
 		.name = "debug_level",
 		.handler = handle_debug_level_command,
@@ -303,6 +463,7 @@ void log_init(void)
 
 int set_log_output(struct command_context *cmd_ctx, FILE *output)
 {
+	log_flush();
 	log_output = output;
 	return ERROR_OK;
 }
@@ -73,6 +73,10 @@ __attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 5, 6)));
  */
 void log_init(void);
 int set_log_output(struct command_context *cmd_ctx, FILE *output);
+/**
+ * Write out log messages held back by the \c log_buffer command.
+ */
+void log_flush(void);
 
 int log_register_commands(struct command_context *cmd_ctx);
 
@@ -124,7 +128,12 @@ extern int debug_level;
 	} while (0)
 
 #define LOG_INFO(expr ...) \
-	log_printf_lf(LOG_LVL_INFO, __FILE__, __LINE__, __func__, expr)
+	do { \
+		if (debug_level >= LOG_LVL_INFO) \
+			log_printf_lf(LOG_LVL_INFO, \
+				__FILE__, __LINE__, __func__, \
+				expr); \
+	} while (0)
 
 #define LOG_WARNING(expr ...) \
 	log_printf_lf(LOG_LVL_WARNING, __FILE__, __LINE__, __func__, expr)
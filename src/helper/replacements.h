@@ -287,6 +287,34 @@ typedef struct {
 
 #define PT_LOAD			1		/* Loadable program segment */
 
+typedef struct {
+	Elf32_Word sh_name;		/* Section name (string tbl index) */
+	Elf32_Word sh_type;		/* Section type */
+	Elf32_Word sh_flags;	/* Section flags */
+	Elf32_Addr sh_addr;		/* Section virtual addr at execution */
+	Elf32_Off sh_offset;	/* Section file offset */
+	Elf32_Word sh_size;		/* Section size in bytes */
+	Elf32_Word sh_link;		/* Link to another section */
+	Elf32_Word sh_info;		/* Additional section information */
+	Elf32_Word sh_addralign;	/* Section alignment */
+	Elf32_Word sh_entsize;	/* Entry size if section holds table */
+} Elf32_Shdr;
+
+#define SHT_SYMTAB		2		/* Symbol table */
+#define SHN_UNDEF		0		/* Undefined section */
+
+#define STT_FUNC		2		/* Symbol is a code object */
+#define ELF32_ST_TYPE(val)		((val) & 0xf)
+
+typedef struct {
+	Elf32_Word st_name;		/* Symbol name (string tbl index) */
+	Elf32_Addr st_value;	/* Symbol value */
+	Elf32_Word st_size;		/* Symbol size */
+	unsigned char st_info;	/* Symbol type and binding */
+	unsigned char st_other;	/* Symbol visibility */
+	Elf32_Half st_shndx;	/* Section index */
+} Elf32_Sym;
+
 #endif	/* HAVE_ELF_H */
 
 #if defined HAVE_LIBUSB1 && !defined HAVE_LIBUSB_ERROR_NAME
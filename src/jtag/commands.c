@@ -37,12 +37,25 @@
 struct cmd_queue_page {
 	struct cmd_queue_page *next;
 	void *address;
+	size_t size;
 	size_t used;
 };
 
 #define CMD_QUEUE_PAGE_SIZE (1024 * 1024)
+/* number of queue flushes after which idle pages above the recent
+ * high-water mark are given back */
+#define CMD_QUEUE_TRIM_INTERVAL 256
+
 static struct cmd_queue_page *cmd_queue_pages;
 static struct cmd_queue_page *cmd_queue_pages_tail;
+/* empty pages kept across flushes for reuse */
+static struct cmd_queue_page *cmd_queue_free_pages;
+
+static unsigned int cmd_queue_used_pages;
+static unsigned int cmd_queue_free_count;
+static unsigned int cmd_queue_interval_peak;
+static unsigned int cmd_queue_flushes_since_trim;
+static struct cmd_queue_stats cmd_queue_stats;
 
 struct jtag_command *jtag_command_queue;
 static struct jtag_command **next_command_pointer = &jtag_command_queue;
@@ -74,10 +87,60 @@ void jtag_queue_command(struct jtag_command *cmd)
 	next_command_pointer = &cmd->next;
 }
 
+static struct cmd_queue_page *cmd_queue_get_page(size_t size)
+{
+	struct cmd_queue_page *page;
+
+	if (size <= CMD_QUEUE_PAGE_SIZE && cmd_queue_free_pages) {
+		page = cmd_queue_free_pages;
+		cmd_queue_free_pages = page->next;
+		cmd_queue_free_count--;
+		cmd_queue_stats.reused_pages++;
+	} else {
+		page = malloc(sizeof(struct cmd_queue_page));
+		if (!page)
+			return NULL;
+		page->size = (size < CMD_QUEUE_PAGE_SIZE) ? CMD_QUEUE_PAGE_SIZE : size;
+		page->address = malloc(page->size);
+		if (!page->address) {
+			free(page);
+			return NULL;
+		}
+		cmd_queue_stats.allocated_pages++;
+		cmd_queue_stats.pages++;
+		cmd_queue_stats.bytes += page->size;
+	}
+
+	page->used = 0;
+	page->next = NULL;
+
+	if (cmd_queue_pages_tail)
+		cmd_queue_pages_tail->next = page;
+	else
+		cmd_queue_pages = page;
+	cmd_queue_pages_tail = page;
+
+	cmd_queue_used_pages++;
+	if (cmd_queue_used_pages > cmd_queue_stats.peak_pages)
+		cmd_queue_stats.peak_pages = cmd_queue_used_pages;
+	if (cmd_queue_stats.bytes > cmd_queue_stats.peak_bytes)
+		cmd_queue_stats.peak_bytes = cmd_queue_stats.bytes;
+
+	return page;
+}
+
+static void cmd_queue_release_page(struct cmd_queue_page *page)
+{
+	cmd_queue_stats.pages--;
+	cmd_queue_stats.bytes -= page->size;
+	free(page->address);
+	free(page);
+}
+
 void *cmd_queue_alloc(size_t size)
 {
-	struct cmd_queue_page **p_page = &cmd_queue_pages;
-	int offset;
+	struct cmd_queue_page *page = cmd_queue_pages_tail;
+	size_t offset;
 	uint8_t *t;
 
 	/*
@@ -112,42 +175,79 @@ void *cmd_queue_alloc(size_t size)
 	size = (size + ALIGN_SIZE - 1) & (~(ALIGN_SIZE - 1));
 	/* Done... */
 
-	if (*p_page) {
-		p_page = &cmd_queue_pages_tail;
-		if (CMD_QUEUE_PAGE_SIZE - (*p_page)->used < size)
-			p_page = &((*p_page)->next);
-	}
-
-	if (!*p_page) {
-		*p_page = malloc(sizeof(struct cmd_queue_page));
-		(*p_page)->used = 0;
-		size_t alloc_size = (size < CMD_QUEUE_PAGE_SIZE) ?
-					CMD_QUEUE_PAGE_SIZE : size;
-		(*p_page)->address = malloc(alloc_size);
-		(*p_page)->next = NULL;
-		cmd_queue_pages_tail = *p_page;
+	if (!page || page->size - page->used < size) {
+		page = cmd_queue_get_page(size);
+		if (!page) {
+			LOG_ERROR("Out of memory");
+			return NULL;
+		}
 	}
 
-	offset = (*p_page)->used;
-	(*p_page)->used += size;
+	offset = page->used;
+	page->used += size;
 
-	t = (*p_page)->address;
+	t = page->address;
 	return t + offset;
 }
 
+static void cmd_queue_trim(unsigned int keep)
+{
+	while (cmd_queue_free_count > keep) {
+		struct cmd_queue_page *page = cmd_queue_free_pages;
+		cmd_queue_free_pages = page->next;
+		cmd_queue_free_count--;
+		cmd_queue_release_page(page);
+	}
+}
+
+/*
+ * Pages are not given back to the system after each flush, they are kept
+ * for the next queue. Every CMD_QUEUE_TRIM_INTERVAL flushes the pool is
+ * trimmed down to the largest number of pages a queue needed during that
+ * interval, so a single huge transfer does not pin memory forever.
+ */
 static void cmd_queue_free(void)
 {
 	struct cmd_queue_page *page = cmd_queue_pages;
 
+	if (cmd_queue_used_pages > cmd_queue_interval_peak)
+		cmd_queue_interval_peak = cmd_queue_used_pages;
+
 	while (page) {
-		struct cmd_queue_page *last = page;
-		free(page->address);
-		page = page->next;
-		free(last);
+		struct cmd_queue_page *next = page->next;
+
+		if (page->size == CMD_QUEUE_PAGE_SIZE) {
+			page->next = cmd_queue_free_pages;
+			cmd_queue_free_pages = page;
+			cmd_queue_free_count++;
+		} else {
+			/* oversized pages are one-offs, don't keep them */
+			cmd_queue_release_page(page);
+		}
+		page = next;
 	}
 
 	cmd_queue_pages = NULL;
 	cmd_queue_pages_tail = NULL;
+	cmd_queue_used_pages = 0;
+
+	if (++cmd_queue_flushes_since_trim >= CMD_QUEUE_TRIM_INTERVAL) {
+		cmd_queue_trim(cmd_queue_interval_peak);
+		cmd_queue_interval_peak = 0;
+		cmd_queue_flushes_since_trim = 0;
+	}
+}
+
+void cmd_queue_get_stats(struct cmd_queue_stats *stats)
+{
+	*stats = cmd_queue_stats;
+}
+
+/** Release all queue memory, including the pages kept for reuse. */
+void jtag_command_queue_free(void)
+{
+	jtag_command_queue_reset();
+	cmd_queue_trim(0);
 }
 
 void jtag_command_queue_reset(void)
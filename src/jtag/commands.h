@@ -163,10 +163,26 @@ struct jtag_command {
 /** The current queue of jtag_command_s structures. */
 extern struct jtag_command *jtag_command_queue;
 
+/** Memory usage of the command queue allocator. */
+struct cmd_queue_stats {
+	/** pages currently owned, in use or kept for reuse, and their size */
+	unsigned int pages;
+	size_t bytes;
+	/** most pages used by a single queue */
+	unsigned int peak_pages;
+	/** most bytes owned at any time, in use or kept for reuse */
+	size_t peak_bytes;
+	/** pages obtained from malloc() resp. taken from the reuse pool */
+	unsigned long allocated_pages;
+	unsigned long reused_pages;
+};
+
 void *cmd_queue_alloc(size_t size);
+void cmd_queue_get_stats(struct cmd_queue_stats *stats);
 
 void jtag_queue_command(struct jtag_command *cmd);
 void jtag_command_queue_reset(void);
+void jtag_command_queue_free(void);
 
 void jtag_scan_field_clone(struct scan_field *dst, const struct scan_field *src);
 enum scan_type jtag_scan_type(const struct scan_command *cmd);
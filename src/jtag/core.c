@@ -33,6 +33,7 @@
 #include "jtag.h"
 #include "swd.h"
 #include "interface.h"
+#include "commands.h"
 #include <transport/transport.h>
 #include <helper/jep106.h>
 
@@ -1657,6 +1658,8 @@ int adapter_quit(void)
 		t = n;
 	}
 
+	jtag_command_queue_free();
+
 	return ERROR_OK;
 }
 
@@ -362,6 +362,10 @@ int bitbang_execute_queue(void)
 				break;
 			case JTAG_SLEEP:
 				LOG_DEBUG_IO("sleep %" PRIu32, cmd->cmd.sleep->us);
+				if (bitbang_interface->flush) {
+					if (bitbang_interface->flush() != ERROR_OK)
+						return ERROR_FAIL;
+				}
 				jtag_sleep(cmd->cmd.sleep->us);
 				break;
 			case JTAG_TMS:
@@ -377,6 +381,10 @@ int bitbang_execute_queue(void)
 		if (bitbang_interface->blink(0) != ERROR_OK)
 			return ERROR_FAIL;
 	}
+	if (bitbang_interface->flush) {
+		if (bitbang_interface->flush() != ERROR_OK)
+			return ERROR_FAIL;
+	}
 
 	return retval;
 }
@@ -57,6 +57,10 @@ struct bitbang_interface {
 	/** Blink led (optional). */
 	int (*blink)(int on);
 
+	/** Send all buffered writes to the hardware (optional). Called before
+	 * sleeping and at the end of each queue execution. */
+	int (*flush)(void);
+
 	/** Sample SWDIO and return the value. */
 	int (*swdio_read)(void);
 
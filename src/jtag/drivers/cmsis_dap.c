@@ -40,6 +40,7 @@
 #include <jtag/interface.h>
 #include <jtag/commands.h>
 #include <jtag/tcl.h>
+#include <helper/time_support.h>
 
 #include "cmsis_dap.h"
 
@@ -179,6 +180,8 @@ struct pending_transfer_result {
 struct pending_request_block {
 	struct pending_transfer_result *transfers;
 	int transfer_count;
+	/* CMD_DAP_TFER, or CMD_DAP_TFER_BLOCK if all transfers share one cmd */
+	uint8_t command;
 };
 
 struct pending_scan_result {
@@ -193,16 +196,31 @@ struct pending_scan_result {
 };
 
 /* Up to MIN(packet_count, MAX_PENDING_REQUESTS) requests may be issued
- * until the first response arrives */
-#define MAX_PENDING_REQUESTS 3
+ * until the first response arrives. The packet count reported by the
+ * adapter is a byte, so this does not limit it at all. */
+#define MAX_PENDING_REQUESTS 255
 
 /* Pending requests are organized as a FIFO - circular buffer */
-/* Each block in FIFO can contain up to pending_queue_len transfers */
+/* Each CMD_DAP_TFER block in FIFO can contain up to pending_queue_len
+ * transfers, a CMD_DAP_TFER_BLOCK block up to cmsis_dap_tfer_block_len() */
 static int pending_queue_len;
 static struct pending_request_block pending_fifo[MAX_PENDING_REQUESTS];
 static int pending_fifo_put_idx, pending_fifo_get_idx;
 static int pending_fifo_block_count;
 
+/* A run of this many identical AP accesses (typically MEM-AP DRW with
+ * address auto-increment) is moved to a CMD_DAP_TFER_BLOCK packet */
+#define TFER_BLOCK_MIN_RUN 8
+
+/* SWD throughput statistics, see "cmsis-dap stats" */
+static struct {
+	uint64_t transfers;
+	uint64_t tfer_packets;
+	uint64_t tfer_block_packets;
+	uint64_t busy_ms;
+} swd_stats;
+static int64_t swd_queue_start;
+
 /* pointers to buffers that will receive jtag scan results on the next flush */
 #define MAX_PENDING_SCAN_RESULTS 256
 static int pending_scan_result_count;
@@ -597,44 +615,68 @@ static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
 	if (block->transfer_count == 0)
 		goto skip;
 
-	command[0] = CMD_DAP_TFER;
-	command[1] = 0x00;	/* DAP Index */
-	command[2] = block->transfer_count;
-	size_t idx = 3;
-
-	for (int i = 0; i < block->transfer_count; i++) {
-		struct pending_transfer_result *transfer = &(block->transfers[i]);
-		uint8_t cmd = transfer->cmd;
-		uint32_t data = transfer->data;
+	size_t idx;
+	if (block->command == CMD_DAP_TFER_BLOCK) {
+		/* All transfers of the block share the same request */
+		uint8_t cmd = block->transfers[0].cmd;
 
-		LOG_DEBUG_IO("%s %s reg %x %"PRIx32,
+		LOG_DEBUG_IO("%s %s reg %x block of %d",
 				cmd & SWD_CMD_APnDP ? "AP" : "DP",
 				cmd & SWD_CMD_RnW ? "read" : "write",
-			  (cmd & SWD_CMD_A32) >> 1, data);
-
-		/* When proper WAIT handling is implemented in the
-		 * common SWD framework, this kludge can be
-		 * removed. However, this might lead to minor
-		 * performance degradation as the adapter wouldn't be
-		 * able to automatically retry anything (because ARM
-		 * has forgotten to implement sticky error flags
-		 * clearing). See also comments regarding
-		 * cmsis_dap_cmd_DAP_TFER_Configure() and
-		 * cmsis_dap_cmd_DAP_SWD_Configure() in
-		 * cmsis_dap_init().
-		 */
-		if (!(cmd & SWD_CMD_RnW) &&
-		    !(cmd & SWD_CMD_APnDP) &&
-		    (cmd & SWD_CMD_A32) >> 1 == DP_CTRL_STAT &&
-		    (data & CORUNDETECT)) {
-			LOG_DEBUG("refusing to enable sticky overrun detection");
-			data &= ~CORUNDETECT;
-		}
+				(cmd & SWD_CMD_A32) >> 1, block->transfer_count);
+
+		command[0] = CMD_DAP_TFER_BLOCK;
+		command[1] = 0x00;	/* DAP Index */
+		h_u16_to_le(&command[2], block->transfer_count);
+		command[4] = (cmd >> 1) & 0x0f;
+		idx = 5;
 
-		command[idx++] = (cmd >> 1) & 0x0f;
 		if (!(cmd & SWD_CMD_RnW)) {
-			h_u32_to_le(&command[idx], data);
-			idx += 4;
+			for (int i = 0; i < block->transfer_count; i++) {
+				h_u32_to_le(&command[idx], block->transfers[i].data);
+				idx += 4;
+			}
+		}
+	} else {
+		command[0] = CMD_DAP_TFER;
+		command[1] = 0x00;	/* DAP Index */
+		command[2] = block->transfer_count;
+		idx = 3;
+
+		for (int i = 0; i < block->transfer_count; i++) {
+			struct pending_transfer_result *transfer = &(block->transfers[i]);
+			uint8_t cmd = transfer->cmd;
+			uint32_t data = transfer->data;
+
+			LOG_DEBUG_IO("%s %s reg %x %"PRIx32,
+					cmd & SWD_CMD_APnDP ? "AP" : "DP",
+					cmd & SWD_CMD_RnW ? "read" : "write",
+				  (cmd & SWD_CMD_A32) >> 1, data);
+
+			/* When proper WAIT handling is implemented in the
+			 * common SWD framework, this kludge can be
+			 * removed. However, this might lead to minor
+			 * performance degradation as the adapter wouldn't be
+			 * able to automatically retry anything (because ARM
+			 * has forgotten to implement sticky error flags
+			 * clearing). See also comments regarding
+			 * cmsis_dap_cmd_DAP_TFER_Configure() and
+			 * cmsis_dap_cmd_DAP_SWD_Configure() in
+			 * cmsis_dap_init().
+			 */
+			if (!(cmd & SWD_CMD_RnW) &&
+			    !(cmd & SWD_CMD_APnDP) &&
+			    (cmd & SWD_CMD_A32) >> 1 == DP_CTRL_STAT &&
+			    (data & CORUNDETECT)) {
+				LOG_DEBUG("refusing to enable sticky overrun detection");
+				data &= ~CORUNDETECT;
+			}
+
+			command[idx++] = (cmd >> 1) & 0x0f;
+			if (!(cmd & SWD_CMD_RnW)) {
+				h_u32_to_le(&command[idx], data);
+				idx += 4;
+			}
 		}
 	}
 
@@ -647,6 +689,11 @@ static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
 		queued_retval = ERROR_OK;
 	}
 
+	if (block->command == CMD_DAP_TFER_BLOCK)
+		swd_stats.tfer_block_packets++;
+	else
+		swd_stats.tfer_packets++;
+
 	pending_fifo_put_idx = (pending_fifo_put_idx + 1) % dap->packet_count;
 	pending_fifo_block_count++;
 	if (pending_fifo_block_count > dap->packet_count)
@@ -677,16 +724,28 @@ static void cmsis_dap_swd_read_process(struct cmsis_dap *dap, int timeout_ms)
 	}
 
 	uint8_t *resp = dap->response;
-	if (resp[0] != CMD_DAP_TFER) {
+	if (resp[0] != block->command) {
 		LOG_ERROR("CMSIS-DAP command mismatch. Expected 0x%" PRIx8
-			 " received 0x%" PRIx8, CMD_DAP_TFER, resp[0]);
+			 " received 0x%" PRIx8, block->command, resp[0]);
 		queued_retval = ERROR_FAIL;
 		goto skip;
 	}
 
-	uint8_t transfer_count = resp[1];
-	uint8_t ack = resp[2] & 0x07;
-	if (resp[2] & 0x08) {
+	int transfer_count;
+	uint8_t response;
+	size_t idx;
+	if (block->command == CMD_DAP_TFER_BLOCK) {
+		transfer_count = le_to_h_u16(&resp[1]);
+		response = resp[3];
+		idx = 4;
+	} else {
+		transfer_count = resp[1];
+		response = resp[2];
+		idx = 3;
+	}
+
+	uint8_t ack = response & 0x07;
+	if (response & 0x08) {
 		LOG_DEBUG("CMSIS-DAP Protocol Error @ %d (wrong parity)", transfer_count);
 		queued_retval = ERROR_FAIL;
 		goto skip;
@@ -699,13 +758,15 @@ static void cmsis_dap_swd_read_process(struct cmsis_dap *dap, int timeout_ms)
 		goto skip;
 	}
 
-	if (block->transfer_count != transfer_count)
+	if (block->transfer_count != transfer_count) {
 		LOG_ERROR("CMSIS-DAP transfer count mismatch: expected %d, got %d",
 			  block->transfer_count, transfer_count);
+		transfer_count = MIN(transfer_count, block->transfer_count);
+	}
 
 	LOG_DEBUG_IO("Received results of %d queued transactions FIFO index %d",
 		 transfer_count, pending_fifo_get_idx);
-	size_t idx = 3;
+	swd_stats.transfers += transfer_count;
 	for (int i = 0; i < transfer_count; i++) {
 		struct pending_transfer_result *transfer = &(block->transfers[i]);
 		if (transfer->cmd & SWD_CMD_RnW) {
@@ -736,9 +797,6 @@ skip:
 
 static int cmsis_dap_swd_run_queue(void)
 {
-	if (pending_fifo_block_count)
-		cmsis_dap_swd_read_process(cmsis_dap_handle, 0);
-
 	cmsis_dap_swd_write_from_queue(cmsis_dap_handle);
 
 	while (pending_fifo_block_count)
@@ -747,26 +805,86 @@ static int cmsis_dap_swd_run_queue(void)
 	pending_fifo_put_idx = 0;
 	pending_fifo_get_idx = 0;
 
+	if (swd_queue_start) {
+		swd_stats.busy_ms += timeval_ms() - swd_queue_start;
+		swd_queue_start = 0;
+	}
+
 	int retval = queued_retval;
 	queued_retval = ERROR_OK;
 
 	return retval;
 }
 
+/* Maximum number of transfers in a CMD_DAP_TFER_BLOCK packet: the request
+ * carries a 5 byte header plus the data of writes, the response a 4 byte
+ * header plus the data of reads */
+static int cmsis_dap_tfer_block_len(uint8_t cmd)
+{
+	int header = (cmd & SWD_CMD_RnW) ? 4 : 5;
+
+	return (cmsis_dap_handle->packet_size - header) / 4;
+}
+
+/* Send the block being filled and make the next FIFO entry available */
+static void cmsis_dap_swd_next_block(void)
+{
+	cmsis_dap_swd_write_from_queue(cmsis_dap_handle);
+
+	if (pending_fifo_block_count >= cmsis_dap_handle->packet_count)
+		cmsis_dap_swd_read_process(cmsis_dap_handle, USB_TIMEOUT);
+}
+
+/* Check whether cmd repeats an AP access often enough at the end of the
+ * block being filled to continue it in a CMD_DAP_TFER_BLOCK packet */
+static bool cmsis_dap_swd_starts_block(struct pending_request_block *block, uint8_t cmd)
+{
+	if (!(cmd & SWD_CMD_APnDP) || block->transfer_count < TFER_BLOCK_MIN_RUN - 1)
+		return false;
+
+	for (int i = 1; i < TFER_BLOCK_MIN_RUN; i++) {
+		if (block->transfers[block->transfer_count - i].cmd != cmd)
+			return false;
+	}
+
+	return true;
+}
+
 static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 {
 	bool targetsel_cmd = swd_cmd(false, false, DP_TARGETSEL) == cmd;
+	struct pending_request_block *block = &pending_fifo[pending_fifo_put_idx];
 
-	if (pending_fifo[pending_fifo_put_idx].transfer_count == pending_queue_len
-			 || targetsel_cmd) {
-		if (pending_fifo_block_count)
-			cmsis_dap_swd_read_process(cmsis_dap_handle, 0);
+	if (!swd_queue_start)
+		swd_queue_start = timeval_ms();
 
+	if (block->command == CMD_DAP_TFER_BLOCK && block->transfer_count) {
+		/* Not the same access or no room in the packet. Send it. */
+		if (block->transfers[0].cmd != cmd
+				|| block->transfer_count == cmsis_dap_tfer_block_len(cmd)
+				|| targetsel_cmd)
+			cmsis_dap_swd_next_block();
+	} else if (block->transfer_count == pending_queue_len || targetsel_cmd) {
 		/* Not enough room in the queue. Run the queue. */
-		cmsis_dap_swd_write_from_queue(cmsis_dap_handle);
+		cmsis_dap_swd_next_block();
+	} else if (cmsis_dap_swd_starts_block(block, cmd)) {
+		/* Move the run of identical accesses to a block transfer,
+		 * the transfers before it go out in their own packet */
+		struct pending_transfer_result run[TFER_BLOCK_MIN_RUN - 1];
+		int first = block->transfer_count - ARRAY_SIZE(run);
+
+		memcpy(run, &block->transfers[first], sizeof(run));
+		if (first) {
+			block->transfer_count = first;
+			cmsis_dap_swd_next_block();
+			if (queued_retval != ERROR_OK)
+				return;
+		}
 
-		if (pending_fifo_block_count >= cmsis_dap_handle->packet_count)
-			cmsis_dap_swd_read_process(cmsis_dap_handle, USB_TIMEOUT);
+		block = &pending_fifo[pending_fifo_put_idx];
+		memcpy(block->transfers, run, sizeof(run));
+		block->transfer_count = ARRAY_SIZE(run);
+		block->command = CMD_DAP_TFER_BLOCK;
 	}
 
 	if (queued_retval != ERROR_OK)
@@ -777,7 +895,10 @@ static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 		return;
 	}
 
-	struct pending_request_block *block = &pending_fifo[pending_fifo_put_idx];
+	block = &pending_fifo[pending_fifo_put_idx];
+	if (!block->transfer_count)
+		block->command = CMD_DAP_TFER;
+
 	struct pending_transfer_result *transfer = &(block->transfers[block->transfer_count]);
 	transfer->data = data;
 	transfer->cmd = cmd;
@@ -1012,8 +1133,8 @@ static int cmsis_dap_init(void)
 		if (pkt_sz != cmsis_dap_handle->packet_size) {
 
 			/* 4 bytes of command header + 5 bytes per register
-			 * write. For bulk read sequences just 4 bytes are
-			 * needed per transfer, so this is suboptimal. */
+			 * write. Bulk read and write sequences go out as
+			 * CMD_DAP_TFER_BLOCK with just 4 bytes per transfer. */
 			pending_queue_len = (pkt_sz - 4) / 5;
 
 			free(cmsis_dap_handle->packet_buffer);
@@ -1038,9 +1159,12 @@ static int cmsis_dap_init(void)
 		LOG_DEBUG("CMSIS-DAP: Packet Count = %d", pkt_cnt);
 	}
 
+	/* Block transfers of reads fit the most transfers into a packet */
+	int block_len = MAX(pending_queue_len, cmsis_dap_tfer_block_len(SWD_CMD_RnW));
+
 	LOG_DEBUG("Allocating FIFO for %d pending packets", cmsis_dap_handle->packet_count);
 	for (int i = 0; i < cmsis_dap_handle->packet_count; i++) {
-		pending_fifo[i].transfers = malloc(pending_queue_len * sizeof(struct pending_transfer_result));
+		pending_fifo[i].transfers = malloc(block_len * sizeof(struct pending_transfer_result));
 		if (!pending_fifo[i].transfers) {
 			LOG_ERROR("Unable to allocate memory for CMSIS-DAP queue");
 			retval = ERROR_FAIL;
@@ -1668,6 +1792,29 @@ COMMAND_HANDLER(cmsis_dap_handle_cmd_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(cmsis_dap_handle_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(&swd_stats, 0, sizeof(swd_stats));
+		return ERROR_OK;
+	}
+
+	uint64_t bytes = swd_stats.transfers * 4;
+	command_print(CMD, "%" PRIu64 " SWD transfers in %" PRIu64 " DAP_Transfer and %"
+			PRIu64 " DAP_TransferBlock packets", swd_stats.transfers,
+			swd_stats.tfer_packets, swd_stats.tfer_block_packets);
+	if (swd_stats.busy_ms)
+		command_print(CMD, "%" PRIu64 " bytes in %" PRIu64 " ms (%" PRIu64 " bytes/s)",
+				bytes, swd_stats.busy_ms, bytes * 1000 / swd_stats.busy_ms);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(cmsis_dap_handle_vid_pid_command)
 {
 	if (CMD_ARGC > MAX_USB_IDS * 2) {
@@ -1745,6 +1892,13 @@ static const struct command_registration cmsis_dap_subcommand_handlers[] = {
 		.usage = "",
 		.help = "issue cmsis-dap command",
 	},
+	{
+		.name = "stats",
+		.handler = &cmsis_dap_handle_stats_command,
+		.mode = COMMAND_EXEC,
+		.usage = "['reset']",
+		.help = "show or reset SWD transfer statistics",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
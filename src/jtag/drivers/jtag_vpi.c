@@ -49,6 +49,11 @@
 #define CMD_SCAN_CHAIN_FLIP_TMS	3
 #define CMD_STOP_SIMU		4
 
+/* Maximum number of commands sent before their responses are read. This has
+ * to stay well below what fits into the socket buffers, or the server blocks
+ * writing responses while we block writing commands. */
+#define MAX_PENDING_CMDS	32
+
 /* jtag_vpi server port and address to connect to */
 static int server_port = SERVER_PORT;
 static char *server_address;
@@ -77,6 +82,31 @@ struct vpi_cmd {
 	};
 };
 
+/* Commands not sent to the server yet. */
+static struct vpi_cmd send_buf[MAX_PENDING_CMDS];
+static unsigned int send_count;
+
+/* TMS bits not sent yet, consecutive TMS sequences go into one command. */
+static uint8_t tms_buf[XFERT_MAX_SIZE];
+static unsigned int tms_buf_bits;
+
+/* Scan commands sent whose response has not been read yet, and where to
+ * store the TDO data of each (NULL if not needed). */
+static struct {
+	uint8_t *bits;
+	int nb_bits;
+} pending_xfer[MAX_PENDING_CMDS];
+static unsigned int pending_count;
+static struct vpi_cmd recv_buf[MAX_PENDING_CMDS];
+
+/* Scans which have been sent completely, but whose TDO data still has to be
+ * handed back once all responses are in. */
+static struct {
+	struct scan_command *cmd;
+	uint8_t *buf;
+} pending_scan[MAX_PENDING_CMDS];
+static unsigned int pending_scan_count;
+
 static char *jtag_vpi_cmd_to_str(int cmd_num)
 {
 	switch (cmd_num) {
@@ -95,10 +125,80 @@ static char *jtag_vpi_cmd_to_str(int cmd_num)
 	}
 }
 
+static int jtag_vpi_write_cmds(void)
+{
+	size_t size = send_count * sizeof(struct vpi_cmd);
+	size_t bytes_sent = 0;
+
+	while (bytes_sent < size) {
+		int retval = write_socket(sockfd, ((char *)send_buf) + bytes_sent,
+				size - bytes_sent);
+
+		if (retval < 0) {
+			/* Account for the case when socket write is interrupted. */
+#ifdef _WIN32
+			int wsa_err = WSAGetLastError();
+			if (wsa_err == WSAEINTR)
+				continue;
+#else
+			if (errno == EINTR)
+				continue;
+#endif
+			/* Otherwise this is an error using the socket, most likely fatal
+			   for the connection. */
+			log_socket_error("jtag_vpi xmit");
+			/* TODO: Clean way how adapter drivers can report fatal errors
+			   to upper layers of OpenOCD and let it perform an orderly shutdown? */
+			exit(-1);
+		} else if (retval == 0) {
+			LOG_ERROR("Could not send all data through jtag_vpi connection.");
+			exit(-1);
+		}
+
+		bytes_sent += retval;
+	}
+
+	send_count = 0;
+
+	return ERROR_OK;
+}
+
+static int jtag_vpi_queue_cmd(struct vpi_cmd *vpi);
+
+/* Send the collected TMS bits as one CMD_TMS_SEQ. */
+static int jtag_vpi_flush_tms(void)
+{
+	struct vpi_cmd vpi;
+	int nb_bytes;
+
+	if (!tms_buf_bits)
+		return ERROR_OK;
+
+	memset(&vpi, 0, sizeof(struct vpi_cmd));
+	nb_bytes = DIV_ROUND_UP(tms_buf_bits, 8);
+
+	vpi.cmd = CMD_TMS_SEQ;
+	memcpy(vpi.buffer_out, tms_buf, nb_bytes);
+	vpi.length = nb_bytes;
+	vpi.nb_bits = tms_buf_bits;
+
+	memset(tms_buf, 0, nb_bytes);
+	tms_buf_bits = 0;
+
+	return jtag_vpi_queue_cmd(&vpi);
+}
+
 static int jtag_vpi_send_cmd(struct vpi_cmd *vpi)
 {
-	int retval;
+	int retval = jtag_vpi_flush_tms();
+	if (retval != ERROR_OK)
+		return retval;
 
+	return jtag_vpi_queue_cmd(vpi);
+}
+
+static int jtag_vpi_queue_cmd(struct vpi_cmd *vpi)
+{
 	/* Optional low-level JTAG debug */
 	if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
 		if (vpi->nb_bits > 0) {
@@ -136,43 +236,29 @@ static int jtag_vpi_send_cmd(struct vpi_cmd *vpi)
 	h_u32_to_le(vpi->length_buf, vpi->length);
 	h_u32_to_le(vpi->nb_bits_buf, vpi->nb_bits);
 
-retry_write:
-	retval = write_socket(sockfd, vpi, sizeof(struct vpi_cmd));
-
-	if (retval < 0) {
-		/* Account for the case when socket write is interrupted. */
-#ifdef _WIN32
-		int wsa_err = WSAGetLastError();
-		if (wsa_err == WSAEINTR)
-			goto retry_write;
-#else
-		if (errno == EINTR)
-			goto retry_write;
-#endif
-		/* Otherwise this is an error using the socket, most likely fatal
-		   for the connection. B*/
-		log_socket_error("jtag_vpi xmit");
-		/* TODO: Clean way how adapter drivers can report fatal errors
-		   to upper layers of OpenOCD and let it perform an orderly shutdown? */
-		exit(-1);
-	} else if (retval < (int)sizeof(struct vpi_cmd)) {
-		/* This means we could not send all data, which is most likely fatal
-		   for the jtag_vpi connection (the underlying TCP connection likely not
-		   usable anymore) */
-		LOG_ERROR("Could not send all data through jtag_vpi connection.");
-		exit(-1);
-	}
+	send_buf[send_count++] = *vpi;
+	if (send_count == MAX_PENDING_CMDS)
+		return jtag_vpi_write_cmds();
 
-	/* Otherwise the packet has been sent successfully. */
 	return ERROR_OK;
 }
 
-static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
+static int jtag_vpi_read_responses(void)
 {
-	unsigned bytes_buffered = 0;
-	while (bytes_buffered < sizeof(struct vpi_cmd)) {
-		int bytes_to_receive = sizeof(struct vpi_cmd) - bytes_buffered;
-		int retval = read_socket(sockfd, ((char *)vpi) + bytes_buffered, bytes_to_receive);
+	size_t size = pending_count * sizeof(struct vpi_cmd);
+	size_t bytes_buffered = 0;
+
+	if (!pending_count)
+		return ERROR_OK;
+
+	int retval = jtag_vpi_write_cmds();
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* read all outstanding responses, in as few calls as possible */
+	while (bytes_buffered < size) {
+		retval = read_socket(sockfd, ((char *)recv_buf) + bytes_buffered,
+				size - bytes_buffered);
 		if (retval < 0) {
 #ifdef _WIN32
 			int wsa_err = WSAGetLastError();
@@ -198,14 +284,57 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
 		bytes_buffered += retval;
 	}
 
-	/* Use little endian when transmitting/receiving jtag_vpi cmds. */
-	vpi->cmd = le_to_h_u32(vpi->cmd_buf);
-	vpi->length = le_to_h_u32(vpi->length_buf);
-	vpi->nb_bits = le_to_h_u32(vpi->nb_bits_buf);
+	for (unsigned int i = 0; i < pending_count; i++) {
+		struct vpi_cmd *vpi = &recv_buf[i];
+		int nb_bits = pending_xfer[i].nb_bits;
+
+		/* Optional low-level JTAG debug */
+		if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
+			char *char_buf = buf_to_hex_str(vpi->buffer_in,
+					(nb_bits > DEBUG_JTAG_IOZ) ? DEBUG_JTAG_IOZ : nb_bits);
+			LOG_DEBUG_IO("recvd JTAG VPI data: nb_bits=%d, buf_in=0x%s%s",
+				nb_bits, char_buf, (nb_bits > DEBUG_JTAG_IOZ) ? "(...)" : "");
+			free(char_buf);
+		}
+
+		if (pending_xfer[i].bits)
+			memcpy(pending_xfer[i].bits, vpi->buffer_in,
+				DIV_ROUND_UP(nb_bits, 8));
+	}
+
+	pending_count = 0;
 
 	return ERROR_OK;
 }
 
+/**
+ * jtag_vpi_flush - execute everything queued so far
+ *
+ * Sends all buffered commands, reads the outstanding responses and hands the
+ * TDO data of completed scans back to the JTAG layer.
+ */
+static int jtag_vpi_flush(void)
+{
+	int retval = jtag_vpi_flush_tms();
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = jtag_vpi_read_responses();
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = jtag_vpi_write_cmds();
+
+	for (unsigned int i = 0; i < pending_scan_count; i++) {
+		if (jtag_read_buffer(pending_scan[i].buf, pending_scan[i].cmd) != ERROR_OK)
+			retval = ERROR_JTAG_QUEUE_FAILED;
+		free(pending_scan[i].buf);
+	}
+	pending_scan_count = 0;
+
+	return retval;
+}
+
 /**
  * jtag_vpi_reset - ask to reset the JTAG device
  * @param trst 1 if TRST is to be asserted
@@ -234,18 +363,19 @@ static int jtag_vpi_reset(int trst, int srst)
  */
 static int jtag_vpi_tms_seq(const uint8_t *bits, int nb_bits)
 {
-	struct vpi_cmd vpi;
-	int nb_bytes;
-
-	memset(&vpi, 0, sizeof(struct vpi_cmd));
-	nb_bytes = DIV_ROUND_UP(nb_bits, 8);
+	for (int i = 0; i < nb_bits; i++) {
+		if (tms_buf_bits == XFERT_MAX_SIZE * 8) {
+			int retval = jtag_vpi_flush_tms();
+			if (retval != ERROR_OK)
+				return retval;
+		}
 
-	vpi.cmd = CMD_TMS_SEQ;
-	memcpy(vpi.buffer_out, bits, nb_bytes);
-	vpi.length = nb_bytes;
-	vpi.nb_bits = nb_bits;
+		if (bits[i / 8] & (1 << (i % 8)))
+			tms_buf[tms_buf_bits / 8] |= 1 << (tms_buf_bits % 8);
+		tms_buf_bits++;
+	}
 
-	return jtag_vpi_send_cmd(&vpi);
+	return ERROR_OK;
 }
 
 /**
@@ -317,25 +447,21 @@ static int jtag_vpi_queue_tdi_xfer(uint8_t *bits, int nb_bits, int tap_shift)
 	vpi.length = nb_bytes;
 	vpi.nb_bits = nb_bits;
 
+	/* make room for the response of this command */
+	if (pending_count == MAX_PENDING_CMDS) {
+		int retval = jtag_vpi_read_responses();
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
 	int retval = jtag_vpi_send_cmd(&vpi);
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = jtag_vpi_receive_cmd(&vpi);
-	if (retval != ERROR_OK)
-		return retval;
-
-	/* Optional low-level JTAG debug */
-	if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
-		char *char_buf = buf_to_hex_str(vpi.buffer_in,
-				(nb_bits > DEBUG_JTAG_IOZ) ? DEBUG_JTAG_IOZ : nb_bits);
-		LOG_DEBUG_IO("recvd JTAG VPI data: nb_bits=%d, buf_in=0x%s%s",
-			nb_bits, char_buf, (nb_bits > DEBUG_JTAG_IOZ) ? "(...)" : "");
-		free(char_buf);
-	}
-
-	if (bits)
-		memcpy(bits, vpi.buffer_in, nb_bytes);
+	/* the response is read later, when the queue is flushed */
+	pending_xfer[pending_count].bits = bits;
+	pending_xfer[pending_count].nb_bits = nb_bits;
+	pending_count++;
 
 	return ERROR_OK;
 }
@@ -436,11 +562,15 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			tap_set_state(TAP_DRPAUSE);
 	}
 
-	retval = jtag_read_buffer(buf, cmd);
-	if (retval != ERROR_OK)
-		return retval;
-
-	free(buf);
+	/* the TDO data is handed back once the responses have been read */
+	pending_scan[pending_scan_count].cmd = cmd;
+	pending_scan[pending_scan_count].buf = buf;
+	pending_scan_count++;
+	if (pending_scan_count == MAX_PENDING_CMDS) {
+		retval = jtag_vpi_flush();
+		if (retval != ERROR_OK)
+			return retval;
+	}
 
 	if (cmd->end_state != TAP_DRSHIFT) {
 		retval = jtag_vpi_state_move(cmd->end_state);
@@ -459,6 +589,10 @@ static int jtag_vpi_runtest(int cycles, tap_state_t state)
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* The idle cycles are clocked as scans with TDI held high (CMD_SCAN_CHAIN
+	 * packets of up to XFERT_MAX_SIZE bytes), not as TMS sequences, so they
+	 * are not merged with the surrounding state moves. The server replies to
+	 * each of them; the replies are read with the others and dropped. */
 	retval = jtag_vpi_queue_tdi(NULL, cycles, NO_TAP_SHIFT);
 	if (retval != ERROR_OK)
 		return retval;
@@ -519,7 +653,9 @@ static int jtag_vpi_execute_queue(void)
 			retval = jtag_vpi_tms(cmd->cmd.tms);
 			break;
 		case JTAG_SLEEP:
-			jtag_sleep(cmd->cmd.sleep->us);
+			retval = jtag_vpi_flush();
+			if (retval == ERROR_OK)
+				jtag_sleep(cmd->cmd.sleep->us);
 			break;
 		case JTAG_SCAN:
 			retval = jtag_vpi_scan(cmd->cmd.scan);
@@ -532,6 +668,10 @@ static int jtag_vpi_execute_queue(void)
 		}
 	}
 
+	int flush_retval = jtag_vpi_flush();
+	if (retval == ERROR_OK)
+		retval = flush_retval;
+
 	return retval;
 }
 
@@ -585,7 +725,12 @@ static int jtag_vpi_stop_simulation(void)
 	cmd.length = 0;
 	cmd.nb_bits = 0;
 	cmd.cmd = CMD_STOP_SIMU;
-	return jtag_vpi_send_cmd(&cmd);
+
+	int retval = jtag_vpi_send_cmd(&cmd);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return jtag_vpi_write_cmds();
 }
 
 static int jtag_vpi_quit(void)
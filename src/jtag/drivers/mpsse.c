@@ -61,6 +61,24 @@
 #define SIO_RESET_PURGE_RX 1
 #define SIO_RESET_PURGE_TX 2
 
+/* Number of command buffers. While one of them is being filled, the others
+ * can be on the wire, so the adapter does not sit idle while the next batch
+ * of commands is built. */
+#define MPSSE_CHUNKS 4
+
+struct mpsse_chunk {
+	uint8_t *write_buffer;
+	unsigned write_count;
+	unsigned write_transferred;
+	uint8_t *read_buffer;
+	unsigned read_count;
+	unsigned read_transferred;
+	struct bit_copy_queue read_queue;
+	struct libusb_transfer *write_transfer;
+	bool write_done;
+	struct mpsse_ctx *ctx;
+};
+
 struct mpsse_ctx {
 	libusb_context *usb_ctx;
 	libusb_device_handle *usb_dev;
@@ -72,15 +90,20 @@ struct mpsse_ctx {
 	uint16_t index;
 	uint8_t interface;
 	enum ftdi_chip_type type;
-	uint8_t *write_buffer;
 	unsigned write_size;
-	unsigned write_count;
-	uint8_t *read_buffer;
 	unsigned read_size;
-	unsigned read_count;
+	struct mpsse_chunk chunks[MPSSE_CHUNKS];
+	/* chunk new commands are added to */
+	struct mpsse_chunk *cur;
+	/* chunks submitted and not yet completed, they precede cur in the ring */
+	unsigned in_flight;
+	/* All read data arrives in one stream, which is distributed over the
+	 * chunks in flight in submission order. A single read transfer is kept
+	 * active as long as any of them still expects data. */
 	uint8_t *read_chunk;
 	unsigned read_chunk_size;
-	struct bit_copy_queue read_queue;
+	struct libusb_transfer *read_transfer;
+	bool read_active;
 	int retval;
 };
 
@@ -326,21 +349,32 @@ struct mpsse_ctx *mpsse_open(const uint16_t *vid, const uint16_t *pid, const cha
 	if (!ctx)
 		return 0;
 
-	bit_copy_queue_init(&ctx->read_queue);
 	ctx->read_chunk_size = 16384;
 	ctx->read_size = 16384;
 	ctx->write_size = 16384;
 	ctx->read_chunk = malloc(ctx->read_chunk_size);
-	ctx->read_buffer = malloc(ctx->read_size);
+	ctx->read_transfer = libusb_alloc_transfer(0);
+	if (!ctx->read_chunk || !ctx->read_transfer)
+		goto error;
 
-	/* Use calloc to make valgrind happy: buffer_write() sets payload
-	 * on bit basis, so some bits can be left uninitialized in write_buffer.
-	 * Although this is perfectly ok with MPSSE, valgrind reports
-	 * Syscall param ioctl(USBDEVFS_SUBMITURB).buffer points to uninitialised byte(s) */
-	ctx->write_buffer = calloc(1, ctx->write_size);
+	for (unsigned i = 0; i < MPSSE_CHUNKS; i++) {
+		struct mpsse_chunk *chunk = &ctx->chunks[i];
 
-	if (!ctx->read_chunk || !ctx->read_buffer || !ctx->write_buffer)
-		goto error;
+		chunk->ctx = ctx;
+		bit_copy_queue_init(&chunk->read_queue);
+		chunk->read_buffer = malloc(ctx->read_size);
+
+		/* Use calloc to make valgrind happy: buffer_write() sets payload
+		 * on bit basis, so some bits can be left uninitialized in write_buffer.
+		 * Although this is perfectly ok with MPSSE, valgrind reports
+		 * Syscall param ioctl(USBDEVFS_SUBMITURB).buffer points to uninitialised byte(s) */
+		chunk->write_buffer = calloc(1, ctx->write_size);
+		chunk->write_transfer = libusb_alloc_transfer(0);
+
+		if (!chunk->read_buffer || !chunk->write_buffer || !chunk->write_transfer)
+			goto error;
+	}
+	ctx->cur = &ctx->chunks[0];
 
 	ctx->interface = channel;
 	ctx->index = channel + 1;
@@ -403,10 +437,19 @@ void mpsse_close(struct mpsse_ctx *ctx)
 		libusb_close(ctx->usb_dev);
 	if (ctx->usb_ctx)
 		libusb_exit(ctx->usb_ctx);
-	bit_copy_discard(&ctx->read_queue);
 
-	free(ctx->write_buffer);
-	free(ctx->read_buffer);
+	for (unsigned i = 0; i < MPSSE_CHUNKS; i++) {
+		struct mpsse_chunk *chunk = &ctx->chunks[i];
+
+		bit_copy_discard(&chunk->read_queue);
+		free(chunk->write_buffer);
+		free(chunk->read_buffer);
+		if (chunk->write_transfer)
+			libusb_free_transfer(chunk->write_transfer);
+	}
+
+	if (ctx->read_transfer)
+		libusb_free_transfer(ctx->read_transfer);
 	free(ctx->read_chunk);
 	free(ctx);
 }
@@ -416,14 +459,30 @@ bool mpsse_is_high_speed(struct mpsse_ctx *ctx)
 	return ctx->type != TYPE_FT2232C;
 }
 
+static void mpsse_cancel_transfers(struct mpsse_ctx *ctx);
+static int mpsse_submit(struct mpsse_ctx *ctx);
+
+/* Submit the current chunk to make room for more commands, unless the
+ * queue already failed. Returns false if the command has to be dropped. */
+static bool mpsse_make_space(struct mpsse_ctx *ctx)
+{
+	if (ctx->retval == ERROR_OK)
+		ctx->retval = mpsse_submit(ctx);
+	return ctx->retval == ERROR_OK;
+}
+
 void mpsse_purge(struct mpsse_ctx *ctx)
 {
 	int err;
 	LOG_DEBUG("-");
-	ctx->write_count = 0;
-	ctx->read_count = 0;
+	mpsse_cancel_transfers(ctx);
+	for (unsigned i = 0; i < MPSSE_CHUNKS; i++) {
+		ctx->chunks[i].write_count = 0;
+		ctx->chunks[i].read_count = 0;
+		bit_copy_discard(&ctx->chunks[i].read_queue);
+	}
+	ctx->in_flight = 0;
 	ctx->retval = ERROR_OK;
-	bit_copy_discard(&ctx->read_queue);
 	err = libusb_control_transfer(ctx->usb_dev, FTDI_DEVICE_OUT_REQTYPE, SIO_RESET_REQUEST,
 			SIO_RESET_PURGE_RX, ctx->index, NULL, 0, ctx->usb_write_timeout);
 	if (err < 0) {
@@ -442,39 +501,45 @@ void mpsse_purge(struct mpsse_ctx *ctx)
 static unsigned buffer_write_space(struct mpsse_ctx *ctx)
 {
 	/* Reserve one byte for SEND_IMMEDIATE */
-	return ctx->write_size - ctx->write_count - 1;
+	return ctx->write_size - ctx->cur->write_count - 1;
 }
 
 static unsigned buffer_read_space(struct mpsse_ctx *ctx)
 {
-	return ctx->read_size - ctx->read_count;
+	return ctx->read_size - ctx->cur->read_count;
 }
 
 static void buffer_write_byte(struct mpsse_ctx *ctx, uint8_t data)
 {
+	struct mpsse_chunk *chunk = ctx->cur;
+
 	LOG_DEBUG_IO("%02x", data);
-	assert(ctx->write_count < ctx->write_size);
-	ctx->write_buffer[ctx->write_count++] = data;
+	assert(chunk->write_count < ctx->write_size);
+	chunk->write_buffer[chunk->write_count++] = data;
 }
 
 static unsigned buffer_write(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_offset,
 	unsigned bit_count)
 {
+	struct mpsse_chunk *chunk = ctx->cur;
+
 	LOG_DEBUG_IO("%d bits", bit_count);
-	assert(ctx->write_count + DIV_ROUND_UP(bit_count, 8) <= ctx->write_size);
-	bit_copy(ctx->write_buffer + ctx->write_count, 0, out, out_offset, bit_count);
-	ctx->write_count += DIV_ROUND_UP(bit_count, 8);
+	assert(chunk->write_count + DIV_ROUND_UP(bit_count, 8) <= ctx->write_size);
+	bit_copy(chunk->write_buffer + chunk->write_count, 0, out, out_offset, bit_count);
+	chunk->write_count += DIV_ROUND_UP(bit_count, 8);
 	return bit_count;
 }
 
 static unsigned buffer_add_read(struct mpsse_ctx *ctx, uint8_t *in, unsigned in_offset,
 	unsigned bit_count, unsigned offset)
 {
+	struct mpsse_chunk *chunk = ctx->cur;
+
 	LOG_DEBUG_IO("%d bits, offset %d", bit_count, offset);
-	assert(ctx->read_count + DIV_ROUND_UP(bit_count, 8) <= ctx->read_size);
-	bit_copy_queued(&ctx->read_queue, in, in_offset, ctx->read_buffer + ctx->read_count, offset,
-		bit_count);
-	ctx->read_count += DIV_ROUND_UP(bit_count, 8);
+	assert(chunk->read_count + DIV_ROUND_UP(bit_count, 8) <= ctx->read_size);
+	bit_copy_queued(&chunk->read_queue, in, in_offset, chunk->read_buffer + chunk->read_count,
+		offset, bit_count);
+	chunk->read_count += DIV_ROUND_UP(bit_count, 8);
 	return bit_count;
 }
 
@@ -509,9 +574,9 @@ void mpsse_clock_data(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_of
 
 	while (length > 0) {
 		/* Guarantee buffer space enough for a minimum size transfer */
-		if (buffer_write_space(ctx) + (length < 8) < (out || (!out && !in) ? 4 : 3)
-				|| (in && buffer_read_space(ctx) < 1))
-			ctx->retval = mpsse_flush(ctx);
+		if ((buffer_write_space(ctx) + (length < 8) < (out || (!out && !in) ? 4 : 3)
+				|| (in && buffer_read_space(ctx) < 1)) && !mpsse_make_space(ctx))
+			return;
 
 		if (length < 8) {
 			/* Transfer remaining bits in bit mode */
@@ -584,8 +649,9 @@ void mpsse_clock_tms_cs(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_
 
 	while (length > 0) {
 		/* Guarantee buffer space enough for a minimum size transfer */
-		if (buffer_write_space(ctx) < 3 || (in && buffer_read_space(ctx) < 1))
-			ctx->retval = mpsse_flush(ctx);
+		if ((buffer_write_space(ctx) < 3 || (in && buffer_read_space(ctx) < 1))
+				&& !mpsse_make_space(ctx))
+			return;
 
 		/* Byte transfer */
 		unsigned this_bits = length;
@@ -627,8 +693,8 @@ void mpsse_set_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t d
 		return;
 	}
 
-	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+	if (buffer_write_space(ctx) < 3 && !mpsse_make_space(ctx))
+		return;
 
 	buffer_write_byte(ctx, 0x80);
 	buffer_write_byte(ctx, data);
@@ -644,8 +710,8 @@ void mpsse_set_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t
 		return;
 	}
 
-	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+	if (buffer_write_space(ctx) < 3 && !mpsse_make_space(ctx))
+		return;
 
 	buffer_write_byte(ctx, 0x82);
 	buffer_write_byte(ctx, data);
@@ -661,8 +727,8 @@ void mpsse_read_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t *data)
 		return;
 	}
 
-	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+	if ((buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1) && !mpsse_make_space(ctx))
+		return;
 
 	buffer_write_byte(ctx, 0x81);
 	buffer_add_read(ctx, data, 0, 8, 0);
@@ -677,8 +743,8 @@ void mpsse_read_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t *data)
 		return;
 	}
 
-	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+	if ((buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1) && !mpsse_make_space(ctx))
+		return;
 
 	buffer_write_byte(ctx, 0x83);
 	buffer_add_read(ctx, data, 0, 8, 0);
@@ -692,8 +758,8 @@ static void single_byte_boolean_helper(struct mpsse_ctx *ctx, bool var, uint8_t
 		return;
 	}
 
-	if (buffer_write_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+	if (buffer_write_space(ctx) < 1 && !mpsse_make_space(ctx))
+		return;
 
 	buffer_write_byte(ctx, var ? val_if_true : val_if_false);
 }
@@ -713,8 +779,8 @@ void mpsse_set_divisor(struct mpsse_ctx *ctx, uint16_t divisor)
 		return;
 	}
 
-	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+	if (buffer_write_space(ctx) < 3 && !mpsse_make_space(ctx))
+		return;
 
 	buffer_write_byte(ctx, 0x86);
 	buffer_write_byte(ctx, divisor & 0xff);
@@ -774,121 +840,145 @@ int mpsse_set_frequency(struct mpsse_ctx *ctx, int frequency)
 	return frequency;
 }
 
-/* Context needed by the callbacks */
-struct transfer_result {
-	struct mpsse_ctx *ctx;
-	bool done;
-	unsigned transferred;
-};
+static struct mpsse_chunk *chunk_next(struct mpsse_ctx *ctx, struct mpsse_chunk *chunk)
+{
+	return chunk == &ctx->chunks[MPSSE_CHUNKS - 1] ? &ctx->chunks[0] : chunk + 1;
+}
+
+static struct mpsse_chunk *oldest_chunk(struct mpsse_ctx *ctx)
+{
+	unsigned cur = ctx->cur - ctx->chunks;
+	return &ctx->chunks[(cur + MPSSE_CHUNKS - ctx->in_flight) % MPSSE_CHUNKS];
+}
+
+/* Returns the chunk in flight the next read data belongs to, NULL if none */
+static struct mpsse_chunk *read_target(struct mpsse_ctx *ctx)
+{
+	struct mpsse_chunk *chunk = oldest_chunk(ctx);
+
+	for (unsigned i = 0; i < ctx->in_flight; i++, chunk = chunk_next(ctx, chunk)) {
+		if (chunk->read_transferred < chunk->read_count)
+			return chunk;
+	}
+
+	return NULL;
+}
 
 static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 {
-	struct transfer_result *res = transfer->user_data;
-	struct mpsse_ctx *ctx = res->ctx;
+	struct mpsse_ctx *ctx = transfer->user_data;
 
 	unsigned packet_size = ctx->max_packet_size;
 
 	DEBUG_PRINT_BUF(transfer->buffer, transfer->actual_length);
 
 	/* Strip the two status bytes sent at the beginning of each USB packet
-	 * while copying the chunk buffer to the read buffer */
+	 * while copying the chunk buffer to the read buffers */
 	unsigned num_packets = DIV_ROUND_UP(transfer->actual_length, packet_size);
 	unsigned chunk_remains = transfer->actual_length;
 	for (unsigned i = 0; i < num_packets && chunk_remains > 2; i++) {
-		unsigned this_size = packet_size - 2;
-		if (this_size > chunk_remains - 2)
-			this_size = chunk_remains - 2;
-		if (this_size > ctx->read_count - res->transferred)
-			this_size = ctx->read_count - res->transferred;
-		memcpy(ctx->read_buffer + res->transferred,
-			ctx->read_chunk + packet_size * i + 2,
-			this_size);
-		res->transferred += this_size;
-		chunk_remains -= this_size + 2;
-		if (res->transferred == ctx->read_count) {
-			res->done = true;
-			break;
+		unsigned packet_remains = MIN(packet_size, chunk_remains) - 2;
+		const uint8_t *data = ctx->read_chunk + packet_size * i + 2;
+
+		chunk_remains -= packet_remains + 2;
+		while (packet_remains > 0) {
+			struct mpsse_chunk *chunk = read_target(ctx);
+			if (!chunk) {
+				LOG_DEBUG_IO("dropping %u unexpected bytes", packet_remains);
+				break;
+			}
+
+			unsigned this_size = MIN(packet_remains,
+					chunk->read_count - chunk->read_transferred);
+			memcpy(chunk->read_buffer + chunk->read_transferred, data, this_size);
+			chunk->read_transferred += this_size;
+			data += this_size;
+			packet_remains -= this_size;
 		}
 	}
 
-	LOG_DEBUG_IO("raw chunk %d, transferred %d of %d", transfer->actual_length, res->transferred,
-		ctx->read_count);
+	LOG_DEBUG_IO("raw chunk %d, %u chunks in flight", transfer->actual_length,
+		ctx->in_flight);
 
-	if (!res->done)
-		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
-			res->done = true;
+	if (transfer->status == LIBUSB_TRANSFER_COMPLETED ||
+			transfer->status == LIBUSB_TRANSFER_TIMED_OUT) {
+		if (read_target(ctx) && libusb_submit_transfer(transfer) == LIBUSB_SUCCESS)
+			return;
+	}
+
+	ctx->read_active = false;
 }
 
 static LIBUSB_CALL void write_cb(struct libusb_transfer *transfer)
 {
-	struct transfer_result *res = transfer->user_data;
-	struct mpsse_ctx *ctx = res->ctx;
+	struct mpsse_chunk *chunk = transfer->user_data;
+	struct mpsse_ctx *ctx = chunk->ctx;
 
-	res->transferred += transfer->actual_length;
+	chunk->write_transferred += transfer->actual_length;
 
-	LOG_DEBUG_IO("transferred %d of %d", res->transferred, ctx->write_count);
+	LOG_DEBUG_IO("transferred %d of %d", chunk->write_transferred, chunk->write_count);
 
 	DEBUG_PRINT_BUF(transfer->buffer, transfer->actual_length);
 
-	if (res->transferred == ctx->write_count)
-		res->done = true;
-	else {
-		transfer->length = ctx->write_count - res->transferred;
-		transfer->buffer = ctx->write_buffer + res->transferred;
-		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
-			res->done = true;
+	/* The rest of a partial write can only be sent as long as no later
+	 * chunk is queued behind it */
+	if (chunk->write_transferred < chunk->write_count && chunk_next(ctx, chunk) == ctx->cur &&
+			(transfer->status == LIBUSB_TRANSFER_COMPLETED ||
+			transfer->status == LIBUSB_TRANSFER_TIMED_OUT)) {
+		transfer->length = chunk->write_count - chunk->write_transferred;
+		transfer->buffer = chunk->write_buffer + chunk->write_transferred;
+		if (libusb_submit_transfer(transfer) == LIBUSB_SUCCESS)
+			return;
 	}
+
+	chunk->write_done = true;
 }
 
-int mpsse_flush(struct mpsse_ctx *ctx)
+static bool chunk_done(struct mpsse_ctx *ctx, struct mpsse_chunk *chunk)
 {
-	int retval = ctx->retval;
-
-	if (retval != ERROR_OK) {
-		LOG_DEBUG_IO("Ignoring flush due to previous error");
-		assert(ctx->write_count == 0 && ctx->read_count == 0);
-		ctx->retval = ERROR_OK;
-		return retval;
-	}
-
-	LOG_DEBUG_IO("write %d%s, read %d", ctx->write_count, ctx->read_count ? "+1" : "",
-			ctx->read_count);
-	assert(ctx->write_count > 0 || ctx->read_count == 0); /* No read data without write data */
+	return chunk->write_done &&
+		(chunk->read_transferred == chunk->read_count || !ctx->read_active);
+}
 
-	if (ctx->write_count == 0)
-		return retval;
+/* Cancel all transfers on the wire and wait until they are given back */
+static void mpsse_cancel_transfers(struct mpsse_ctx *ctx)
+{
+	struct mpsse_chunk *oldest = oldest_chunk(ctx);
+	struct mpsse_chunk *chunk = oldest;
 
-	struct libusb_transfer *read_transfer = 0;
-	struct transfer_result read_result = { .ctx = ctx, .done = true };
-	if (ctx->read_count) {
-		buffer_write_byte(ctx, 0x87); /* SEND_IMMEDIATE */
-		read_result.done = false;
-		/* delay read transaction to ensure the FTDI chip can support us with data
-		   immediately after processing the MPSSE commands in the write transaction */
+	for (unsigned i = 0; i < ctx->in_flight; i++, chunk = chunk_next(ctx, chunk)) {
+		if (!chunk->write_done)
+			libusb_cancel_transfer(chunk->write_transfer);
 	}
+	if (ctx->read_active)
+		libusb_cancel_transfer(ctx->read_transfer);
+
+	bool pending = true;
+	while (pending) {
+		pending = ctx->read_active;
+		chunk = oldest;
+		for (unsigned i = 0; i < ctx->in_flight; i++, chunk = chunk_next(ctx, chunk))
+			pending = pending || !chunk->write_done;
+		if (!pending)
+			break;
 
-	struct transfer_result write_result = { .ctx = ctx, .done = false };
-	struct libusb_transfer *write_transfer = libusb_alloc_transfer(0);
-	libusb_fill_bulk_transfer(write_transfer, ctx->usb_dev, ctx->out_ep, ctx->write_buffer,
-		ctx->write_count, write_cb, &write_result, ctx->usb_write_timeout);
-	retval = libusb_submit_transfer(write_transfer);
-	if (retval != LIBUSB_SUCCESS)
-		goto error_check;
-
-	if (ctx->read_count) {
-		read_transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(read_transfer, ctx->usb_dev, ctx->in_ep, ctx->read_chunk,
-			ctx->read_chunk_size, read_cb, &read_result,
-			ctx->usb_read_timeout);
-		retval = libusb_submit_transfer(read_transfer);
-		if (retval != LIBUSB_SUCCESS)
-			goto error_check;
+		struct timeval timeout_usb = { .tv_sec = 1 };
+		if (libusb_handle_events_timeout_completed(ctx->usb_ctx, &timeout_usb,
+					NULL) != LIBUSB_SUCCESS)
+			break;
 	}
+}
+
+/* Wait for the oldest chunk in flight and hand out its read data */
+static int mpsse_complete(struct mpsse_ctx *ctx)
+{
+	struct mpsse_chunk *chunk = oldest_chunk(ctx);
+	int retval = LIBUSB_SUCCESS;
 
 	/* Polling loop, more or less taken from libftdi */
 	int64_t start = timeval_ms();
 	int64_t warn_after = 2000;
-	while (!write_result.done || !read_result.done) {
+	while (!chunk_done(ctx, chunk)) {
 		struct timeval timeout_usb;
 
 		timeout_usb.tv_sec = 1;
@@ -896,21 +986,9 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 
 		retval = libusb_handle_events_timeout_completed(ctx->usb_ctx, &timeout_usb, NULL);
 		keep_alive();
-		if (retval == LIBUSB_ERROR_NO_DEVICE || retval == LIBUSB_ERROR_INTERRUPTED)
+		if (retval != LIBUSB_SUCCESS)
 			break;
 
-		if (retval != LIBUSB_SUCCESS) {
-			libusb_cancel_transfer(write_transfer);
-			if (read_transfer)
-				libusb_cancel_transfer(read_transfer);
-			while (!write_result.done || !read_result.done) {
-				retval = libusb_handle_events_timeout_completed(ctx->usb_ctx,
-								&timeout_usb, NULL);
-				if (retval != LIBUSB_SUCCESS)
-					break;
-			}
-		}
-
 		int64_t now = timeval_ms();
 		if (now - start > warn_after) {
 			LOG_WARNING("Haven't made progress in mpsse_flush() for %" PRId64
@@ -919,37 +997,118 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 		}
 	}
 
-error_check:
 	if (retval != LIBUSB_SUCCESS) {
 		LOG_ERROR("libusb_handle_events() failed with %s", libusb_error_name(retval));
-		retval = ERROR_FAIL;
-	} else if (write_result.transferred < ctx->write_count) {
+		return ERROR_FAIL;
+	} else if (chunk->write_transferred < chunk->write_count) {
 		LOG_ERROR("ftdi device did not accept all data: %d, tried %d",
-			write_result.transferred,
-			ctx->write_count);
-		retval = ERROR_FAIL;
-	} else if (read_result.transferred < ctx->read_count) {
+			chunk->write_transferred,
+			chunk->write_count);
+		return ERROR_FAIL;
+	} else if (chunk->read_transferred < chunk->read_count) {
 		LOG_ERROR("ftdi device did not return all data: %d, expected %d",
-			read_result.transferred,
-			ctx->read_count);
-		retval = ERROR_FAIL;
-	} else if (ctx->read_count) {
-		ctx->write_count = 0;
-		ctx->read_count = 0;
-		bit_copy_execute(&ctx->read_queue);
-		retval = ERROR_OK;
-	} else {
-		ctx->write_count = 0;
-		bit_copy_discard(&ctx->read_queue);
-		retval = ERROR_OK;
+			chunk->read_transferred,
+			chunk->read_count);
+		return ERROR_FAIL;
 	}
 
-	libusb_free_transfer(write_transfer);
-	if (read_transfer)
-		libusb_free_transfer(read_transfer);
+	if (chunk->read_count)
+		bit_copy_execute(&chunk->read_queue);
+	else
+		bit_copy_discard(&chunk->read_queue);
+	chunk->write_count = 0;
+	chunk->read_count = 0;
+	ctx->in_flight--;
+
+	return ERROR_OK;
+}
+
+/* Put the commands collected so far on the wire without waiting for them,
+ * and continue with the next chunk. Only blocks if all chunks are in flight. */
+static int mpsse_submit(struct mpsse_ctx *ctx)
+{
+	struct mpsse_chunk *chunk = ctx->cur;
+
+	/* don't hide an earlier failure behind a successful submission */
+	if (ctx->retval != ERROR_OK)
+		return ctx->retval;
+
+	LOG_DEBUG_IO("write %d%s, read %d", chunk->write_count, chunk->read_count ? "+1" : "",
+			chunk->read_count);
+	assert(chunk->write_count > 0 || chunk->read_count == 0); /* No read data without write data */
+
+	if (chunk->write_count == 0)
+		return ERROR_OK;
 
+	if (chunk->read_count)
+		buffer_write_byte(ctx, 0x87); /* SEND_IMMEDIATE */
+
+	chunk->write_transferred = 0;
+	chunk->read_transferred = 0;
+	chunk->write_done = false;
+	libusb_fill_bulk_transfer(chunk->write_transfer, ctx->usb_dev, ctx->out_ep,
+		chunk->write_buffer, chunk->write_count, write_cb, chunk, ctx->usb_write_timeout);
+	int retval = libusb_submit_transfer(chunk->write_transfer);
+	if (retval != LIBUSB_SUCCESS)
+		goto error;
+
+	ctx->in_flight++;
+	ctx->cur = chunk_next(ctx, chunk);
+
+	/* delay read transaction to ensure the FTDI chip can support us with data
+	   immediately after processing the MPSSE commands in the write transaction */
+	if (chunk->read_count && !ctx->read_active) {
+		libusb_fill_bulk_transfer(ctx->read_transfer, ctx->usb_dev, ctx->in_ep,
+			ctx->read_chunk, ctx->read_chunk_size, read_cb, ctx,
+			ctx->usb_read_timeout);
+		retval = libusb_submit_transfer(ctx->read_transfer);
+		if (retval != LIBUSB_SUCCESS)
+			goto error;
+		ctx->read_active = true;
+	}
+
+	/* Keep the read transfer going for chunks that are already done */
+	struct timeval no_wait = { 0 };
+	libusb_handle_events_timeout_completed(ctx->usb_ctx, &no_wait, NULL);
+
+	if (ctx->in_flight == MPSSE_CHUNKS) {
+		/* the chunk to fill next is still on the wire */
+		retval = mpsse_complete(ctx);
+		if (retval != ERROR_OK)
+			mpsse_purge(ctx);
+		return retval;
+	}
+
+	return ERROR_OK;
+
+error:
+	LOG_ERROR("libusb_submit_transfer() failed with %s", libusb_error_name(retval));
+	mpsse_purge(ctx);
+	return ERROR_FAIL;
+}
+
+int mpsse_flush(struct mpsse_ctx *ctx)
+{
+	int retval = ctx->retval;
+
+	if (retval != ERROR_OK) {
+		LOG_DEBUG_IO("Ignoring flush due to previous error");
+		assert(ctx->cur->write_count == 0 && ctx->cur->read_count == 0 && ctx->in_flight == 0);
+		ctx->retval = ERROR_OK;
+		return retval;
+	}
+
+	retval = mpsse_submit(ctx);
 	if (retval != ERROR_OK)
-		mpsse_purge(ctx);
+		return retval;
 
-	return retval;
+	while (ctx->in_flight) {
+		retval = mpsse_complete(ctx);
+		if (retval != ERROR_OK) {
+			mpsse_purge(ctx);
+			return retval;
+		}
+	}
+
+	return ERROR_OK;
 }
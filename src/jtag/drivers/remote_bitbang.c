@@ -25,83 +25,143 @@
 #include <netdb.h>
 #endif
 #include <jtag/interface.h>
+#include <helper/binarybuffer.h>
 #include "bitbang.h"
 
+/*
+ * Besides the classic protocol of one ASCII character per pin change or TDO
+ * sample, the driver speaks an optional binary scan extension which sends
+ * whole runs of TCK cycles at once:
+ *
+ *   'V'                 server replies 'V' and the extension version ('1')
+ *   'X' n tms[] tdi[]   clock n cycles, no reply
+ *   'Y' n tms[] tdi[]   clock n cycles, reply with the TDO bits tdo[]
+ *
+ * n is a 32 bit little endian cycle count, tms[], tdi[] and tdo[] are bit
+ * vectors of (n + 7) / 8 bytes, LSB first. For every cycle the server sets
+ * TCK low and TMS/TDI to the given values, samples TDO and sets TCK high.
+ *
+ * At init the driver sends "VR". A classic server ignores 'V' and answers
+ * 'R' with '0' or '1', in which case the driver keeps using the classic
+ * protocol.
+ */
+
 /* arbitrary limit on host name length: */
 #define REMOTE_BITBANG_HOST_MAX 255
 
+/* commands not yet sent to the remote side */
+#define REMOTE_BITBANG_SEND_BUF_SIZE	4096
+/* responses received but not yet consumed */
+#define REMOTE_BITBANG_RECV_BUF_SIZE	1024
+/* TDO samples which can be requested before they have to be read */
+#define REMOTE_BITBANG_SAMPLES_MAX		4096
+/* maximum number of cycles in a scan vector */
+#define REMOTE_BITBANG_SCAN_MAX_BITS	8192
+
 static char *remote_bitbang_host;
 static char *remote_bitbang_port;
 
 static int remote_bitbang_fd;
 
-/* Circular buffer. When start == end, the buffer is empty. */
-static char remote_bitbang_buf[64];
-static unsigned remote_bitbang_start;
-static unsigned remote_bitbang_end;
-
-static int remote_bitbang_buf_full(void)
+static char remote_bitbang_send_buf[REMOTE_BITBANG_SEND_BUF_SIZE];
+static unsigned remote_bitbang_send_used;
+
+static char remote_bitbang_recv_buf[REMOTE_BITBANG_RECV_BUF_SIZE];
+static unsigned remote_bitbang_recv_start;
+static unsigned remote_bitbang_recv_end;
+
+/* whether to ask the server for the scan extension */
+static bool remote_bitbang_use_scan = true;
+/* whether the server supports the scan extension */
+static bool remote_bitbang_scan;
+
+/* cycles collected for the next scan vector */
+static struct {
+	unsigned bits;
+	bool capture;
+	uint8_t tms[REMOTE_BITBANG_SCAN_MAX_BITS / 8];
+	uint8_t tdi[REMOTE_BITBANG_SCAN_MAX_BITS / 8];
+	uint8_t sampled[REMOTE_BITBANG_SCAN_MAX_BITS / 8];
+} remote_bitbang_vector;
+
+/* falling TCK edge waiting for the rising edge that completes the cycle */
+static struct {
+	bool valid;
+	bool sampled;
+	int tms;
+	int tdi;
+} remote_bitbang_pending;
+
+/* TDO samples received in scan extension mode, not yet consumed */
+static bb_value_t remote_bitbang_samples[REMOTE_BITBANG_SAMPLES_MAX];
+static unsigned remote_bitbang_samples_first;
+static unsigned remote_bitbang_samples_count;
+
+/* Send all buffered commands. */
+static int remote_bitbang_flush(void)
 {
-	return remote_bitbang_end ==
-		((remote_bitbang_start + sizeof(remote_bitbang_buf) - 1) %
-		 sizeof(remote_bitbang_buf));
+	unsigned offset = 0;
+
+	while (offset < remote_bitbang_send_used) {
+		ssize_t count = write_socket(remote_bitbang_fd,
+				remote_bitbang_send_buf + offset,
+				remote_bitbang_send_used - offset);
+		if (count <= 0) {
+			log_socket_error("remote_bitbang_flush");
+			remote_bitbang_send_used = 0;
+			return ERROR_FAIL;
+		}
+		offset += count;
+	}
+
+	remote_bitbang_send_used = 0;
+	return ERROR_OK;
 }
 
-/* Read any incoming data, placing it into the buffer. */
-static int remote_bitbang_fill_buf(void)
+static int remote_bitbang_queue(const void *data, size_t size)
 {
-	socket_nonblock(remote_bitbang_fd);
-	while (!remote_bitbang_buf_full()) {
-		unsigned contiguous_available_space;
-		if (remote_bitbang_end >= remote_bitbang_start) {
-			contiguous_available_space = sizeof(remote_bitbang_buf) -
-				remote_bitbang_end;
-			if (remote_bitbang_start == 0)
-				contiguous_available_space -= 1;
-		} else {
-			contiguous_available_space = remote_bitbang_start -
-				remote_bitbang_end - 1;
-		}
-		ssize_t count = read_socket(remote_bitbang_fd,
-				remote_bitbang_buf + remote_bitbang_end,
-				contiguous_available_space);
-		if (count > 0) {
-			remote_bitbang_end += count;
-			if (remote_bitbang_end == sizeof(remote_bitbang_buf))
-				remote_bitbang_end = 0;
-		} else if (count == 0) {
-			return ERROR_OK;
-		} else if (count < 0) {
-#ifdef _WIN32
-			if (WSAGetLastError() == WSAEWOULDBLOCK) {
-#else
-			if (errno == EAGAIN) {
-#endif
-				return ERROR_OK;
-			} else {
-				log_socket_error("remote_bitbang_fill_buf");
-				return ERROR_FAIL;
-			}
-		}
-	}
+	assert(size <= sizeof(remote_bitbang_send_buf));
 
+	if (remote_bitbang_send_used + size > sizeof(remote_bitbang_send_buf))
+		if (remote_bitbang_flush() != ERROR_OK)
+			return ERROR_FAIL;
+
+	memcpy(remote_bitbang_send_buf + remote_bitbang_send_used, data, size);
+	remote_bitbang_send_used += size;
 	return ERROR_OK;
 }
 
 static int remote_bitbang_putc(int c)
 {
 	char buf = c;
-	ssize_t count = write_socket(remote_bitbang_fd, &buf, sizeof(buf));
-	if (count < 0) {
-		log_socket_error("remote_bitbang_putc");
-		return ERROR_FAIL;
+	return remote_bitbang_queue(&buf, sizeof(buf));
+}
+
+/* Get the next byte of the responses, sending pending commands first. */
+static int remote_bitbang_getc(void)
+{
+	if (remote_bitbang_recv_start == remote_bitbang_recv_end) {
+		if (remote_bitbang_flush() != ERROR_OK)
+			return -1;
+
+		ssize_t count = read_socket(remote_bitbang_fd, remote_bitbang_recv_buf,
+				sizeof(remote_bitbang_recv_buf));
+		if (count <= 0) {
+			LOG_ERROR("read_socket: count=%d", (int) count);
+			log_socket_error("read_socket");
+			return -1;
+		}
+		remote_bitbang_recv_start = 0;
+		remote_bitbang_recv_end = count;
 	}
-	return ERROR_OK;
+
+	return (unsigned char)remote_bitbang_recv_buf[remote_bitbang_recv_start++];
 }
 
 static int remote_bitbang_quit(void)
 {
-	if (remote_bitbang_putc('Q') == ERROR_FAIL)
+	remote_bitbang_putc('Q');
+	if (remote_bitbang_flush() != ERROR_OK)
 		return ERROR_FAIL;
 
 	if (close_socket(remote_bitbang_fd) != 0) {
@@ -124,74 +184,261 @@ static bb_value_t char_to_int(int c)
 		case '1':
 			return BB_HIGH;
 		default:
-			remote_bitbang_quit();
 			LOG_ERROR("remote_bitbang: invalid read response: %c(%i)", c, c);
 			return BB_ERROR;
 	}
 }
 
-/* Get the next read response. */
-static bb_value_t remote_bitbang_rread(void)
+static void remote_bitbang_push_sample(bb_value_t value)
 {
-	/* Enable blocking access. */
-	socket_block(remote_bitbang_fd);
-	char c;
-	ssize_t count = read_socket(remote_bitbang_fd, &c, 1);
-	if (count == 1) {
-		return char_to_int(c);
-	} else {
-		remote_bitbang_quit();
-		LOG_ERROR("read_socket: count=%d", (int) count);
-		log_socket_error("read_socket");
-		return BB_ERROR;
+	unsigned last = (remote_bitbang_samples_first + remote_bitbang_samples_count) %
+		REMOTE_BITBANG_SAMPLES_MAX;
+
+	assert(remote_bitbang_samples_count < REMOTE_BITBANG_SAMPLES_MAX);
+	remote_bitbang_samples[last] = value;
+	remote_bitbang_samples_count++;
+}
+
+/* Send the collected cycles and, if any of them were sampled, get TDO. */
+static int remote_bitbang_vector_flush(void)
+{
+	unsigned bits = remote_bitbang_vector.bits;
+	unsigned bytes = DIV_ROUND_UP(bits, 8);
+	uint8_t header[5];
+
+	if (!bits)
+		return ERROR_OK;
+
+	header[0] = remote_bitbang_vector.capture ? 'Y' : 'X';
+	h_u32_to_le(header + 1, bits);
+
+	if (remote_bitbang_queue(header, sizeof(header)) != ERROR_OK ||
+			remote_bitbang_queue(remote_bitbang_vector.tms, bytes) != ERROR_OK ||
+			remote_bitbang_queue(remote_bitbang_vector.tdi, bytes) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (remote_bitbang_vector.capture) {
+		for (unsigned i = 0; i < bytes; i++) {
+			int tdo = remote_bitbang_getc();
+			if (tdo < 0)
+				return ERROR_FAIL;
+
+			for (unsigned bit = 8 * i; bit < MIN(8 * i + 8, bits); bit++)
+				if (remote_bitbang_vector.sampled[i] & (1 << (bit % 8)))
+					remote_bitbang_push_sample((tdo & (1 << (bit % 8))) ?
+						BB_HIGH : BB_LOW);
+		}
+	}
+
+	memset(remote_bitbang_vector.tms, 0, bytes);
+	memset(remote_bitbang_vector.tdi, 0, bytes);
+	memset(remote_bitbang_vector.sampled, 0, bytes);
+	remote_bitbang_vector.bits = 0;
+	remote_bitbang_vector.capture = false;
+
+	return ERROR_OK;
+}
+
+static int remote_bitbang_vector_add(int tms, int tdi, bool sampled)
+{
+	unsigned bit = remote_bitbang_vector.bits++;
+
+	if (tms)
+		remote_bitbang_vector.tms[bit / 8] |= 1 << (bit % 8);
+	if (tdi)
+		remote_bitbang_vector.tdi[bit / 8] |= 1 << (bit % 8);
+	if (sampled) {
+		remote_bitbang_vector.sampled[bit / 8] |= 1 << (bit % 8);
+		remote_bitbang_vector.capture = true;
+	}
+
+	if (remote_bitbang_vector.bits == REMOTE_BITBANG_SCAN_MAX_BITS)
+		return remote_bitbang_vector_flush();
+
+	return ERROR_OK;
+}
+
+/* Send a falling TCK edge which is not part of a full cycle on its own. */
+static int remote_bitbang_emit_pending(void)
+{
+	if (!remote_bitbang_pending.valid)
+		return ERROR_OK;
+
+	remote_bitbang_pending.valid = false;
+
+	if (remote_bitbang_vector_flush() != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (remote_bitbang_putc('0' + ((remote_bitbang_pending.tms ? 0x2 : 0x0) |
+			(remote_bitbang_pending.tdi ? 0x1 : 0x0))) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (remote_bitbang_pending.sampled) {
+		if (remote_bitbang_putc('R') != ERROR_OK)
+			return ERROR_FAIL;
+
+		bb_value_t value = char_to_int(remote_bitbang_getc());
+		if (value == BB_ERROR)
+			return ERROR_FAIL;
+		remote_bitbang_push_sample(value);
+	}
+
+	return ERROR_OK;
+}
+
+/* Send a classic command, after everything collected for scan vectors. */
+static int remote_bitbang_command(int c)
+{
+	if (remote_bitbang_scan) {
+		if (remote_bitbang_emit_pending() != ERROR_OK ||
+				remote_bitbang_vector_flush() != ERROR_OK)
+			return ERROR_FAIL;
 	}
+
+	return remote_bitbang_putc(c);
 }
 
 static int remote_bitbang_sample(void)
 {
-	if (remote_bitbang_fill_buf() != ERROR_OK)
+	if (!remote_bitbang_scan)
+		return remote_bitbang_putc('R');
+
+	if (remote_bitbang_pending.valid) {
+		remote_bitbang_pending.sampled = true;
+		return ERROR_OK;
+	}
+
+	if (remote_bitbang_command('R') != ERROR_OK)
+		return ERROR_FAIL;
+
+	bb_value_t value = char_to_int(remote_bitbang_getc());
+	if (value == BB_ERROR)
 		return ERROR_FAIL;
-	assert(!remote_bitbang_buf_full());
-	return remote_bitbang_putc('R');
+	remote_bitbang_push_sample(value);
+
+	return ERROR_OK;
 }
 
 static bb_value_t remote_bitbang_read_sample(void)
 {
-	if (remote_bitbang_start != remote_bitbang_end) {
-		int c = remote_bitbang_buf[remote_bitbang_start];
-		remote_bitbang_start =
-			(remote_bitbang_start + 1) % sizeof(remote_bitbang_buf);
-		return char_to_int(c);
+	if (!remote_bitbang_scan)
+		return char_to_int(remote_bitbang_getc());
+
+	if (!remote_bitbang_samples_count) {
+		if (remote_bitbang_emit_pending() != ERROR_OK ||
+				remote_bitbang_vector_flush() != ERROR_OK)
+			return BB_ERROR;
+		if (!remote_bitbang_samples_count) {
+			LOG_ERROR("remote_bitbang: no TDO sample requested");
+			return BB_ERROR;
+		}
 	}
-	return remote_bitbang_rread();
+
+	bb_value_t value = remote_bitbang_samples[remote_bitbang_samples_first];
+	remote_bitbang_samples_first = (remote_bitbang_samples_first + 1) %
+		REMOTE_BITBANG_SAMPLES_MAX;
+	remote_bitbang_samples_count--;
+
+	return value;
 }
 
 static int remote_bitbang_write(int tck, int tms, int tdi)
 {
 	char c = '0' + ((tck ? 0x4 : 0x0) | (tms ? 0x2 : 0x0) | (tdi ? 0x1 : 0x0));
-	return remote_bitbang_putc(c);
+
+	if (!remote_bitbang_scan)
+		return remote_bitbang_putc(c);
+
+	/*
+	 * A falling edge followed by a rising edge with the same TMS and TDI
+	 * is a TCK cycle which goes into a scan vector. Anything else is sent
+	 * with the classic protocol.
+	 */
+	if (!tck) {
+		int retval = remote_bitbang_emit_pending();
+
+		remote_bitbang_pending.valid = true;
+		remote_bitbang_pending.sampled = false;
+		remote_bitbang_pending.tms = tms;
+		remote_bitbang_pending.tdi = tdi;
+		return retval;
+	}
+
+	if (remote_bitbang_pending.valid && !remote_bitbang_pending.tms == !tms &&
+			!remote_bitbang_pending.tdi == !tdi) {
+		remote_bitbang_pending.valid = false;
+		return remote_bitbang_vector_add(tms, tdi,
+			remote_bitbang_pending.sampled);
+	}
+
+	return remote_bitbang_command(c);
 }
 
 static int remote_bitbang_reset(int trst, int srst)
 {
 	char c = 'r' + ((trst ? 0x2 : 0x0) | (srst ? 0x1 : 0x0));
-	return remote_bitbang_putc(c);
+
+	/* reset is not queued, it has to take effect right away */
+	if (remote_bitbang_command(c) != ERROR_OK)
+		return ERROR_FAIL;
+
+	return remote_bitbang_flush();
 }
 
 static int remote_bitbang_blink(int on)
 {
 	char c = on ? 'B' : 'b';
-	return remote_bitbang_putc(c);
+	return remote_bitbang_command(c);
+}
+
+static int remote_bitbang_flush_all(void)
+{
+	if (remote_bitbang_scan) {
+		if (remote_bitbang_emit_pending() != ERROR_OK ||
+				remote_bitbang_vector_flush() != ERROR_OK)
+			return ERROR_FAIL;
+	}
+
+	return remote_bitbang_flush();
 }
 
 static struct bitbang_interface remote_bitbang_bitbang = {
-	.buf_size = sizeof(remote_bitbang_buf) - 1,
+	.buf_size = REMOTE_BITBANG_SAMPLES_MAX,
 	.sample = &remote_bitbang_sample,
 	.read_sample = &remote_bitbang_read_sample,
 	.write = &remote_bitbang_write,
 	.blink = &remote_bitbang_blink,
+	.flush = &remote_bitbang_flush_all,
 };
 
+/* Ask the server whether it supports the scan extension. */
+static int remote_bitbang_negotiate(void)
+{
+	remote_bitbang_scan = false;
+
+	if (!remote_bitbang_use_scan)
+		return ERROR_OK;
+
+	if (remote_bitbang_putc('V') != ERROR_OK ||
+			remote_bitbang_putc('R') != ERROR_OK)
+		return ERROR_FAIL;
+
+	int c = remote_bitbang_getc();
+	if (c == 'V') {
+		int version = remote_bitbang_getc();
+		if (version < 0 || char_to_int(remote_bitbang_getc()) == BB_ERROR)
+			return ERROR_FAIL;
+		LOG_INFO("remote_bitbang: using scan extension version %c", version);
+		remote_bitbang_scan = true;
+	} else if (char_to_int(c) != BB_ERROR) {
+		LOG_INFO("remote_bitbang: server does not support the scan extension");
+	} else {
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
 static int remote_bitbang_init_tcp(void)
 {
 	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
@@ -266,8 +513,13 @@ static int remote_bitbang_init(void)
 {
 	bitbang_interface = &remote_bitbang_bitbang;
 
-	remote_bitbang_start = 0;
-	remote_bitbang_end = 0;
+	remote_bitbang_send_used = 0;
+	remote_bitbang_recv_start = 0;
+	remote_bitbang_recv_end = 0;
+	remote_bitbang_samples_first = 0;
+	remote_bitbang_samples_count = 0;
+	remote_bitbang_pending.valid = false;
+	memset(&remote_bitbang_vector, 0, sizeof(remote_bitbang_vector));
 
 	LOG_INFO("Initializing remote_bitbang driver");
 	if (remote_bitbang_port == NULL)
@@ -278,6 +530,11 @@ static int remote_bitbang_init(void)
 	if (remote_bitbang_fd < 0)
 		return remote_bitbang_fd;
 
+	if (remote_bitbang_negotiate() != ERROR_OK) {
+		close_socket(remote_bitbang_fd);
+		return ERROR_FAIL;
+	}
+
 	LOG_INFO("remote_bitbang driver initialized");
 	return ERROR_OK;
 }
@@ -304,6 +561,15 @@ COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_host_command)
 	return ERROR_COMMAND_SYNTAX_ERROR;
 }
 
+COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_scan_extension_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ON_OFF(CMD_ARGV[0], remote_bitbang_use_scan);
+	return ERROR_OK;
+}
+
 static const struct command_registration remote_bitbang_command_handlers[] = {
 	{
 		.name = "remote_bitbang_port",
@@ -321,6 +587,14 @@ static const struct command_registration remote_bitbang_command_handlers[] = {
 			"  if port is 0 or unset, this is the name of the unix socket to use.",
 		.usage = "host_name",
 	},
+	{
+		.name = "remote_bitbang_scan_extension",
+		.handler = remote_bitbang_handle_remote_bitbang_scan_extension_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Set whether to use the binary scan extension if the remote "
+			"side supports it (default on).",
+		.usage = "(on|off)",
+	},
 	COMMAND_REGISTRATION_DONE,
 };
 
@@ -0,0 +1,1118 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/**
+ * @file
+ * Adapter driver that simulates a debug target instead of talking to one.
+ *
+ * The simulated target is a STM32F1-like Cortex-M3 behind an ADIv5 SW-DP or
+ * JTAG-DP with a single AHB-AP. It has RAM, flash with a STM32F1 compatible
+ * flash controller (so the stm32f1x flash driver works unmodified), a ROM
+ * table and a minimal model of the Cortex-M debug registers: halt, step,
+ * resume, core register transfers, vector catch, SYSRESETREQ, FPB and DWT.
+ * The core does not execute instructions, it only pretends to.
+ *
+ * All transactions complete immediately; the time a real link would take
+ * is derived from the number of SWCLK/TCK cycles and the adapter speed, plus
+ * a configurable latency per queue execution (round trip), and slept for.
+ * The transaction counters make the simulator useful for reproducible
+ * throughput benchmarks of the ADIv5, Cortex-M and flash code.
+ *
+ * JTAG is modeled on scan level for a chain with the DAP TAP only.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <jtag/interface.h>
+#include <jtag/swd.h>
+#include <jtag/commands.h>
+#include <helper/time_support.h>
+#include <target/cortex_m.h>
+
+#define SIM_DPIDR			0x1ba01477	/* STM32F1 SW-DP */
+#define SIM_IDCODE			0x3ba00477	/* STM32F1 JTAG-DP */
+#define SIM_AP_IDR			0x24770011	/* AHB-AP of Cortex-M3 */
+#define SIM_ROM_TABLE		0xe00ff000
+#define SIM_CPUID			0x412fc231	/* Cortex-M3 r2p1 */
+#define SIM_DBGMCU_IDCODE	0x20036410	/* STM32F10x medium density */
+#define SIM_DBGMCU_IDCODE_ADDR	0xe0042000
+#define SIM_FLASH_SIZE_ADDR	0x1ffff7e0
+
+/* private peripheral bus, backed by plain storage unless modeled below */
+#define SIM_PPB_BASE		0xe0000000
+#define SIM_PPB_SIZE		0x100000
+
+/* STM32F1 flash controller */
+#define SIM_FLASH_REG_BASE	0x40022000
+#define SIM_FLASH_ACR		0x00
+#define SIM_FLASH_KEYR		0x04
+#define SIM_FLASH_SR		0x0c
+#define SIM_FLASH_CR		0x10
+#define SIM_FLASH_AR		0x14
+#define SIM_FLASH_OBR		0x1c
+#define SIM_FLASH_WRPR		0x20
+#define SIM_FLASH_KEY1		0x45670123
+#define SIM_FLASH_KEY2		0xcdef89ab
+#define SIM_FLASH_PG		BIT(0)
+#define SIM_FLASH_PER		BIT(1)
+#define SIM_FLASH_MER		BIT(2)
+#define SIM_FLASH_STRT		BIT(6)
+#define SIM_FLASH_LOCK		BIT(7)
+#define SIM_FLASH_PGERR		BIT(2)
+#define SIM_FLASH_WRPRTERR	BIT(4)
+#define SIM_FLASH_EOP		BIT(5)
+#define SIM_FLASH_PAGE_SIZE	1024
+
+/* JTAG-DP instructions and acknowledge */
+#define SIM_JTAG_IR_LEN		4
+#define SIM_JTAG_IR_ABORT	0x8
+#define SIM_JTAG_IR_DPACC	0xa
+#define SIM_JTAG_IR_APACC	0xb
+#define SIM_JTAG_IR_IDCODE	0xe
+#define SIM_JTAG_ACK_OK		0x2
+
+/* cycles of a SWD transfer: request, turnaround, ack, data and parity */
+#define SIM_SWD_TRANSFER_CYCLES	46
+/* cycles to get from Run-Test/Idle to a shift state and back */
+#define SIM_JTAG_SCAN_CYCLES	5
+
+#define SIM_CORE_REGS		128
+#define SIM_FP_NUM_CODE		6
+#define SIM_FP_NUM_LIT		2
+#define SIM_DWT_NUM_COMP	4
+
+struct sim_memory {
+	uint32_t base;
+	uint32_t size;
+	uint8_t *data;
+};
+
+struct sim_stats {
+	uint64_t runs;
+	uint64_t dp_reads;
+	uint64_t dp_writes;
+	uint64_t ap_reads;
+	uint64_t ap_writes;
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	uint64_t faults;
+	uint64_t flash_programmed;
+	uint64_t flash_erased;
+	uint64_t cycles;
+	uint64_t link_ns;
+};
+
+static struct sim_memory sim_ram = { .base = 0x20000000, .size = 64 * 1024 };
+static struct sim_memory sim_flash = { .base = 0x08000000, .size = 128 * 1024 };
+static uint8_t *sim_ppb;
+
+static unsigned int sim_khz;
+static unsigned int sim_latency_us;
+static uint64_t sim_pending_cycles;
+static struct sim_stats sim_stats;
+
+static int queued_retval;
+
+/* debug port */
+static struct {
+	uint32_t ctrl_stat;
+	uint32_t select;
+	/* posted read result, RDBUFF */
+	uint32_t rdbuff;
+} sim_dp;
+
+/* MEM-AP */
+static struct {
+	uint32_t csw;
+	uint32_t tar;
+} sim_ap;
+
+/* JTAG-DP */
+static struct {
+	uint32_t ir;
+	/* captured by the next DPACC/APACC scan */
+	uint32_t result;
+} sim_jtag;
+
+/* flash controller */
+static struct {
+	uint32_t cr;
+	uint32_t sr;
+	uint32_t ar;
+	unsigned int keys;
+} sim_fpec;
+
+/* Cortex-M core */
+static struct {
+	uint32_t regs[SIM_CORE_REGS];
+	uint32_t dhcsr;
+	bool halted;
+	bool in_reset;
+	bool reset_st;
+	bool retire_st;
+} sim_core;
+
+static uint32_t sim_ppb_get(uint32_t address)
+{
+	return le_to_h_u32(sim_ppb + address - SIM_PPB_BASE);
+}
+
+static void sim_ppb_set(uint32_t address, uint32_t value)
+{
+	h_u32_to_le(sim_ppb + address - SIM_PPB_BASE, value);
+}
+
+static uint8_t *sim_memory_ptr(struct sim_memory *mem, uint32_t address, unsigned int size)
+{
+	if (address >= mem->base && address - mem->base <= mem->size - size)
+		return mem->data + address - mem->base;
+	return NULL;
+}
+
+/* Flash is also aliased at address 0 */
+static uint8_t *sim_flash_ptr(uint32_t address, unsigned int size)
+{
+	if (address <= sim_flash.size - size)
+		return sim_flash.data + address;
+	return sim_memory_ptr(&sim_flash, address, size);
+}
+
+static uint32_t sim_read_u32(uint32_t address)
+{
+	uint8_t *p = sim_flash_ptr(address, 4);
+	if (!p)
+		p = sim_memory_ptr(&sim_ram, address, 4);
+
+	return p ? le_to_h_u32(p) : 0;
+}
+
+static void sim_core_reset(void)
+{
+	memset(sim_core.regs, 0, sizeof(sim_core.regs));
+
+	/* the vector table is fetched from address 0, where flash is aliased */
+	sim_core.regs[17] = sim_read_u32(0) & ~3;	/* MSP */
+	sim_core.regs[13] = sim_core.regs[17];		/* SP */
+	sim_core.regs[14] = 0xffffffff;				/* LR */
+	sim_core.regs[15] = sim_read_u32(4) & ~1;	/* PC */
+	sim_core.regs[16] = 0x01000000;				/* xPSR, Thumb bit */
+
+	sim_core.reset_st = true;
+	sim_core.halted = (sim_core.dhcsr & C_DEBUGEN) &&
+		((sim_ppb_get(DCB_DEMCR) & VC_CORERESET) || (sim_core.dhcsr & C_HALT));
+	if (sim_core.halted)
+		sim_ppb_set(NVIC_DFSR, sim_ppb_get(NVIC_DFSR) | DFSR_VCATCH);
+}
+
+static void sim_system_reset(void)
+{
+	LOG_DEBUG("sim: system reset");
+
+	sim_fpec.cr = SIM_FLASH_LOCK;
+	sim_fpec.sr = 0;
+	sim_fpec.keys = 0;
+
+	sim_core_reset();
+}
+
+static void sim_dhcsr_write(uint32_t value)
+{
+	if ((value & 0xffff0000) != DBGKEY)
+		return;
+
+	sim_core.dhcsr = value & (C_DEBUGEN | C_HALT | C_STEP | C_MASKINTS);
+
+	if (!(sim_core.dhcsr & C_DEBUGEN)) {
+		sim_core.halted = false;
+	} else if (sim_core.dhcsr & C_HALT) {
+		if (!sim_core.halted)
+			sim_ppb_set(NVIC_DFSR, sim_ppb_get(NVIC_DFSR) | DFSR_HALTED);
+		sim_core.halted = true;
+	} else if (sim_core.halted) {
+		/* pretend to execute a 16 bit instruction when stepping */
+		sim_core.retire_st = true;
+		if (sim_core.dhcsr & C_STEP) {
+			sim_core.regs[15] += 2;
+			sim_ppb_set(NVIC_DFSR, sim_ppb_get(NVIC_DFSR) | DFSR_HALTED);
+		} else {
+			sim_core.halted = false;
+		}
+	}
+}
+
+static uint32_t sim_dhcsr_read(void)
+{
+	uint32_t value = sim_core.dhcsr | S_REGRDY;
+
+	if (sim_core.halted)
+		value |= S_HALT;
+	if (sim_core.reset_st || sim_core.in_reset)
+		value |= S_RESET_ST;
+	if (sim_core.retire_st)
+		value |= S_RETIRE_ST;
+
+	/* sticky status bits are cleared by reading */
+	sim_core.reset_st = false;
+	sim_core.retire_st = false;
+
+	return value;
+}
+
+static uint32_t sim_ppb_read(uint32_t address)
+{
+	switch (address) {
+	case CPUID:
+		return SIM_CPUID;
+	case NVIC_AIRCR:
+		return 0xfa050000 | (sim_ppb_get(address) & 0x700);
+	case DCB_DHCSR:
+		return sim_dhcsr_read();
+	case FP_CTRL:
+		return (sim_ppb_get(address) & 1) | (SIM_FP_NUM_CODE << 4) | (SIM_FP_NUM_LIT << 8);
+	case DWT_CTRL:
+		return (SIM_DWT_NUM_COMP << 28) | (sim_ppb_get(address) & 0x0fffffff);
+	case SIM_DBGMCU_IDCODE_ADDR:
+		return SIM_DBGMCU_IDCODE;
+	default:
+		return sim_ppb_get(address);
+	}
+}
+
+static void sim_ppb_write(uint32_t address, uint32_t value)
+{
+	switch (address) {
+	case CPUID:
+	case SIM_DBGMCU_IDCODE_ADDR:
+		break;
+	case NVIC_AIRCR:
+		if ((value & 0xffff0000) != AIRCR_VECTKEY)
+			break;
+		sim_ppb_set(address, value & 0x700);
+		if (value & AIRCR_SYSRESETREQ)
+			sim_system_reset();
+		else if (value & AIRCR_VECTRESET)
+			sim_core_reset();
+		break;
+	case NVIC_DFSR:
+		sim_ppb_set(address, sim_ppb_get(address) & ~value);
+		break;
+	case DCB_DHCSR:
+		sim_dhcsr_write(value);
+		break;
+	case DCB_DCRSR: {
+		unsigned int regsel = value & (SIM_CORE_REGS - 1);
+		if (value & DCRSR_WnR)
+			sim_core.regs[regsel] = sim_ppb_get(DCB_DCRDR);
+		else
+			sim_ppb_set(DCB_DCRDR, sim_core.regs[regsel]);
+		break;
+	}
+	case FP_CTRL:
+		/* the enable bit is only written together with the key bit */
+		if (value & 2)
+			sim_ppb_set(address, value & 1);
+		break;
+	default:
+		sim_ppb_set(address, value);
+		break;
+	}
+}
+
+static void sim_flash_erase(uint32_t address, uint32_t size)
+{
+	memset(sim_flash.data + address - sim_flash.base, 0xff, size);
+	sim_stats.flash_erased += size;
+}
+
+static uint32_t sim_fpec_read(uint32_t offset)
+{
+	switch (offset) {
+	case SIM_FLASH_SR:
+		return sim_fpec.sr;
+	case SIM_FLASH_CR:
+		return sim_fpec.cr;
+	case SIM_FLASH_AR:
+		return sim_fpec.ar;
+	case SIM_FLASH_OBR:
+		return 0x03fffffc;
+	case SIM_FLASH_WRPR:
+		return 0xffffffff;
+	default:
+		return 0;
+	}
+}
+
+static void sim_fpec_write(uint32_t offset, uint32_t value)
+{
+	switch (offset) {
+	case SIM_FLASH_KEYR:
+		if (value == SIM_FLASH_KEY1) {
+			sim_fpec.keys = 1;
+		} else if (value == SIM_FLASH_KEY2 && sim_fpec.keys == 1) {
+			sim_fpec.cr &= ~SIM_FLASH_LOCK;
+			sim_fpec.keys = 0;
+		} else {
+			sim_fpec.keys = 0;
+		}
+		break;
+	case SIM_FLASH_SR:
+		sim_fpec.sr &= ~(value & (SIM_FLASH_PGERR | SIM_FLASH_WRPRTERR | SIM_FLASH_EOP));
+		break;
+	case SIM_FLASH_CR:
+		if (sim_fpec.cr & SIM_FLASH_LOCK)
+			break;
+		sim_fpec.cr = value & (SIM_FLASH_PG | SIM_FLASH_PER | SIM_FLASH_MER | SIM_FLASH_LOCK);
+		if (!(value & SIM_FLASH_STRT))
+			break;
+		/* erase operations complete immediately */
+		if (value & SIM_FLASH_MER) {
+			sim_flash_erase(sim_flash.base, sim_flash.size);
+		} else if (value & SIM_FLASH_PER) {
+			uint32_t page = sim_fpec.ar & ~(SIM_FLASH_PAGE_SIZE - 1);
+			if (sim_memory_ptr(&sim_flash, page, SIM_FLASH_PAGE_SIZE))
+				sim_flash_erase(page, SIM_FLASH_PAGE_SIZE);
+		}
+		sim_fpec.sr |= SIM_FLASH_EOP;
+		break;
+	case SIM_FLASH_AR:
+		sim_fpec.ar = value;
+		break;
+	default:
+		break;
+	}
+}
+
+/* Program flash the way the STM32F1 does: half-word wise, and only if the
+ * half-word is erased or zero is written */
+static int sim_flash_program(uint8_t *p, unsigned int size, uint32_t value)
+{
+	if (!(sim_fpec.cr & SIM_FLASH_PG) || (sim_fpec.cr & SIM_FLASH_LOCK) || size == 1)
+		return ERROR_FAIL;
+
+	for (unsigned int i = 0; i < size; i += 2) {
+		uint16_t old = le_to_h_u16(p + i);
+		uint16_t new = value >> (8 * i);
+		if (old != 0xffff && new != 0) {
+			sim_fpec.sr |= SIM_FLASH_PGERR;
+			continue;
+		}
+		h_u16_to_le(p + i, new);
+		sim_stats.flash_programmed += 2;
+	}
+	sim_fpec.sr |= SIM_FLASH_EOP;
+
+	return ERROR_OK;
+}
+
+/* Bus access of 1, 2 or 4 bytes, with the value right aligned */
+static int sim_bus_access(uint32_t address, unsigned int size, bool write, uint32_t *value)
+{
+	uint8_t *p;
+
+	if (address & (size - 1))
+		return ERROR_FAIL;
+
+	if (write)
+		sim_stats.bytes_written += size;
+	else
+		sim_stats.bytes_read += size;
+
+	p = sim_memory_ptr(&sim_ram, address, size);
+	if (p) {
+		if (write)
+			buf_set_u32(p, 0, 8 * size, *value);
+		else
+			*value = buf_get_u32(p, 0, 8 * size);
+		return ERROR_OK;
+	}
+
+	p = sim_flash_ptr(address, size);
+	if (p) {
+		if (write)
+			return sim_flash_program(p, size, *value);
+		*value = buf_get_u32(p, 0, 8 * size);
+		return ERROR_OK;
+	}
+
+	if (address - SIM_FLASH_SIZE_ADDR < 4) {
+		/* flash size in KiB, read-only */
+		uint8_t reg[4];
+		h_u32_to_le(reg, sim_flash.size / 1024);
+		if (!write)
+			*value = buf_get_u32(reg + (address & 3), 0, 8 * size);
+		return ERROR_OK;
+	}
+
+	if (address - SIM_FLASH_REG_BASE < 0x400 && size == 4) {
+		if (write)
+			sim_fpec_write(address - SIM_FLASH_REG_BASE, *value);
+		else
+			*value = sim_fpec_read(address - SIM_FLASH_REG_BASE);
+		return ERROR_OK;
+	}
+
+	if (address - SIM_PPB_BASE < SIM_PPB_SIZE) {
+		/* registers are word wide, narrower accesses read-modify-write */
+		uint32_t word = address & ~3;
+		unsigned int shift = 8 * (address & 3);
+		uint32_t mask = (size == 4 ? 0xffffffff : (1u << (8 * size)) - 1) << shift;
+		if (write) {
+			uint32_t old = size == 4 ? 0 : sim_ppb_get(word);
+			sim_ppb_write(word, (old & ~mask) | ((*value << shift) & mask));
+		} else {
+			*value = (sim_ppb_read(word) & mask) >> shift;
+		}
+		return ERROR_OK;
+	}
+
+	return ERROR_FAIL;
+}
+
+static int sim_ap_access(unsigned int reg, bool read, uint32_t *data)
+{
+	unsigned int apsel = sim_dp.select >> 24;
+	unsigned int size = 1 << (sim_ap.csw & CSW_SIZE_MASK);
+
+	if (read)
+		sim_stats.ap_reads++;
+	else
+		sim_stats.ap_writes++;
+
+	/* transactions are discarded until the sticky error is cleared */
+	if (sim_dp.ctrl_stat & SSTICKYERR)
+		return ERROR_FAIL;
+
+	reg |= sim_dp.select & DP_SELECT_APBANK;
+
+	if (apsel != 0) {
+		/* no AP, reads as zero */
+		if (read)
+			*data = 0;
+		return ERROR_OK;
+	}
+
+	switch (reg) {
+	case MEM_AP_REG_CSW:
+		if (read) {
+			*data = sim_ap.csw | CSW_DEVICE_EN;
+		} else {
+			sim_ap.csw = *data & ~(CSW_DEVICE_EN | CSW_TRIN_PROG);
+			/* byte, half-word and word accesses, no packed transfers */
+			if ((sim_ap.csw & CSW_SIZE_MASK) > CSW_32BIT)
+				sim_ap.csw &= ~CSW_SIZE_MASK;
+			if ((sim_ap.csw & CSW_ADDRINC_MASK) != CSW_ADDRINC_SINGLE)
+				sim_ap.csw &= ~CSW_ADDRINC_MASK;
+		}
+		return ERROR_OK;
+	case MEM_AP_REG_TAR:
+		if (read)
+			*data = sim_ap.tar;
+		else
+			sim_ap.tar = *data;
+		return ERROR_OK;
+	case MEM_AP_REG_DRW:
+	case MEM_AP_REG_BD0:
+	case MEM_AP_REG_BD1:
+	case MEM_AP_REG_BD2:
+	case MEM_AP_REG_BD3: {
+		uint32_t address = reg == MEM_AP_REG_DRW ? sim_ap.tar :
+			(sim_ap.tar & ~0xf) | (reg & 0xc);
+		unsigned int lane = 8 * (address & 3);
+		uint32_t value = read ? 0 : *data >> lane;
+
+		if (sim_bus_access(address, size, !read, &value) != ERROR_OK) {
+			LOG_DEBUG("sim: bus error at 0x%08" PRIx32, address);
+			sim_dp.ctrl_stat |= SSTICKYERR;
+			return ERROR_FAIL;
+		}
+		if (read)
+			*data = value << lane;
+
+		/* auto-increment is only guaranteed within 1 KiB */
+		if (reg == MEM_AP_REG_DRW && (sim_ap.csw & CSW_ADDRINC_MASK) == CSW_ADDRINC_SINGLE)
+			sim_ap.tar = (sim_ap.tar & ~0x3ff) | ((sim_ap.tar + size) & 0x3ff);
+		return ERROR_OK;
+	}
+	case MEM_AP_REG_BASE:
+		if (read)
+			*data = SIM_ROM_TABLE | 3;
+		return ERROR_OK;
+	case AP_REG_IDR:
+		if (read)
+			*data = SIM_AP_IDR;
+		return ERROR_OK;
+	default:
+		if (read)
+			*data = 0;
+		return ERROR_OK;
+	}
+}
+
+static uint32_t sim_ctrl_stat_read(void)
+{
+	uint32_t value = sim_dp.ctrl_stat;
+
+	/* power up and reset requests are acknowledged immediately */
+	value |= (value & (CDBGRSTREQ | CDBGPWRUPREQ | CSYSPWRUPREQ)) << 1;
+
+	return value;
+}
+
+static void sim_ctrl_stat_write(uint32_t value, bool jtag)
+{
+	uint32_t sticky = SSTICKYORUN | SSTICKYCMP | SSTICKYERR;
+
+	/* sticky flags are cleared through ABORT on SWD, by writing one on JTAG */
+	if (jtag)
+		sticky &= ~value;
+	else
+		sticky &= sim_dp.ctrl_stat;
+
+	sim_dp.ctrl_stat = (sim_dp.ctrl_stat & sticky) |
+		(value & (CSYSPWRUPREQ | CDBGPWRUPREQ | CDBGRSTREQ | 0xfff00 | CORUNDETECT));
+}
+
+static void sim_abort_write(uint32_t value)
+{
+	if (value & STKCMPCLR)
+		sim_dp.ctrl_stat &= ~SSTICKYCMP;
+	if (value & STKERRCLR)
+		sim_dp.ctrl_stat &= ~SSTICKYERR;
+	if (value & ORUNERRCLR)
+		sim_dp.ctrl_stat &= ~SSTICKYORUN;
+}
+
+static void sim_link_cycles(unsigned int cycles)
+{
+	sim_pending_cycles += cycles;
+}
+
+/* End of a queue execution, the simulated link time has passed */
+static void sim_link_flush(void)
+{
+	uint64_t ns = sim_latency_us * 1000ull;
+
+	if (sim_khz)
+		ns += sim_pending_cycles * 1000000 / sim_khz;
+
+	sim_stats.runs++;
+	sim_stats.cycles += sim_pending_cycles;
+	sim_stats.link_ns += ns;
+	sim_pending_cycles = 0;
+
+	if (ns >= 1000)
+		jtag_sleep(ns / 1000);
+}
+
+static int sim_swd_switch_seq(enum swd_special_seq seq)
+{
+	switch (seq) {
+	case LINE_RESET:
+		LOG_DEBUG("SWD line reset");
+		sim_link_cycles(swd_seq_line_reset_len);
+		break;
+	case JTAG_TO_SWD:
+		LOG_DEBUG("JTAG-to-SWD");
+		sim_link_cycles(swd_seq_jtag_to_swd_len);
+		break;
+	case SWD_TO_JTAG:
+		LOG_DEBUG("SWD-to-JTAG");
+		sim_link_cycles(swd_seq_swd_to_jtag_len);
+		break;
+	default:
+		LOG_ERROR("Sequence %d not supported", seq);
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+static void sim_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay_clk)
+{
+	unsigned int reg = (cmd & SWD_CMD_A32) >> 1;
+	uint32_t data = 0;
+
+	assert(cmd & SWD_CMD_RnW);
+
+	if (queued_retval != ERROR_OK)
+		return;
+
+	if (!(cmd & SWD_CMD_APnDP)) {
+		sim_link_cycles(SIM_SWD_TRANSFER_CYCLES);
+		sim_stats.dp_reads++;
+
+		switch (reg) {
+		case DP_DPIDR:
+			data = SIM_DPIDR;
+			break;
+		case DP_CTRL_STAT:
+			if ((sim_dp.select & DP_SELECT_DPBANK) == 0)
+				data = sim_ctrl_stat_read();
+			break;
+		case DP_RESEND:
+		case DP_RDBUFF:
+			data = sim_dp.rdbuff;
+			break;
+		}
+	} else {
+		sim_link_cycles(SIM_SWD_TRANSFER_CYCLES + ap_delay_clk);
+
+		if (sim_ap_access(reg, true, &data) != ERROR_OK) {
+			sim_stats.faults++;
+			queued_retval = ERROR_FAIL;
+			return;
+		}
+
+		/* AP reads are posted, return the result of the previous one */
+		uint32_t posted = sim_dp.rdbuff;
+		sim_dp.rdbuff = data;
+		data = posted;
+	}
+
+	if (value)
+		*value = data;
+}
+
+static void sim_swd_write_reg(uint8_t cmd, uint32_t value, uint32_t ap_delay_clk)
+{
+	unsigned int reg = (cmd & SWD_CMD_A32) >> 1;
+
+	assert(!(cmd & SWD_CMD_RnW));
+
+	if (queued_retval != ERROR_OK)
+		return;
+
+	if (!(cmd & SWD_CMD_APnDP)) {
+		sim_link_cycles(SIM_SWD_TRANSFER_CYCLES);
+		sim_stats.dp_writes++;
+
+		switch (reg) {
+		case DP_ABORT:
+			sim_abort_write(value);
+			break;
+		case DP_CTRL_STAT:
+			if ((sim_dp.select & DP_SELECT_DPBANK) == 0)
+				sim_ctrl_stat_write(value, false);
+			break;
+		case DP_SELECT:
+			sim_dp.select = value;
+			break;
+		}
+	} else {
+		sim_link_cycles(SIM_SWD_TRANSFER_CYCLES + ap_delay_clk);
+
+		if (sim_ap_access(reg, false, &value) != ERROR_OK) {
+			sim_stats.faults++;
+			queued_retval = ERROR_FAIL;
+		}
+	}
+}
+
+static int sim_swd_run_queue(void)
+{
+	int retval = queued_retval;
+	queued_retval = ERROR_OK;
+
+	sim_link_flush();
+
+	return retval;
+}
+
+static int sim_swd_init(void)
+{
+	return ERROR_OK;
+}
+
+/* DPACC/APACC/ABORT scan: RnW, A[3:2] and data in, ack and data out */
+static void sim_jtag_dap_access(uint64_t in)
+{
+	bool read = in & 1;
+	unsigned int reg = (in >> 1 & 3) << 2;
+	uint32_t data = in >> 3;
+
+	if (sim_jtag.ir == SIM_JTAG_IR_ABORT)
+		return;
+
+	if (sim_jtag.ir == SIM_JTAG_IR_APACC) {
+		if (sim_ap_access(reg, read, &data) != ERROR_OK)
+			sim_stats.faults++;
+		sim_jtag.result = read ? data : 0;
+		return;
+	}
+
+	if (read)
+		sim_stats.dp_reads++;
+	else
+		sim_stats.dp_writes++;
+
+	switch (reg) {
+	case DP_DPIDR:
+		data = SIM_DPIDR;
+		break;
+	case DP_CTRL_STAT:
+		if (read)
+			data = sim_ctrl_stat_read();
+		else
+			sim_ctrl_stat_write(data, true);
+		break;
+	case DP_SELECT:
+		if (read)
+			data = sim_dp.select;
+		else
+			sim_dp.select = data;
+		break;
+	default:
+		/* RDBUFF reads as zero, its capture returns the previous result */
+		data = 0;
+		break;
+	}
+
+	sim_jtag.result = read ? data : 0;
+}
+
+static void sim_jtag_scan(bool ir_scan, uint8_t *buffer, int bits)
+{
+	unsigned int len;
+	uint64_t capture;
+
+	if (ir_scan) {
+		len = SIM_JTAG_IR_LEN;
+		capture = 1;
+	} else if (sim_jtag.ir == SIM_JTAG_IR_IDCODE) {
+		len = 32;
+		capture = SIM_IDCODE;
+	} else if (sim_jtag.ir == SIM_JTAG_IR_DPACC || sim_jtag.ir == SIM_JTAG_IR_APACC
+			|| sim_jtag.ir == SIM_JTAG_IR_ABORT) {
+		len = 35;
+		capture = (uint64_t)sim_jtag.result << 3 | SIM_JTAG_ACK_OK;
+	} else {
+		/* BYPASS */
+		len = 1;
+		capture = 0;
+	}
+
+	sim_link_cycles(bits + SIM_JTAG_SCAN_CYCLES);
+
+	/* the register is shifted out first, followed by the bits shifted in */
+	uint8_t *in = malloc(DIV_ROUND_UP(bits, 8));
+	if (!in) {
+		queued_retval = ERROR_FAIL;
+		return;
+	}
+	memcpy(in, buffer, DIV_ROUND_UP(bits, 8));
+	for (int i = 0; i < bits; i++) {
+		int bit = i < (int)len ? (capture >> i) & 1 : buf_get_u32(in, i - len, 1);
+		buf_set_u32(buffer, i, 1, bit);
+	}
+
+	if (bits >= (int)len) {
+		uint64_t value = buf_get_u64(in, bits - len, len);
+		if (ir_scan)
+			sim_jtag.ir = value;
+		else if (len == 35)
+			sim_jtag_dap_access(value);
+	}
+
+	free(in);
+}
+
+static int sim_execute_command(struct jtag_command *cmd)
+{
+	switch (cmd->type) {
+	case JTAG_SCAN: {
+		uint8_t *buffer;
+		int bits = jtag_build_buffer(cmd->cmd.scan, &buffer);
+		sim_jtag_scan(cmd->cmd.scan->ir_scan, buffer, bits);
+		int retval = jtag_read_buffer(buffer, cmd->cmd.scan);
+		free(buffer);
+		tap_set_state(cmd->cmd.scan->end_state);
+		return retval;
+	}
+	case JTAG_TLR_RESET:
+		sim_jtag.ir = SIM_JTAG_IR_IDCODE;
+		sim_link_cycles(5);
+		tap_set_state(cmd->cmd.statemove->end_state);
+		break;
+	case JTAG_RUNTEST:
+		sim_link_cycles(cmd->cmd.runtest->num_cycles);
+		tap_set_state(cmd->cmd.runtest->end_state);
+		break;
+	case JTAG_STABLECLOCKS:
+		sim_link_cycles(cmd->cmd.stableclocks->num_cycles);
+		break;
+	case JTAG_PATHMOVE:
+		for (int i = 0; i < cmd->cmd.pathmove->num_states; i++) {
+			if (cmd->cmd.pathmove->path[i] == TAP_RESET)
+				sim_jtag.ir = SIM_JTAG_IR_IDCODE;
+		}
+		sim_link_cycles(cmd->cmd.pathmove->num_states);
+		tap_set_state(cmd->cmd.pathmove->path[cmd->cmd.pathmove->num_states - 1]);
+		break;
+	case JTAG_TMS:
+		sim_link_cycles(cmd->cmd.tms->num_bits);
+		break;
+	case JTAG_RESET:
+		if (cmd->cmd.reset->trst == 1) {
+			sim_jtag.ir = SIM_JTAG_IR_IDCODE;
+			tap_set_state(TAP_RESET);
+		}
+		break;
+	case JTAG_SLEEP:
+		jtag_sleep(cmd->cmd.sleep->us);
+		break;
+	default:
+		LOG_ERROR("BUG: unknown JTAG command type encountered");
+		return ERROR_JTAG_QUEUE_FAILED;
+	}
+
+	return ERROR_OK;
+}
+
+static int sim_execute_queue(void)
+{
+	int retval = ERROR_OK;
+
+	for (struct jtag_command *cmd = jtag_command_queue; cmd; cmd = cmd->next) {
+		retval = sim_execute_command(cmd);
+		if (retval != ERROR_OK)
+			break;
+	}
+
+	if (retval == ERROR_OK)
+		retval = queued_retval;
+	queued_retval = ERROR_OK;
+
+	sim_link_flush();
+
+	return retval;
+}
+
+static int sim_reset(int trst, int srst)
+{
+	if (trst)
+		sim_jtag.ir = SIM_JTAG_IR_IDCODE;
+
+	if (srst) {
+		sim_core.in_reset = true;
+	} else if (sim_core.in_reset) {
+		sim_core.in_reset = false;
+		sim_system_reset();
+	}
+
+	return ERROR_OK;
+}
+
+static int sim_speed(int speed)
+{
+	sim_khz = speed;
+	return ERROR_OK;
+}
+
+static int sim_khz_to_speed(int khz, int *jtag_speed)
+{
+	*jtag_speed = khz;
+	return ERROR_OK;
+}
+
+static int sim_speed_div(int speed, int *khz)
+{
+	*khz = speed;
+	return ERROR_OK;
+}
+
+static void sim_ppb_set_component(uint32_t base, uint8_t class)
+{
+	sim_ppb_set(base + 0xff0, 0x0d);
+	sim_ppb_set(base + 0xff4, class << 4);
+	sim_ppb_set(base + 0xff8, 0x05);
+	sim_ppb_set(base + 0xffc, 0xb1);
+}
+
+static int sim_init(void)
+{
+	sim_ram.data = calloc(1, sim_ram.size);
+	sim_flash.data = malloc(sim_flash.size);
+	sim_ppb = calloc(1, SIM_PPB_SIZE);
+	if (!sim_ram.data || !sim_flash.data || !sim_ppb) {
+		LOG_ERROR("sim: unable to allocate target memory");
+		return ERROR_JTAG_INIT_FAILED;
+	}
+	memset(sim_flash.data, 0xff, sim_flash.size);
+
+	/* ROM table with SCS, DWT, FPB and ITM */
+	sim_ppb_set(SIM_ROM_TABLE + 0x0, 0xfff0f003);
+	sim_ppb_set(SIM_ROM_TABLE + 0x4, 0xfff02003);
+	sim_ppb_set(SIM_ROM_TABLE + 0x8, 0xfff03003);
+	sim_ppb_set(SIM_ROM_TABLE + 0xc, 0xfff01003);
+	sim_ppb_set_component(SIM_ROM_TABLE, 0x1);
+	sim_ppb_set_component(0xe000e000, 0xe);
+	sim_ppb_set_component(0xe0001000, 0xe);
+	sim_ppb_set_component(0xe0002000, 0xe);
+	sim_ppb_set_component(0xe0000000, 0xe);
+
+	sim_jtag.ir = SIM_JTAG_IR_IDCODE;
+	sim_system_reset();
+
+	LOG_INFO("sim: %" PRIu32 " KiB flash at 0x%08" PRIx32 ", %" PRIu32 " KiB RAM at 0x%08" PRIx32,
+		sim_flash.size / 1024, sim_flash.base, sim_ram.size / 1024, sim_ram.base);
+
+	return ERROR_OK;
+}
+
+static int sim_quit(void)
+{
+	free(sim_ram.data);
+	sim_ram.data = NULL;
+	free(sim_flash.data);
+	sim_flash.data = NULL;
+	free(sim_ppb);
+	sim_ppb = NULL;
+
+	return ERROR_OK;
+}
+
+static int sim_parse_memory(struct command_invocation *cmd, struct sim_memory *mem)
+{
+	uint32_t base, size;
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], base);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+
+	if (!size || size % SIM_FLASH_PAGE_SIZE || base % SIM_FLASH_PAGE_SIZE
+			|| base + (size - 1) < base) {
+		command_print(CMD, "address and size must be multiples of 1 KiB");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	mem->base = base;
+	mem->size = size;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(sim_handle_ram_command)
+{
+	return sim_parse_memory(CMD, &sim_ram);
+}
+
+COMMAND_HANDLER(sim_handle_flash_command)
+{
+	return sim_parse_memory(CMD, &sim_flash);
+}
+
+COMMAND_HANDLER(sim_handle_latency_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], sim_latency_us);
+
+	command_print(CMD, "sim latency: %u us", sim_latency_us);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(sim_handle_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(&sim_stats, 0, sizeof(sim_stats));
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "queue executions: %" PRIu64, sim_stats.runs);
+	command_print(CMD, "DP reads/writes:  %" PRIu64 "/%" PRIu64,
+		sim_stats.dp_reads, sim_stats.dp_writes);
+	command_print(CMD, "AP reads/writes:  %" PRIu64 "/%" PRIu64 " (%" PRIu64 " faults)",
+		sim_stats.ap_reads, sim_stats.ap_writes, sim_stats.faults);
+	command_print(CMD, "bytes read/written on the bus: %" PRIu64 "/%" PRIu64,
+		sim_stats.bytes_read, sim_stats.bytes_written);
+	command_print(CMD, "flash bytes programmed/erased: %" PRIu64 "/%" PRIu64,
+		sim_stats.flash_programmed, sim_stats.flash_erased);
+	command_print(CMD, "link: %" PRIu64 " clock cycles, %" PRIu64 " us",
+		sim_stats.cycles, sim_stats.link_ns / 1000);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration sim_subcommand_handlers[] = {
+	{
+		.name = "ram",
+		.handler = &sim_handle_ram_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set address and size of the simulated RAM",
+		.usage = "address size",
+	},
+	{
+		.name = "flash",
+		.handler = &sim_handle_flash_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set address and size of the simulated flash",
+		.usage = "address size",
+	},
+	{
+		.name = "latency",
+		.handler = &sim_handle_latency_command,
+		.mode = COMMAND_ANY,
+		.help = "set the simulated latency of each queue execution",
+		.usage = "[microseconds]",
+	},
+	{
+		.name = "stats",
+		.handler = &sim_handle_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "show or reset the transaction counters",
+		.usage = "['reset']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration sim_command_handlers[] = {
+	{
+		.name = "sim",
+		.mode = COMMAND_ANY,
+		.help = "simulated target adapter commands",
+		.chain = sim_subcommand_handlers,
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static struct jtag_interface sim_interface = {
+	.execute_queue = &sim_execute_queue,
+};
+
+static const struct swd_driver sim_swd = {
+	.init = sim_swd_init,
+	.switch_seq = sim_swd_switch_seq,
+	.read_reg = sim_swd_read_reg,
+	.write_reg = sim_swd_write_reg,
+	.run = sim_swd_run_queue,
+};
+
+static const char * const sim_transports[] = { "swd", "jtag", NULL };
+
+struct adapter_driver sim_adapter_driver = {
+	.name = "sim",
+	.transports = sim_transports,
+	.commands = sim_command_handlers,
+
+	.init = &sim_init,
+	.quit = &sim_quit,
+	.reset = &sim_reset,
+	.speed = &sim_speed,
+	.khz = &sim_khz_to_speed,
+	.speed_div = &sim_speed_div,
+
+	.jtag_ops = &sim_interface,
+	.swd_ops = &sim_swd,
+};
@@ -423,6 +423,7 @@ static inline int stlink_usb_xfer_noerrcheck(void *handle, const uint8_t *buf, i
 #define STLINK_F_HAS_DPBANKSEL          BIT(8)
 #define STLINK_F_HAS_RW8_512BYTES       BIT(9)
 #define STLINK_F_FIX_CLOSE_AP           BIT(10)
+#define STLINK_F_HAS_CSW                BIT(11)
 
 /* aliases */
 #define STLINK_F_HAS_TARGET_VOLT        STLINK_F_HAS_TRACE
@@ -430,6 +431,10 @@ static inline int stlink_usb_xfer_noerrcheck(void *handle, const uint8_t *buf, i
 
 #define STLINK_REGSEL_IS_FPU(x)         ((x) > 0x1F)
 
+/* HLA is limited to AP 0 and leaves the CSW to the firmware */
+#define STLINK_HLA_AP_NUM               0
+#define STLINK_HLA_CSW                  0
+
 struct speed_map {
 	int speed;
 	int speed_divisor;
@@ -1260,8 +1265,11 @@ static int stlink_usb_version(void *handle)
 			flags |= STLINK_F_FIX_CLOSE_AP;
 
 		/* Banked regs (DPv1 & DPv2) support from V2J32 */
-		if (h->version.jtag >= 32)
+		/* Memory R/W on any AP and with any CSW from V2J32 */
+		if (h->version.jtag >= 32) {
 			flags |= STLINK_F_HAS_DPBANKSEL;
+			flags |= STLINK_F_HAS_CSW;
+		}
 
 		break;
 	case 3:
@@ -1290,8 +1298,11 @@ static int stlink_usb_version(void *handle)
 		flags |= STLINK_F_FIX_CLOSE_AP;
 
 		/* Banked regs (DPv1 & DPv2) support from V3J2 */
-		if (h->version.jtag >= 2)
+		/* Memory R/W on any AP and with any CSW from V3J2 */
+		if (h->version.jtag >= 2) {
 			flags |= STLINK_F_HAS_DPBANKSEL;
+			flags |= STLINK_F_HAS_CSW;
+		}
 
 		/* 8bit read/write max packet size 512 bytes from V3J6 */
 		if (h->version.jtag >= 6)
@@ -2473,8 +2484,8 @@ static int stlink_usb_write_mem16(void *handle, uint32_t addr, uint16_t len,
 }
 
 /** */
-static int stlink_usb_read_mem32(void *handle, uint32_t addr, uint16_t len,
-			  uint8_t *buffer)
+static int stlink_usb_read_mem32(void *handle, uint8_t ap_num, uint32_t csw,
+		uint32_t addr, uint16_t len, uint8_t *buffer)
 {
 	int res;
 	struct stlink_usb_handle_s *h = handle;
@@ -2495,6 +2506,11 @@ static int stlink_usb_read_mem32(void *handle, uint32_t addr, uint16_t len,
 	h->cmdidx += 4;
 	h_u16_to_le(h->cmdbuf+h->cmdidx, len);
 	h->cmdidx += 2;
+	if (h->version.flags & STLINK_F_HAS_CSW) {
+		h->cmdbuf[h->cmdidx++] = ap_num;
+		h_u24_to_le(h->cmdbuf+h->cmdidx, csw >> 8);
+		h->cmdidx += 3;
+	}
 
 	res = stlink_usb_xfer_noerrcheck(handle, h->databuf, len);
 
@@ -2507,8 +2523,8 @@ static int stlink_usb_read_mem32(void *handle, uint32_t addr, uint16_t len,
 }
 
 /** */
-static int stlink_usb_write_mem32(void *handle, uint32_t addr, uint16_t len,
-			   const uint8_t *buffer)
+static int stlink_usb_write_mem32(void *handle, uint8_t ap_num, uint32_t csw,
+		uint32_t addr, uint16_t len, const uint8_t *buffer)
 {
 	int res;
 	struct stlink_usb_handle_s *h = handle;
@@ -2529,6 +2545,11 @@ static int stlink_usb_write_mem32(void *handle, uint32_t addr, uint16_t len,
 	h->cmdidx += 4;
 	h_u16_to_le(h->cmdbuf+h->cmdidx, len);
 	h->cmdidx += 2;
+	if (h->version.flags & STLINK_F_HAS_CSW) {
+		h->cmdbuf[h->cmdidx++] = ap_num;
+		h_u24_to_le(h->cmdbuf+h->cmdidx, csw >> 8);
+		h->cmdidx += 3;
+	}
 
 	res = stlink_usb_xfer_noerrcheck(handle, buffer, len);
 
@@ -2607,7 +2628,8 @@ static int stlink_usb_read_mem(void *handle, uint32_t addr, uint32_t size,
 			else if (size == 2)
 				retval = stlink_usb_read_mem16(handle, addr, bytes_remaining, buffer);
 			else
-				retval = stlink_usb_read_mem32(handle, addr, bytes_remaining, buffer);
+				retval = stlink_usb_read_mem32(handle, STLINK_HLA_AP_NUM, STLINK_HLA_CSW,
+						addr, bytes_remaining, buffer);
 		} else
 			retval = stlink_usb_read_mem8(handle, addr, bytes_remaining, buffer);
 
@@ -2687,7 +2709,8 @@ static int stlink_usb_write_mem(void *handle, uint32_t addr, uint32_t size,
 			else if (size == 2)
 				retval = stlink_usb_write_mem16(handle, addr, bytes_remaining, buffer);
 			else
-				retval = stlink_usb_write_mem32(handle, addr, bytes_remaining, buffer);
+				retval = stlink_usb_write_mem32(handle, STLINK_HLA_AP_NUM, STLINK_HLA_CSW,
+						addr, bytes_remaining, buffer);
 
 		} else
 			retval = stlink_usb_write_mem8(handle, addr, bytes_remaining, buffer);
@@ -3494,7 +3517,7 @@ static int stlink_open(struct hl_interface_param_s *param, enum stlink_mode mode
 
 		uint8_t buffer[4];
 		stlink_usb_open_ap(h, 0);
-		err = stlink_usb_read_mem32(h, CPUID, 4, buffer);
+		err = stlink_usb_read_mem32(h, STLINK_HLA_AP_NUM, STLINK_HLA_CSW, CPUID, 4, buffer);
 		if (err == ERROR_OK) {
 			uint32_t cpuid = le_to_h_u32(buffer);
 			int i = (cpuid >> 4) & 0xf;
@@ -3723,8 +3746,47 @@ static struct hl_interface_param_s stlink_dap_param;
 static DECLARE_BITMAP(opened_ap, DP_APSEL_MAX + 1);
 static int stlink_dap_error = ERROR_OK;
 
+/* Number of DAP operations recorded before they have to be executed */
+#define STLINK_DAP_QUEUE_SIZE		1024
+
+enum stlink_dap_op_type {
+	STLINK_DAP_DP_READ,
+	STLINK_DAP_DP_WRITE,
+	STLINK_DAP_AP_READ,
+	STLINK_DAP_AP_WRITE,
+};
+
+struct stlink_dap_op {
+	enum stlink_dap_op_type type;
+	struct adiv5_ap *ap;
+	unsigned int reg;
+	uint32_t *dst;
+	uint32_t data;
+};
+
+/*
+ * MEM-AP registers as last written through the queue. The firmware memory
+ * commands used for block transfers overwrite CSW and TAR of the AP, so
+ * they are written again before the next plain access that depends on them.
+ */
+struct stlink_dap_ap_regs {
+	bool csw_valid;
+	bool tar_valid;
+	/* hardware CSW/TAR may differ from the values below */
+	bool dirty;
+	uint32_t csw;
+	uint32_t tar;
+	uint32_t tar64;
+};
+
+static struct stlink_dap_op stlink_dap_queue[STLINK_DAP_QUEUE_SIZE];
+static unsigned int stlink_dap_queue_len;
+static struct stlink_dap_ap_regs stlink_dap_ap_regs[DP_APSEL_MAX + 1];
+static uint8_t stlink_dap_block[STLINK_DATA_SIZE];
+
 static int stlink_dap_op_queue_dp_read(struct adiv5_dap *dap, unsigned reg,
 		uint32_t *data);
+static int stlink_dap_run_queue(void);
 
 /** */
 static int stlink_dap_record_error(int error)
@@ -3846,6 +3908,8 @@ static int stlink_dap_op_connect(struct adiv5_dap *dap)
 
 	dap->do_reconnect = false;
 	dap_invalidate_cache(dap);
+	stlink_dap_queue_len = 0;
+	memset(stlink_dap_ap_regs, 0, sizeof(stlink_dap_ap_regs));
 
 	retval = dap_dp_init(dap);
 	if (retval != ERROR_OK) {
@@ -3887,22 +3951,11 @@ static int stlink_dap_op_send_sequence(struct adiv5_dap *dap, enum swd_special_s
 }
 
 /** */
-static int stlink_dap_op_queue_dp_read(struct adiv5_dap *dap, unsigned reg,
-		uint32_t *data)
+static int stlink_dap_dp_read(unsigned int reg, uint32_t *data)
 {
 	uint32_t dummy;
 	int retval;
 
-	if (!(stlink_dap_handle->version.flags & STLINK_F_HAS_DPBANKSEL))
-		if (reg & 0x000000F0) {
-			LOG_ERROR("Banked DP registers not supported in current STLink FW");
-			return ERROR_COMMAND_NOTFOUND;
-		}
-
-	retval = stlink_dap_check_reconnect(dap);
-	if (retval != ERROR_OK)
-		return retval;
-
 	data = data ? : &dummy;
 	if (stlink_dap_handle->version.flags & STLINK_F_QUIRK_JTAG_DP_READ
 		&& stlink_dap_handle->st_mode == STLINK_MODE_DEBUG_JTAG) {
@@ -3917,7 +3970,266 @@ static int stlink_dap_op_queue_dp_read(struct adiv5_dap *dap, unsigned reg,
 					STLINK_DEBUG_PORT_ACCESS, reg, data);
 	}
 
-	return stlink_dap_record_error(retval);
+	return retval;
+}
+
+static bool stlink_dap_is_data_reg(unsigned int reg)
+{
+	return reg == MEM_AP_REG_DRW || (reg & ~0xc) == MEM_AP_REG_BD0;
+}
+
+/* Target address of an access to DRW or BD0..3 */
+static uint32_t stlink_dap_data_address(const struct stlink_dap_ap_regs *regs,
+		unsigned int reg)
+{
+	if (reg == MEM_AP_REG_DRW)
+		return regs->tar;
+	return (regs->tar & ~0xf) | (reg & 0xc);
+}
+
+/* Update the tracked TAR after an access to DRW */
+static void stlink_dap_drw_accessed(struct adiv5_ap *ap, struct stlink_dap_ap_regs *regs)
+{
+	uint32_t inc;
+
+	if (!regs->csw_valid) {
+		regs->tar_valid = false;
+		return;
+	}
+
+	switch (regs->csw & CSW_ADDRINC_MASK) {
+	case CSW_ADDRINC_SINGLE:
+		inc = 1 << (regs->csw & CSW_SIZE_MASK);
+		break;
+	case CSW_ADDRINC_PACKED:
+		inc = 4;
+		break;
+	default:
+		return;
+	}
+
+	/* autoincrement is only guaranteed inside the TAR block */
+	if (((regs->tar + inc) & ~(ap->tar_autoincr_block - 1)) !=
+			(regs->tar & ~(ap->tar_autoincr_block - 1)))
+		regs->tar_valid = false;
+	regs->tar += inc;
+}
+
+/* Write back CSW and TAR after a firmware memory command changed them */
+static int stlink_dap_restore_ap_regs(struct adiv5_ap *ap, struct stlink_dap_ap_regs *regs)
+{
+	int retval;
+
+	regs->dirty = false;
+
+	if (regs->csw_valid) {
+		retval = stlink_write_dap_register(stlink_dap_handle, ap->ap_num,
+				MEM_AP_REG_CSW, regs->csw);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	if (regs->tar_valid)
+		return stlink_write_dap_register(stlink_dap_handle, ap->ap_num,
+				MEM_AP_REG_TAR, regs->tar);
+
+	return ERROR_OK;
+}
+
+static int stlink_dap_ap_access(struct stlink_dap_op *op)
+{
+	struct adiv5_ap *ap = op->ap;
+	struct stlink_dap_ap_regs *regs = &stlink_dap_ap_regs[ap->ap_num];
+	int retval;
+
+	if (regs->dirty && op->reg <= MEM_AP_REG_BD3) {
+		retval = stlink_dap_restore_ap_regs(ap, regs);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	if (op->type == STLINK_DAP_AP_READ) {
+		uint32_t dummy;
+		retval = stlink_read_dap_register(stlink_dap_handle, ap->ap_num, op->reg,
+				op->dst ? : &dummy);
+	} else {
+		retval = stlink_write_dap_register(stlink_dap_handle, ap->ap_num, op->reg,
+				op->data);
+	}
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (op->type == STLINK_DAP_AP_WRITE) {
+		switch (op->reg) {
+		case MEM_AP_REG_CSW:
+			regs->csw = op->data;
+			regs->csw_valid = true;
+			break;
+		case MEM_AP_REG_TAR:
+			regs->tar = op->data;
+			regs->tar_valid = true;
+			break;
+		case MEM_AP_REG_TAR64:
+			regs->tar64 = op->data;
+			break;
+		}
+	}
+
+	if (op->reg == MEM_AP_REG_DRW)
+		stlink_dap_drw_accessed(ap, regs);
+
+	return ERROR_OK;
+}
+
+/*
+ * Count the accesses from op on that can be done as one firmware memory
+ * command: 32 bit accesses of the same direction to DRW (with single
+ * autoincrement) or BD0..3 of the same AP, at consecutive addresses that
+ * do not cross a TAR autoincrement block.
+ */
+static unsigned int stlink_dap_block_len(struct stlink_dap_op *op, unsigned int max_ops)
+{
+	struct adiv5_ap *ap = op->ap;
+	struct stlink_dap_ap_regs regs = stlink_dap_ap_regs[ap->ap_num];
+	uint32_t block_size = MIN(ap->tar_autoincr_block, stlink_dap_handle->max_mem_packet);
+	uint32_t address = stlink_dap_data_address(&regs, op->reg);
+	unsigned int n;
+
+	if (!(stlink_dap_handle->version.flags & STLINK_F_HAS_CSW) ||
+			!regs.csw_valid || !regs.tar_valid || regs.tar64 ||
+			(regs.csw & CSW_SIZE_MASK) != CSW_32BIT)
+		return 0;
+
+	for (n = 0; n < max_ops && n < sizeof(stlink_dap_block) / 4; n++) {
+		struct stlink_dap_op *next = &op[n];
+
+		if (next->type != op->type || next->ap != ap || !stlink_dap_is_data_reg(next->reg))
+			break;
+		if (next->reg == MEM_AP_REG_DRW &&
+				(regs.csw & CSW_ADDRINC_MASK) != CSW_ADDRINC_SINGLE)
+			break;
+		if (!regs.tar_valid || stlink_dap_data_address(&regs, next->reg) != address + 4 * n)
+			break;
+		if (n > 0 && ((address + 4 * n) & (block_size - 1)) == 0)
+			break;
+
+		if (next->reg == MEM_AP_REG_DRW)
+			stlink_dap_drw_accessed(ap, &regs);
+	}
+
+	return n;
+}
+
+static int stlink_dap_block_access(struct stlink_dap_op *op, unsigned int n)
+{
+	struct adiv5_ap *ap = op->ap;
+	struct stlink_dap_ap_regs *regs = &stlink_dap_ap_regs[ap->ap_num];
+	uint32_t address = stlink_dap_data_address(regs, op->reg);
+	int retries = 0;
+	int retval = ERROR_OK;
+
+	LOG_DEBUG_IO("AP %" PRIu8 " %s %u words at 0x%08" PRIx32, ap->ap_num,
+			op->type == STLINK_DAP_AP_READ ? "read" : "write", n, address);
+
+	if (op->type == STLINK_DAP_AP_WRITE)
+		for (unsigned int i = 0; i < n; i++)
+			h_u32_to_le(stlink_dap_block + 4 * i, op[i].data);
+
+	/* the firmware takes over CSW and TAR of the AP */
+	regs->dirty = true;
+
+	do {
+		if (retval == ERROR_WAIT)
+			usleep((1 << retries++) * 1000);
+		if (op->type == STLINK_DAP_AP_READ)
+			retval = stlink_usb_read_mem32(stlink_dap_handle, ap->ap_num, regs->csw,
+					address, 4 * n, stlink_dap_block);
+		else
+			retval = stlink_usb_write_mem32(stlink_dap_handle, ap->ap_num, regs->csw,
+					address, 4 * n, stlink_dap_block);
+	} while (retval == ERROR_WAIT && retries < MAX_WAIT_RETRIES);
+
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (unsigned int i = 0; i < n; i++) {
+		if (op[i].type == STLINK_DAP_AP_READ && op[i].dst)
+			*op[i].dst = le_to_h_u32(stlink_dap_block + 4 * i);
+		if (op[i].reg == MEM_AP_REG_DRW)
+			stlink_dap_drw_accessed(ap, regs);
+	}
+
+	return ERROR_OK;
+}
+
+/* Execute the recorded operations, stop at the first error */
+static int stlink_dap_run_queue(void)
+{
+	int retval = ERROR_OK;
+	unsigned int n;
+
+	for (unsigned int i = 0; i < stlink_dap_queue_len && retval == ERROR_OK; i += n) {
+		struct stlink_dap_op *op = &stlink_dap_queue[i];
+
+		n = 1;
+		switch (op->type) {
+		case STLINK_DAP_DP_READ:
+			retval = stlink_dap_dp_read(op->reg, op->dst);
+			break;
+		case STLINK_DAP_DP_WRITE:
+			retval = stlink_write_dap_register(stlink_dap_handle,
+						STLINK_DEBUG_PORT_ACCESS, op->reg, op->data);
+			break;
+		case STLINK_DAP_AP_READ:
+		case STLINK_DAP_AP_WRITE:
+			if (stlink_dap_is_data_reg(op->reg))
+				n = stlink_dap_block_len(op, stlink_dap_queue_len - i);
+			if (n > 1) {
+				retval = stlink_dap_block_access(op, n);
+			} else {
+				n = 1;
+				retval = stlink_dap_ap_access(op);
+			}
+			break;
+		}
+	}
+
+	stlink_dap_queue_len = 0;
+	return retval;
+}
+
+static void stlink_dap_queue_op(enum stlink_dap_op_type type, struct adiv5_ap *ap,
+		unsigned int reg, uint32_t *dst, uint32_t data)
+{
+	if (stlink_dap_queue_len == STLINK_DAP_QUEUE_SIZE)
+		stlink_dap_record_error(stlink_dap_run_queue());
+
+	struct stlink_dap_op *op = &stlink_dap_queue[stlink_dap_queue_len++];
+	op->type = type;
+	op->ap = ap;
+	op->reg = reg;
+	op->dst = dst;
+	op->data = data;
+}
+
+/** */
+static int stlink_dap_op_queue_dp_read(struct adiv5_dap *dap, unsigned reg,
+		uint32_t *data)
+{
+	int retval;
+
+	if (!(stlink_dap_handle->version.flags & STLINK_F_HAS_DPBANKSEL))
+		if (reg & 0x000000F0) {
+			LOG_ERROR("Banked DP registers not supported in current STLink FW");
+			return ERROR_COMMAND_NOTFOUND;
+		}
+
+	retval = stlink_dap_check_reconnect(dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	stlink_dap_queue_op(STLINK_DAP_DP_READ, NULL, reg, data, 0);
+	return ERROR_OK;
 }
 
 /** */
@@ -3946,9 +4258,8 @@ static int stlink_dap_op_queue_dp_write(struct adiv5_dap *dap, unsigned reg,
 	if (reg == DP_CTRL_STAT)
 		data &= ~CORUNDETECT;
 
-	retval = stlink_write_dap_register(stlink_dap_handle,
-				STLINK_DEBUG_PORT_ACCESS, reg, data);
-	return stlink_dap_record_error(retval);
+	stlink_dap_queue_op(STLINK_DAP_DP_WRITE, NULL, reg, NULL, data);
+	return ERROR_OK;
 }
 
 /** */
@@ -3956,7 +4267,6 @@ static int stlink_dap_op_queue_ap_read(struct adiv5_ap *ap, unsigned reg,
 		uint32_t *data)
 {
 	struct adiv5_dap *dap = ap->dap;
-	uint32_t dummy;
 	int retval;
 
 	retval = stlink_dap_check_reconnect(dap);
@@ -3968,11 +4278,10 @@ static int stlink_dap_op_queue_ap_read(struct adiv5_ap *ap, unsigned reg,
 		if (retval != ERROR_OK)
 			return retval;
 	}
-	data = data ? : &dummy;
-	retval = stlink_read_dap_register(stlink_dap_handle, ap->ap_num, reg,
-				 data);
+
+	stlink_dap_queue_op(STLINK_DAP_AP_READ, ap, reg, data, 0);
 	dap->stlink_flush_ap_write = false;
-	return stlink_dap_record_error(retval);
+	return ERROR_OK;
 }
 
 /** */
@@ -3990,10 +4299,9 @@ static int stlink_dap_op_queue_ap_write(struct adiv5_ap *ap, unsigned reg,
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = stlink_write_dap_register(stlink_dap_handle, ap->ap_num, reg,
-				data);
+	stlink_dap_queue_op(STLINK_DAP_AP_WRITE, ap, reg, NULL, data);
 	dap->stlink_flush_ap_write = true;
-	return stlink_dap_record_error(retval);
+	return ERROR_OK;
 }
 
 /** */
@@ -4026,6 +4334,7 @@ static int stlink_dap_op_run(struct adiv5_dap *dap)
 		}
 	}
 
+	stlink_dap_record_error(stlink_dap_run_queue());
 	saved_retval = stlink_dap_get_and_clear_error();
 
 	retval = stlink_dap_op_queue_dp_read(dap, DP_CTRL_STAT, &ctrlstat);
@@ -4033,7 +4342,7 @@ static int stlink_dap_op_run(struct adiv5_dap *dap)
 		dap->do_reconnect = true;
 		return retval;
 	}
-	retval = stlink_dap_get_and_clear_error();
+	retval = stlink_dap_run_queue();
 	if (retval != ERROR_OK) {
 		LOG_ERROR("Fail reading CTRL/STAT register. Force reconnect");
 		dap->do_reconnect = true;
@@ -4050,7 +4359,7 @@ static int stlink_dap_op_run(struct adiv5_dap *dap)
 			dap->do_reconnect = true;
 			return retval;
 		}
-		retval = stlink_dap_get_and_clear_error();
+		retval = stlink_dap_run_queue();
 		if (retval != ERROR_OK) {
 			dap->do_reconnect = true;
 			return retval;
@@ -4070,6 +4379,8 @@ static void stlink_dap_op_quit(struct adiv5_dap *dap)
 {
 	int retval;
 
+	stlink_dap_queue_len = 0;
+
 	retval = stlink_dap_closeall_ap();
 	if (retval != ERROR_OK)
 		LOG_ERROR("Error closing APs");
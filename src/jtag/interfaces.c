@@ -48,6 +48,9 @@ extern struct adapter_driver parport_adapter_driver;
 #if BUILD_DUMMY == 1
 extern struct adapter_driver dummy_adapter_driver;
 #endif
+#if BUILD_SIM == 1
+extern struct adapter_driver sim_adapter_driver;
+#endif
 #if BUILD_FTDI == 1
 extern struct adapter_driver ftdi_adapter_driver;
 #endif
@@ -159,6 +162,9 @@ struct adapter_driver *adapter_drivers[] = {
 #if BUILD_DUMMY == 1
 		&dummy_adapter_driver,
 #endif
+#if BUILD_SIM == 1
+		&sim_adapter_driver,
+#endif
 #if BUILD_FTDI == 1
 		&ftdi_adapter_driver,
 #endif
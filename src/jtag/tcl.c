@@ -857,6 +857,24 @@ COMMAND_HANDLER(handle_jtag_init_command)
 	return jtag_init(CMD_CTX);
 }
 
+COMMAND_HANDLER(handle_jtag_queue_stats_command)
+{
+	struct cmd_queue_stats stats;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	cmd_queue_get_stats(&stats);
+
+	command_print(CMD, "pages: %u (%zu bytes), peak: %u pages in one queue, "
+			"%zu bytes owned", stats.pages, stats.bytes, stats.peak_pages,
+			stats.peak_bytes);
+	command_print(CMD, "pages allocated: %lu, reused: %lu",
+			stats.allocated_pages, stats.reused_pages);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration jtag_subcommand_handlers[] = {
 	{
 		.name = "init",
@@ -939,6 +957,13 @@ static const struct command_registration jtag_subcommand_handlers[] = {
 		.jim_handler = jim_jtag_names,
 		.help = "Returns list of all JTAG tap names.",
 	},
+	{
+		.name = "queue_stats",
+		.mode = COMMAND_EXEC,
+		.handler = handle_jtag_queue_stats_command,
+		.help = "Display memory usage of the command queue allocator.",
+		.usage = "",
+	},
 	{
 		.chain = jtag_command_handlers_to_move,
 	},
@@ -377,6 +377,8 @@ int openocd_main(int argc, char *argv[])
 	rtt_exit();
 	free_config();
 
+	log_flush();
+
 	if (ERROR_FAIL == ret)
 		return EXIT_FAILURE;
 	else if (ERROR_OK != ret)
@@ -174,12 +174,22 @@ static int rcmd_offset(const char *cmd, const char *name)
 static int nuttx_thread_packet(struct connection *connection,
 	char const *packet, int packet_size)
 {
-	char cmd[GDB_BUFFER_SIZE / 2 + 1] = ""; /* Extra byte for null-termination */
+	char *cmd = NULL;
 
-	if (!strncmp(packet, "qRcmd", 5)) {
-		size_t len = unhexify((uint8_t *)cmd, packet + 6, sizeof(cmd));
+	if (!strncmp(packet, "qRcmd,", 6)) {
+		/* packets may be much larger than GDB_BUFFER_SIZE, size the
+		 * buffer after the command instead of truncating it */
+		size_t hex_len = strlen(packet + 6);
 		int offset;
 
+		cmd = malloc(hex_len / 2 + 1); /* Extra byte for null-termination */
+		if (!cmd) {
+			LOG_ERROR("Out of memory");
+			goto pass;
+		}
+		size_t len = unhexify((uint8_t *)cmd, packet + 6, hex_len / 2);
+		cmd[len] = 0;
+
 		if (len <= 0)
 			goto pass;
 
@@ -224,8 +234,10 @@ static int nuttx_thread_packet(struct connection *connection,
 		}
 	}
 pass:
+	free(cmd);
 	return rtos_thread_packet(connection, packet, packet_size);
 retok:
+	free(cmd);
 	gdb_put_packet(connection, "OK", 2);
 	return ERROR_OK;
 }
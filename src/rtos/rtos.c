@@ -231,7 +231,7 @@ int rtos_qsymbol(struct connection *connection, char const *packet, int packet_s
 	int rtos_detected = 0;
 	uint64_t addr = 0;
 	size_t reply_len;
-	char reply[GDB_BUFFER_SIZE + 1], cur_sym[GDB_BUFFER_SIZE / 2 + 1] = ""; /* Extra byte for null-termination */
+	char reply[GDB_BUFFER_SIZE + 1], *cur_sym = NULL;
 	struct symbol_table_elem *next_sym = NULL;
 	struct target *target = get_target_from_connection(connection);
 	struct rtos *os = target->rtos;
@@ -241,8 +241,17 @@ int rtos_qsymbol(struct connection *connection, char const *packet, int packet_s
 	if (!os)
 		goto done;
 
-	/* Decode any symbol name in the packet*/
-	size_t len = unhexify((uint8_t *)cur_sym, strchr(packet + 8, ':') + 1, strlen(strchr(packet + 8, ':') + 1));
+	/* Decode any symbol name in the packet. Packets can be larger than
+	 * GDB_BUFFER_SIZE, so size the buffer after the hex string. */
+	const char *hex_sym = strchr(packet + 8, ':');
+	hex_sym = hex_sym ? hex_sym + 1 : "";
+	size_t hex_len = strlen(hex_sym);
+	cur_sym = malloc(hex_len / 2 + 1); /* Extra byte for null-termination */
+	if (!cur_sym) {
+		LOG_ERROR("Out of memory");
+		goto done;
+	}
+	size_t len = unhexify((uint8_t *)cur_sym, hex_sym, hex_len / 2);
 	cur_sym[len] = 0;
 
 	if ((strcmp(packet, "qSymbol::") != 0) &&               /* GDB is not offering symbol lookup for the first time */
@@ -295,6 +304,7 @@ int rtos_qsymbol(struct connection *connection, char const *packet, int packet_s
 		sizeof(reply) - reply_len);
 
 done:
+	free(cur_sym);
 	gdb_put_packet(connection, reply, reply_len);
 	return rtos_detected;
 }
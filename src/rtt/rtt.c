@@ -45,11 +45,20 @@ static struct {
 	bool changed;
 	/** Whether the control block was found. */
 	bool found_cb;
+	/** Address where the control block is expected, e.g. from the ELF file. */
+	target_addr_t hint_addr;
+	/** Whether hint_addr is valid. */
+	bool hint_valid;
 
 	struct rtt_sink_list **sink_list;
 	size_t sink_list_length;
 
+	/** Polling interval while no data is received, in milliseconds. */
 	unsigned int polling_interval;
+	/** Polling interval while data is received, in milliseconds. */
+	unsigned int min_polling_interval;
+	/** Polling interval the read callback is currently registered with. */
+	unsigned int current_interval;
 } rtt;
 
 int rtt_init(void)
@@ -65,6 +74,7 @@ int rtt_init(void)
 	rtt.started = false;
 
 	rtt.polling_interval = 100;
+	rtt.min_polling_interval = 10;
 
 	return ERROR_OK;
 }
@@ -76,19 +86,47 @@ int rtt_exit(void)
 	return ERROR_OK;
 }
 
+static int read_channel_callback(void *user_data);
+
+static void set_current_interval(unsigned int interval)
+{
+	if (interval == rtt.current_interval)
+		return;
+
+	target_unregister_timer_callback(&read_channel_callback, NULL);
+	target_register_timer_callback(&read_channel_callback, interval,
+		TARGET_TIMER_TYPE_PERIODIC, NULL);
+	rtt.current_interval = interval;
+}
+
 static int read_channel_callback(void *user_data)
 {
 	int ret;
+	size_t received;
+	unsigned int interval;
 
 	ret = rtt.source.read(rtt.target, &rtt.ctrl, rtt.sink_list,
-		rtt.sink_list_length, NULL);
+		rtt.sink_list_length, &received, NULL);
 
 	if (ret != ERROR_OK) {
 		target_unregister_timer_callback(&read_channel_callback, NULL);
+		rtt.current_interval = 0;
 		rtt.source.stop(rtt.target, NULL);
 		return ret;
 	}
 
+	/*
+	 * Halve the interval as long as data arrives so that the up-channel
+	 * buffers do not overflow, and double it while the channels are idle
+	 * to save adapter bandwidth.
+	 */
+	if (received)
+		interval = MAX(rtt.current_interval / 2, rtt.min_polling_interval);
+	else
+		interval = MIN(rtt.current_interval * 2, rtt.polling_interval);
+
+	set_current_interval(interval);
+
 	return ERROR_OK;
 }
 
@@ -110,6 +148,26 @@ int rtt_setup(target_addr_t address, size_t size, const char *id)
 	return ERROR_OK;
 }
 
+void rtt_set_hint(target_addr_t address)
+{
+	rtt.hint_addr = address;
+	rtt.hint_valid = true;
+}
+
+/* Check whether the control block with the configured ID is at address. */
+static bool control_block_at(target_addr_t address)
+{
+	struct rtt_control ctrl;
+
+	if (address < rtt.addr || address - rtt.addr >= rtt.size)
+		return false;
+
+	if (rtt.source.read_cb(rtt.target, address, &ctrl, NULL) != ERROR_OK)
+		return false;
+
+	return !strcmp(ctrl.id, rtt.id);
+}
+
 int rtt_register_source(const struct rtt_source source,
 		struct target *target)
 {
@@ -137,8 +195,21 @@ int rtt_start(void)
 		return ERROR_OK;
 
 	if (!rtt.found_cb || rtt.changed) {
-		rtt.source.find_cb(rtt.target, &addr, rtt.size, rtt.id,
-			&rtt.found_cb, NULL);
+		/*
+		 * Try the address from the symbol table and the address the
+		 * control block was found at before scanning the whole search
+		 * area.
+		 */
+		if (rtt.hint_valid && control_block_at(rtt.hint_addr)) {
+			addr = rtt.hint_addr;
+			rtt.found_cb = true;
+		} else if (rtt.ctrl.address && control_block_at(rtt.ctrl.address)) {
+			addr = rtt.ctrl.address;
+			rtt.found_cb = true;
+		} else {
+			rtt.source.find_cb(rtt.target, &addr, rtt.size, rtt.id,
+				&rtt.found_cb, NULL);
+		}
 
 		rtt.changed = false;
 
@@ -162,8 +233,7 @@ int rtt_start(void)
 	if (ret != ERROR_OK)
 		return ret;
 
-	target_register_timer_callback(&read_channel_callback,
-		rtt.polling_interval, 1, NULL);
+	set_current_interval(rtt.min_polling_interval);
 	rtt.started = true;
 
 	return ERROR_OK;
@@ -179,6 +249,7 @@ int rtt_stop(void)
 	}
 
 	target_unregister_timer_callback(&read_channel_callback, NULL);
+	rtt.current_interval = 0;
 	rtt.started = false;
 
 	ret = rtt.source.stop(rtt.target, NULL);
@@ -266,28 +337,29 @@ int rtt_unregister_sink(unsigned int channel_index, rtt_sink_read read,
 	return ERROR_OK;
 }
 
-int rtt_get_polling_interval(unsigned int *interval)
+int rtt_get_polling_interval(unsigned int *interval,
+		unsigned int *min_interval)
 {
-	if (!interval)
+	if (!interval || !min_interval)
 		return ERROR_FAIL;
 
 	*interval = rtt.polling_interval;
+	*min_interval = rtt.min_polling_interval;
 
 	return ERROR_OK;
 }
 
-int rtt_set_polling_interval(unsigned int interval)
+int rtt_set_polling_interval(unsigned int interval, unsigned int min_interval)
 {
-	if (!interval)
+	if (!interval || !min_interval || min_interval > interval)
 		return ERROR_FAIL;
 
-	if (rtt.polling_interval != interval) {
-		target_unregister_timer_callback(&read_channel_callback, NULL);
-		target_register_timer_callback(&read_channel_callback, interval, 1,
-			NULL);
-	}
-
 	rtt.polling_interval = interval;
+	rtt.min_polling_interval = min_interval;
+
+	if (rtt.started)
+		set_current_interval(MIN(MAX(rtt.current_interval, min_interval),
+			interval));
 
 	return ERROR_OK;
 }
@@ -121,7 +121,7 @@ typedef int (*rtt_source_start)(struct target *target,
 typedef int (*rtt_source_stop)(struct target *target, void *user_data);
 typedef int (*rtt_source_read)(struct target *target,
 		const struct rtt_control *ctrl, struct rtt_sink_list **sinks,
-		size_t num_channels, void *user_data);
+		size_t num_channels, size_t *received, void *user_data);
 typedef int (*rtt_source_write)(struct target *target,
 		struct rtt_control *ctrl, unsigned int channel,
 		const uint8_t *buffer, size_t *length, void *user_data);
@@ -173,6 +173,16 @@ int rtt_register_source(const struct rtt_source source,
  */
 int rtt_setup(target_addr_t address, size_t size, const char *id);
 
+/**
+ * Set the address where the control block is expected.
+ *
+ * The address is checked for the control block before the search area is
+ * scanned.
+ *
+ * @param[in] address Expected address of the control block.
+ */
+void rtt_set_hint(target_addr_t address);
+
 /**
  * Start Real-Time Transfer (RTT).
  *
@@ -190,20 +200,31 @@ int rtt_stop(void);
 /**
  * Get the polling interval.
  *
- * @param[out] interval Polling interval in milliseconds.
+ * @param[out] interval Polling interval in milliseconds while the up-channels
+ *                      are idle.
+ * @param[out] min_interval Polling interval in milliseconds while data is
+ *                          received.
  *
  * @returns ERROR_OK on success, an error code on failure.
  */
-int rtt_get_polling_interval(unsigned int *interval);
+int rtt_get_polling_interval(unsigned int *interval,
+		unsigned int *min_interval);
 
 /**
  * Set the polling interval.
  *
- * @param[in] interval Polling interval in milliseconds.
+ * The interval is halved after every poll that received data, down to
+ * @p min_interval, and doubled after every poll that did not, up to
+ * @p interval.
+ *
+ * @param[in] interval Polling interval in milliseconds while the up-channels
+ *                     are idle.
+ * @param[in] min_interval Polling interval in milliseconds while data is
+ *                         received. Must not be larger than @p interval.
  *
  * @returns ERROR_OK on success, an error code on failure.
  */
-int rtt_set_polling_interval(unsigned int interval);
+int rtt_set_polling_interval(unsigned int interval, unsigned int min_interval);
 
 /**
  * Get whether RTT is started.
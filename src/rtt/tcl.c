@@ -16,6 +16,7 @@
  */
 
 #include <helper/log.h>
+#include <target/image.h>
 #include <target/rtt.h>
 
 #include "rtt.h"
@@ -51,6 +52,39 @@ struct rtt_source source;
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_rtt_symbol_command)
+{
+	struct image image;
+	target_addr_t address;
+	const char *symbol = "_SEGGER_RTT";
+	int ret;
+
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 2)
+		symbol = CMD_ARGV[1];
+
+	ret = image_open(&image, CMD_ARGV[0], "elf");
+
+	if (ret != ERROR_OK)
+		return ret;
+
+	ret = image_find_symbol(&image, symbol, &address);
+	image_close(&image);
+
+	if (ret != ERROR_OK) {
+		command_print(CMD, "rtt: Symbol '%s' not found", symbol);
+		return ERROR_FAIL;
+	}
+
+	rtt_set_hint(address);
+	command_print(CMD, "rtt: Control block expected at 0x%" TARGET_PRIxADDR,
+		address);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_rtt_start_command)
 {
 	if (CMD_ARGC > 0)
@@ -77,21 +111,32 @@ COMMAND_HANDLER(handle_rtt_polling_interval_command)
 	if (CMD_ARGC == 0) {
 		int ret;
 		unsigned int interval;
+		unsigned int min_interval;
 
-		ret = rtt_get_polling_interval(&interval);
+		ret = rtt_get_polling_interval(&interval, &min_interval);
 
 		if (ret != ERROR_OK) {
 			command_print(CMD, "Failed to get polling interval");
 			return ret;
 		}
 
-		command_print(CMD, "%u ms", interval);
-	} else if (CMD_ARGC == 1) {
+		if (min_interval == interval)
+			command_print(CMD, "%u ms", interval);
+		else
+			command_print(CMD, "%u ms, %u ms while data is received",
+				interval, min_interval);
+	} else if (CMD_ARGC <= 2) {
 		int ret;
 		unsigned int interval;
+		unsigned int min_interval;
 
 		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], interval);
-		ret = rtt_set_polling_interval(interval);
+		min_interval = interval;
+
+		if (CMD_ARGC == 2)
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], min_interval);
+
+		ret = rtt_set_polling_interval(interval, min_interval);
 
 		if (ret != ERROR_OK) {
 			command_print(CMD, "Failed to set polling interval");
@@ -261,6 +306,13 @@ static const struct command_registration rtt_subcommand_handlers[] = {
 		.help = "setup RTT",
 		.usage = "<address> <size> <ID>"
 	},
+	{
+		.name = "symbol",
+		.handler = handle_rtt_symbol_command,
+		.mode = COMMAND_ANY,
+		.help = "take the control block address from an ELF file",
+		.usage = "<filename> [symbol]"
+	},
 	{
 		.name = "start",
 		.handler = handle_rtt_start_command,
@@ -280,7 +332,7 @@ static const struct command_registration rtt_subcommand_handlers[] = {
 		.handler = handle_rtt_polling_interval_command,
 		.mode = COMMAND_EXEC,
 		.help = "show or set polling interval in ms",
-		.usage = "[interval]"
+		.usage = "[interval [min_interval]]"
 	},
 	{
 		.name = "channels",
@@ -48,6 +48,7 @@
 #include <flash/nor/core.h>
 #include "gdb_server.h"
 #include <target/image.h>
+#include <target/memcache.h>
 #include <jtag/jtag.h>
 #include "rtos/rtos.h"
 #include "target/smp.h"
@@ -97,6 +98,10 @@ struct gdb_connection {
 	struct target_desc_format target_desc;
 	/* temporarily used for thread list support */
 	char *thread_list;
+	/* received packets are unescaped in place into this buffer, binary
+	 * payloads (X, vFlashWrite) are handed on from here without copying */
+	char *packet_buffer;
+	unsigned int packet_buffer_size;
 };
 
 #if 0
@@ -142,6 +147,9 @@ static int gdb_report_register_access_error;
 /* enabled by default */
 static int gdb_use_target_description = 1;
 
+/* maximum packet size advertised to gdb in the qSupported reply */
+static unsigned int gdb_packet_size = GDB_PACKET_SIZE_DEFAULT;
+
 /* current processing free-run type, used by file-I/O */
 static char gdb_running_type;
 
@@ -935,6 +943,17 @@ static int gdb_new_connection(struct connection *connection)
 	int retval;
 	int initial_ack;
 
+	if (!gdb_connection)
+		return ERROR_FAIL;
+
+	/* Extra byte for null-termination */
+	gdb_connection->packet_buffer = malloc(gdb_packet_size + 1);
+	if (!gdb_connection->packet_buffer) {
+		free(gdb_connection);
+		return ERROR_FAIL;
+	}
+	gdb_connection->packet_buffer_size = gdb_packet_size;
+
 	target = get_target_from_connection(connection);
 	connection->priv = gdb_connection;
 	connection->cmd_ctx->current_target = target;
@@ -1067,6 +1086,7 @@ static int gdb_connection_closed(struct connection *connection)
 	/* if this connection registered a debug-message receiver delete it */
 	delete_debug_msg_receiver(connection->cmd_ctx, target);
 
+	free(gdb_connection->packet_buffer);
 	free(connection->priv);
 	connection->priv = NULL;
 
@@ -1202,6 +1222,17 @@ static int gdb_get_registers_packet(struct connection *connection,
 
 	reg_packet_p = reg_packet;
 
+	/* let the target read whatever is missing in one go, rather than
+	 * register by register below */
+	for (i = 0; i < reg_list_size; i++) {
+		if (reg_list[i] == NULL || reg_list[i]->exist == false || reg_list[i]->hidden)
+			continue;
+		if (!reg_list[i]->valid) {
+			target_fetch_registers(target);
+			break;
+		}
+	}
+
 	for (i = 0; i < reg_list_size; i++) {
 		if (reg_list[i] == NULL || reg_list[i]->exist == false || reg_list[i]->hidden)
 			continue;
@@ -1462,7 +1493,7 @@ static int gdb_read_memory_packet(struct connection *connection,
 
 	LOG_DEBUG("addr: 0x%16.16" PRIx64 ", len: 0x%8.8" PRIx32 "", addr, len);
 
-	retval = target_read_buffer(target, addr, len, buffer);
+	retval = memcache_read_buffer(target, addr, len, buffer);
 
 	if ((retval != ERROR_OK) && !gdb_report_data_abort) {
 		/* TODO : Here we have to lie and send back all zero's lest stack traces won't work.
@@ -2628,7 +2659,7 @@ static int gdb_query_packet(struct connection *connection,
 			&pos,
 			&size,
 			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;qXfer:threads:read+;QStartNoAckMode+;vContSupported+",
-			GDB_BUFFER_SIZE,
+			gdb_connection->packet_buffer_size,
 			((gdb_use_memory_map == 1) && (flash_get_bank_count() > 0)) ? '+' : '-',
 			(gdb_target_desc_supported == 1) ? '+' : '-');
 
@@ -3099,7 +3130,13 @@ static int gdb_v_packet(struct connection *connection,
 		/* create a new image if there isn't already one */
 		if (gdb_connection->vflash_image == NULL) {
 			gdb_connection->vflash_image = malloc(sizeof(struct image));
-			image_open(gdb_connection->vflash_image, "", "build");
+			if (!gdb_connection->vflash_image
+					|| image_open(gdb_connection->vflash_image, "", "build") != ERROR_OK) {
+				free(gdb_connection->vflash_image);
+				gdb_connection->vflash_image = NULL;
+				gdb_send_error(connection, ENOMEM);
+				return ERROR_OK;
+			}
 		}
 
 		/* create new section with content from packet buffer */
@@ -3227,14 +3264,12 @@ static void gdb_sig_halted(struct connection *connection)
 
 static int gdb_input_inner(struct connection *connection)
 {
-	/* Do not allocate this on the stack */
-	static char gdb_packet_buffer[GDB_BUFFER_SIZE + 1]; /* Extra byte for null-termination */
-
 	struct target *target;
-	char const *packet = gdb_packet_buffer;
 	int packet_size;
 	int retval;
 	struct gdb_connection *gdb_con = connection->priv;
+	char *gdb_packet_buffer = gdb_con->packet_buffer;
+	char const *packet = gdb_packet_buffer;
 	static bool warn_use_ext;
 
 	target = get_target_from_connection(connection);
@@ -3251,7 +3286,7 @@ static int gdb_input_inner(struct connection *connection)
 	 * drain the rest of the buffer.
 	 */
 	do {
-		packet_size = GDB_BUFFER_SIZE;
+		packet_size = gdb_con->packet_buffer_size;
 		retval = gdb_get_packet(connection, gdb_packet_buffer, &packet_size);
 		if (retval != ERROR_OK)
 			return retval;
@@ -3660,6 +3695,30 @@ COMMAND_HANDLER(handle_gdb_report_register_access_error)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_gdb_packet_size_command)
+{
+	unsigned int size;
+
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "%u", gdb_packet_size);
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+
+	if (size < GDB_BUFFER_SIZE || size > GDB_PACKET_SIZE_MAX) {
+		command_print(CMD, "packet size must be between %d and %d bytes",
+				GDB_BUFFER_SIZE, GDB_PACKET_SIZE_MAX);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	gdb_packet_size = size;
+	return ERROR_OK;
+}
+
 /* gdb_breakpoint_override */
 COMMAND_HANDLER(handle_gdb_breakpoint_override_command)
 {
@@ -3788,6 +3847,13 @@ static const struct command_registration gdb_command_handlers[] = {
 		.help = "enable or disable reporting register access errors",
 		.usage = "('enable'|'disable')"
 	},
+	{
+		.name = "gdb_packet_size",
+		.handler = handle_gdb_packet_size_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set the maximum packet size advertised to gdb",
+		.usage = "[size]"
+	},
 	{
 		.name = "gdb_breakpoint_override",
 		.handler = handle_gdb_breakpoint_override_command,
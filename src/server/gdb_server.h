@@ -33,6 +33,8 @@ struct reg;
 #include <target/target.h>
 
 #define GDB_BUFFER_SIZE 16384
+#define GDB_PACKET_SIZE_DEFAULT (64 * 1024)
+#define GDB_PACKET_SIZE_MAX (1024 * 1024)
 
 int gdb_target_add_all(struct target *target);
 int gdb_register_commands(struct command_context *command_context);
@@ -33,6 +33,7 @@
 #include "openocd.h"
 #include "tcl_server.h"
 #include "telnet_server.h"
+#include <helper/time_support.h>
 
 #include <signal.h>
 
@@ -44,8 +45,20 @@
 #include <netinet/tcp.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 static struct service *services;
 
+#ifdef HAVE_SYS_EPOLL_H
+/* epoll instance watching all service and connection fds, -1 to use select() */
+static int epoll_fd = -1;
+#endif
+
+/* self pipe used by server_wakeup(), -1 if not available */
+static int wakeup_fds[2] = { -1, -1 };
+
 enum shutdown_reason {
 	CONTINUE_MAIN_LOOP,			/* stay in main event loop */
 	SHUTDOWN_REQUESTED,			/* set by shutdown command; exit the event loop and quit the debugger */
@@ -63,6 +76,48 @@ static int polling_period = 100;
 /* address by name on which to listen for incoming TCP/IP connections */
 static char *bindto_name;
 
+#ifdef HAVE_SYS_EPOLL_H
+static void server_stop_epoll(void)
+{
+	if (epoll_fd != -1) {
+		close(epoll_fd);
+		epoll_fd = -1;
+	}
+}
+#endif
+
+/* start watching fd for input in server_loop() */
+static void server_watch_fd(int fd)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	if (epoll_fd == -1 || fd < 0)
+		return;
+
+	struct epoll_event event = {
+		.events = EPOLLIN,
+		.data.fd = fd,
+	};
+
+	/* Ready fds are handed on in an fd_set. Also, fds which epoll can not
+	 * watch, like stdin redirected from a file, are always ready for
+	 * select() but rejected by epoll; use select() for everything then. */
+	if (fd >= FD_SETSIZE || (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0 &&
+			errno != EEXIST)) {
+		LOG_DEBUG("cannot watch fd %d with epoll, falling back to select()", fd);
+		server_stop_epoll();
+	}
+#endif
+}
+
+/* stop watching fd, must be called before fd is closed or handed on */
+static void server_unwatch_fd(int fd)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	if (epoll_fd != -1 && fd >= 0)
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+}
+
 static int add_connection(struct service *service, struct command_context *cmd_ctx)
 {
 	socklen_t address_size;
@@ -106,6 +161,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 			free(c);
 			return retval;
 		}
+		server_watch_fd(c->fd);
 	} else if (service->type == CONNECTION_STDINOUT) {
 		c->fd = service->fd;
 		c->fd_out = fileno(stdout);
@@ -171,11 +227,15 @@ static int remove_connection(struct service *service, struct connection *connect
 	while ((c = *p)) {
 		if (c->fd == connection->fd) {
 			service->connection_closed(c);
-			if (service->type == CONNECTION_TCP)
+			if (service->type == CONNECTION_TCP) {
+				server_unwatch_fd(c->fd);
 				close_socket(c->fd);
-			else if (service->type == CONNECTION_PIPE) {
+			} else if (service->type == CONNECTION_PIPE) {
 				/* The service will listen to the pipe again */
 				c->service->fd = c->fd;
+			} else {
+				/* stdin is not listened to again */
+				server_unwatch_fd(c->fd);
 			}
 
 			command_done(c->cmd_ctx);
@@ -341,6 +401,8 @@ int add_service(char *name,
 #endif
 	}
 
+	server_watch_fd(c->fd);
+
 	/* add to the end of linked list */
 	for (p = &services; *p; p = &(*p)->next)
 		;
@@ -380,8 +442,10 @@ int remove_service(const char *name, const char *port)
 			else
 				prev->next = tmp->next;
 
-			if (tmp->type != CONNECTION_STDINOUT)
+			if (tmp->type != CONNECTION_STDINOUT) {
+				server_unwatch_fd(tmp->fd);
 				close_socket(tmp->fd);
+			}
 
 			free(tmp->priv);
 			free_service(tmp);
@@ -406,8 +470,10 @@ static int remove_services(void)
 		free(c->name);
 
 		if (c->type == CONNECTION_PIPE) {
-			if (c->fd != -1)
+			if (c->fd != -1) {
+				server_unwatch_fd(c->fd);
 				close(c->fd);
+			}
 		}
 		free(c->port);
 		free(c->priv);
@@ -423,6 +489,87 @@ static int remove_services(void)
 	return ERROR_OK;
 }
 
+/* Fill read_fds with the fds that have input, waiting up to timeout_ms.
+ * Returns the number of ready fds, 0 on timeout or -1 on error. */
+static int server_wait(fd_set *read_fds, int timeout_ms)
+{
+	int retval;
+
+	FD_ZERO(read_fds);
+
+#ifdef HAVE_SYS_EPOLL_H
+	if (epoll_fd != -1) {
+		struct epoll_event events[16];
+
+		retval = epoll_wait(epoll_fd, events, ARRAY_SIZE(events), timeout_ms);
+		for (int i = 0; i < retval; i++)
+			FD_SET(events[i].data.fd, read_fds);
+
+		return retval;
+	}
+#endif
+
+	int fd_max = 0;
+	struct service *service;
+
+	/* add service and connection fds to read_fds */
+	for (service = services; service; service = service->next) {
+		if (service->fd != -1) {
+			/* listen for new connections */
+			FD_SET(service->fd, read_fds);
+
+			if (service->fd > fd_max)
+				fd_max = service->fd;
+		}
+
+		if (service->connections) {
+			struct connection *c;
+
+			for (c = service->connections; c; c = c->next) {
+				/* check for activity on the connection */
+				FD_SET(c->fd, read_fds);
+				if (c->fd > fd_max)
+					fd_max = c->fd;
+			}
+		}
+	}
+
+	if (wakeup_fds[0] != -1) {
+		FD_SET(wakeup_fds[0], read_fds);
+		if (wakeup_fds[0] > fd_max)
+			fd_max = wakeup_fds[0];
+	}
+
+	struct timeval tv;
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	retval = socket_select(fd_max + 1, read_fds, NULL, NULL, &tv);
+
+#ifdef _WIN32
+	if (retval == -1)
+		errno = WSAGetLastError();
+#endif
+
+	return retval;
+}
+
+/**
+ * Make server_loop() return from waiting for input right away, e.g. to
+ * handle data collected by a driver thread. Safe to call from any thread
+ * and from signal handlers.
+ */
+void server_wakeup(void)
+{
+#ifndef _WIN32
+	if (wakeup_fds[1] != -1) {
+		char c = 0;
+		/* a full pipe means a wakeup is pending already */
+		if (write(wakeup_fds[1], &c, 1) < 0)
+			return;
+	}
+#endif
+}
+
 int server_loop(struct command_context *command_context)
 {
 	struct service *service;
@@ -431,7 +578,6 @@ int server_loop(struct command_context *command_context)
 
 	/* used in select() */
 	fd_set read_fds;
-	int fd_max;
 
 	/* used in accept() */
 	int retval;
@@ -442,69 +588,48 @@ int server_loop(struct command_context *command_context)
 #endif
 
 	while (shutdown_openocd == CONTINUE_MAIN_LOOP) {
-		/* monitor sockets for activity */
-		fd_max = 0;
-		FD_ZERO(&read_fds);
-
-		/* add service and connection fds to read_fds */
-		for (service = services; service; service = service->next) {
-			if (service->fd != -1) {
-				/* listen for new connections */
-				FD_SET(service->fd, &read_fds);
-
-				if (service->fd > fd_max)
-					fd_max = service->fd;
-			}
-
-			if (service->connections) {
-				struct connection *c;
-
-				for (c = service->connections; c; c = c->next) {
-					/* check for activity on the connection */
-					FD_SET(c->fd, &read_fds);
-					if (c->fd > fd_max)
-						fd_max = c->fd;
-				}
-			}
-		}
-
-		struct timeval tv;
-		tv.tv_sec = 0;
 		if (poll_ok) {
 			/* we're just polling this iteration, this is faster on embedded
 			 * hosts */
-			tv.tv_usec = 0;
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+			retval = server_wait(&read_fds, 0);
 		} else {
-			/* Every 100ms, can be changed with "poll_period" command */
-			tv.tv_usec = polling_period * 1000;
+			/* Sleep until the next target timer is due, but at most
+			 * polling_period ms, which can be changed with "poll_period" */
+			int64_t timeout_ms = target_timer_next_event() - timeval_ms();
+			if (timeout_ms < 0)
+				timeout_ms = 0;
+			else if (timeout_ms > polling_period)
+				timeout_ms = polling_period;
+
 			/* Only while we're sleeping we'll let others run */
 			openocd_sleep_prelude();
 			kept_alive();
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+			log_flush();
+			retval = server_wait(&read_fds, timeout_ms);
 			openocd_sleep_postlude();
 		}
 
 		if (retval == -1) {
 #ifdef _WIN32
-
-			errno = WSAGetLastError();
-
-			if (errno == WSAEINTR)
-				FD_ZERO(&read_fds);
-			else {
-				LOG_ERROR("error during select: %s", strerror(errno));
-				return ERROR_FAIL;
-			}
+			if (errno == WSAEINTR) {
 #else
-
-			if (errno == EINTR)
+			if (errno == EINTR) {
+#endif
 				FD_ZERO(&read_fds);
-			else {
-				LOG_ERROR("error during select: %s", strerror(errno));
+			} else {
+				LOG_ERROR("error waiting for input: %s", strerror(errno));
 				return ERROR_FAIL;
 			}
-#endif
+		}
+
+		if (retval > 0 && wakeup_fds[0] != -1 && FD_ISSET(wakeup_fds[0], &read_fds)) {
+			/* drain the wakeup pipe, the wakeup itself counts as idle so
+			 * that timer callbacks run right away */
+			char buf[64];
+			while (read(wakeup_fds[0], buf, sizeof(buf)) > 0)
+				;
+			FD_CLR(wakeup_fds[0], &read_fds);
+			retval--;
 		}
 
 		if (retval == 0) {
@@ -601,6 +726,7 @@ static void sig_handler(int sig)
 	if (shutdown_openocd == CONTINUE_MAIN_LOOP) {
 		shutdown_openocd = SHUTDOWN_WITH_SIGNAL_CODE;
 		last_signal = sig;
+		server_wakeup();
 		LOG_DEBUG("Terminating on Signal %d", sig);
 	} else
 		LOG_DEBUG("Ignored extra Signal %d", sig);
@@ -671,6 +797,22 @@ int server_preinit(void)
 	signal(SIGTERM, sig_handler);
 	signal(SIGABRT, sig_handler);
 
+#ifdef HAVE_SYS_EPOLL_H
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1)
+		LOG_DEBUG("epoll not available, using select(): %s", strerror(errno));
+#endif
+
+#ifndef _WIN32
+	if (pipe(wakeup_fds) == 0) {
+		socket_nonblock(wakeup_fds[0]);
+		socket_nonblock(wakeup_fds[1]);
+		server_watch_fd(wakeup_fds[0]);
+	} else {
+		wakeup_fds[0] = wakeup_fds[1] = -1;
+	}
+#endif
+
 	return ERROR_OK;
 }
 
@@ -696,6 +838,17 @@ int server_quit(void)
 	remove_services();
 	target_quit();
 
+#ifdef HAVE_SYS_EPOLL_H
+	server_stop_epoll();
+#endif
+#ifndef _WIN32
+	if (wakeup_fds[0] != -1) {
+		close(wakeup_fds[0]);
+		close(wakeup_fds[1]);
+		wakeup_fds[0] = wakeup_fds[1] = -1;
+	}
+#endif
+
 #ifdef _WIN32
 	SetConsoleCtrlHandler(ControlHandler, FALSE);
 
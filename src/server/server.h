@@ -90,6 +90,7 @@ void server_free(void);
 void exit_on_signal(int sig);
 
 int server_loop(struct command_context *command_context);
+void server_wakeup(void);
 
 int server_register_commands(struct command_context *context);
 
@@ -206,7 +206,7 @@ struct svf_check_tdo_para {
 	int bit_len;		/* bit length to check */
 };
 
-#define SVF_CHECK_TDO_PARA_SIZE 1024
+#define SVF_CHECK_TDO_PARA_SIZE 8192
 static struct svf_check_tdo_para *svf_check_tdo_para;
 static int svf_check_tdo_para_index;
 
@@ -214,6 +214,7 @@ static int svf_read_command_from_file(FILE *fd);
 static int svf_check_tdo(void);
 static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len);
 static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str);
+static int svf_execute_queue(void);
 static int svf_execute_tap(void);
 
 static FILE *svf_fd;
@@ -235,6 +236,13 @@ static int svf_ignore_error;
 static int svf_tap_is_specified;
 static int svf_set_padding(struct svf_xxr_para *para, int len, unsigned char tdi);
 
+/* Throughput report */
+static struct {
+	unsigned int batches;
+	uint64_t scan_bits;
+	int64_t execute_ms;
+} svf_stats;
+
 /* Progress Indicator */
 static int svf_progress_enabled;
 static long svf_total_lines;
@@ -256,6 +264,10 @@ static void svf_hexbuf_print(int dbg_lvl, const char *file, unsigned line,
 	int byte_len = DIV_ROUND_UP(bit_len, 8);
 	int msbits = bit_len % 8;
 
+	/* long vectors are expensive to format, don't when nothing is logged */
+	if (dbg_lvl > debug_level)
+		return;
+
 	/* allocate 2 bytes per hex digit */
 	char *prbuf = malloc((byte_len * 2) + 2 + 1);
 	if (!prbuf)
@@ -413,6 +425,7 @@ COMMAND_HANDLER(handle_svf_command)
 	/* init */
 	svf_line_number = 0;
 	svf_command_buffer_size = 0;
+	memset(&svf_stats, 0, sizeof(svf_stats));
 
 	svf_check_tdo_para_index = 0;
 	svf_check_tdo_para = malloc(sizeof(struct svf_check_tdo_para) * SVF_CHECK_TDO_PARA_SIZE);
@@ -517,13 +530,22 @@ COMMAND_HANDLER(handle_svf_command)
 		command_num++;
 	}
 
-	if ((!svf_nil) && (ERROR_OK != jtag_execute_queue()))
+	if (ERROR_OK != svf_execute_queue())
 		ret = ERROR_FAIL;
 	else if (ERROR_OK != svf_check_tdo())
 		ret = ERROR_FAIL;
 
 	/* print time */
 	time_measure_ms = timeval_ms() - time_measure_ms;
+	if (!svf_nil) {
+		command_print(CMD, "%" PRIu64 " bits scanned in %u batches, "
+			"%" PRId64 " ms waiting for the adapter, %" PRId64 " ms host time",
+			svf_stats.scan_bits, svf_stats.batches, svf_stats.execute_ms,
+			time_measure_ms - svf_stats.execute_ms);
+		if (time_measure_ms > 0)
+			command_print(CMD, "throughput: %" PRIu64 " kbit/s",
+				svf_stats.scan_bits / time_measure_ms);
+	}
 	time_measure_s = time_measure_ms / 1000;
 	time_measure_ms %= 1000;
 	time_measure_m = time_measure_s / 60;
@@ -583,8 +605,8 @@ free_all:
 
 static int svf_getline(char **lineptr, size_t *n, FILE *stream)
 {
-#define MIN_CHUNK 16	/* Buffer is increased by this size each time as required */
-	size_t i = 0;
+#define MIN_CHUNK 128	/* Initial buffer size, doubled each time as required */
+	size_t len = 0;
 
 	if (*lineptr == NULL) {
 		*n = MIN_CHUNK;
@@ -593,22 +615,29 @@ static int svf_getline(char **lineptr, size_t *n, FILE *stream)
 			return -1;
 	}
 
-	(*lineptr)[0] = fgetc(stream);
-	while ((*lineptr)[i] != '\n') {
-		(*lineptr)[++i] = fgetc(stream);
-		if (feof(stream)) {
-			(*lineptr)[0] = 0;
-			return -1;
+	while (fgets(*lineptr + len, *n - len, stream)) {
+		size_t chunk = strlen(*lineptr + len);
+		if (chunk == 0) {
+			/* fgets() read something, but it starts with a NUL */
+			LOG_ERROR("NUL character in SVF file");
+			break;
 		}
-		if ((i + 2) > *n) {
-			*n += MIN_CHUNK;
-			*lineptr = realloc(*lineptr, *n);
+		len += chunk;
+		if ((*lineptr)[len - 1] == '\n')
+			return len;
+
+		/* the line didn't fit, unless it is the last one without '\n' */
+		if (len + 1 == *n) {
+			char *ptr = realloc(*lineptr, 2 * *n);
+			if (!ptr)
+				break;
+			*lineptr = ptr;
+			*n *= 2;
 		}
 	}
 
-	(*lineptr)[++i] = 0;
-
-	return sizeof(*lineptr);
+	(*lineptr)[0] = 0;
+	return -1;
 }
 
 #define SVFP_CMD_INC_CNT 1024
@@ -672,12 +701,14 @@ static int svf_read_command_from_file(FILE *fd)
 				 *  - terminating NUL ('\0')
 				 */
 				if (cmd_pos + 3 > svf_command_buffer_size) {
-					svf_command_buffer = realloc(svf_command_buffer, cmd_pos + 3);
-					svf_command_buffer_size = cmd_pos + 3;
-					if (svf_command_buffer == NULL) {
+					size_t size = MAX(2 * svf_command_buffer_size, cmd_pos + 3);
+					char *ptr = realloc(svf_command_buffer, size);
+					if (ptr == NULL) {
 						LOG_ERROR("not enough memory");
 						return ERROR_FAIL;
 					}
+					svf_command_buffer = ptr;
+					svf_command_buffer_size = size;
 				}
 
 				/* insert a space before '(' */
@@ -807,16 +838,13 @@ static int svf_copy_hexstring_to_binary(char *str, uint8_t **bin, int orig_bit_l
 			 * a hard limit on line length.
 			 */
 			if (!isspace(ch)) {
-				if ((ch >= '0') && (ch <= '9')) {
-					ch = ch - '0';
-					break;
-				} else if ((ch >= 'A') && (ch <= 'F')) {
-					ch = ch - 'A' + 10;
-					break;
-				} else {
+				int value = hex_digit_value(ch);
+				if (value < 0) {
 					LOG_ERROR("invalid hex string");
 					return ERROR_FAIL;
 				}
+				ch = value;
+				break;
 			}
 
 			ch = 0;
@@ -890,9 +918,22 @@ static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len)
 	return ERROR_OK;
 }
 
+static int svf_execute_queue(void)
+{
+	if (svf_nil)
+		return ERROR_OK;
+
+	int64_t start = timeval_ms();
+	int retval = jtag_execute_queue();
+	svf_stats.execute_ms += timeval_ms() - start;
+	svf_stats.batches++;
+
+	return retval;
+}
+
 static int svf_execute_tap(void)
 {
-	if ((!svf_nil) && (ERROR_OK != jtag_execute_queue()))
+	if (ERROR_OK != svf_execute_queue())
 		return ERROR_FAIL;
 	else if (ERROR_OK != svf_check_tdo())
 		return ERROR_FAIL;
@@ -1040,12 +1081,13 @@ XXR_common:
 			LOG_DEBUG("\tlength = %d", xxr_para_tmp->len);
 			xxr_para_tmp->data_mask = 0;
 			for (i = 2; i < num_of_argu; i += 2) {
-				if ((strlen(argus[i + 1]) < 3) || (argus[i + 1][0] != '(') ||
-				(argus[i + 1][strlen(argus[i + 1]) - 1] != ')')) {
+				size_t data_len = strlen(argus[i + 1]);
+				if ((data_len < 3) || (argus[i + 1][0] != '(') ||
+				(argus[i + 1][data_len - 1] != ')')) {
 					LOG_ERROR("data section error");
 					return ERROR_FAIL;
 				}
-				argus[i + 1][strlen(argus[i + 1]) - 1] = '\0';
+				argus[i + 1][data_len - 1] = '\0';
 				/* TDI, TDO, MASK, SMASK */
 				if (!strcmp(argus[i], "TDI")) {
 					/* TDI */
@@ -1191,6 +1233,7 @@ XXR_common:
 				field.num_bits = i;
 				field.out_value = &svf_tdi_buffer[svf_buffer_index];
 				field.in_value = (xxr_para_tmp->data_mask & XXR_TDO) ? &svf_tdi_buffer[svf_buffer_index] : NULL;
+				svf_stats.scan_bits += field.num_bits;
 				if (!svf_nil) {
 					/* NOTE:  doesn't use SVF-specified state paths */
 					jtag_add_plain_dr_scan(field.num_bits,
@@ -1281,6 +1324,7 @@ XXR_common:
 				field.num_bits = i;
 				field.out_value = &svf_tdi_buffer[svf_buffer_index];
 				field.in_value = (xxr_para_tmp->data_mask & XXR_TDO) ? &svf_tdi_buffer[svf_buffer_index] : NULL;
+				svf_stats.scan_bits += field.num_bits;
 				if (!svf_nil) {
 					/* NOTE:  doesn't use SVF-specified state paths */
 					jtag_add_plain_ir_scan(field.num_bits,
@@ -393,6 +393,68 @@ fail:
 	return retval;
 }
 
+/**
+ * Read every invalid register of the current mode, plus the VFP registers,
+ * inside a single prepare/finish bracket instead of one per register as
+ * arm->read_core_reg() does.  Banked registers of other modes stay lazy,
+ * they need a mode switch each.
+ */
+int arm_dpm_fetch_registers(struct target *target)
+{
+	struct arm *arm = target_to_arm(target);
+	struct arm_dpm *dpm = arm->dpm;
+	struct reg_cache *cache = arm->core_cache;
+	bool todo = false;
+	int retval;
+
+	if (target->state != TARGET_HALTED)
+		return ERROR_TARGET_NOT_HALTED;
+
+	for (unsigned i = 0; i < 16; i++)
+		todo |= !arm_reg_current(arm, i)->valid;
+	for (unsigned i = 0; i < cache->num_regs; i++) {
+		struct arm_reg *arm_reg = cache->reg_list[i].arch_info;
+		if (arm_reg->num >= ARM_VFP_V3_D0 && arm_reg->num <= ARM_VFP_V3_FPSCR)
+			todo |= !cache->reg_list[i].valid;
+	}
+	if (!todo)
+		return ERROR_OK;
+
+	retval = dpm->prepare(dpm);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* R0 and R1 are scratch for PC and VFP reads; read them first and make
+	 * sure they get restored before resuming */
+	for (unsigned i = 0; i < 16; i++) {
+		struct reg *r = arm_reg_current(arm, i);
+		if (!r->valid) {
+			retval = arm_dpm_read_reg(dpm, r, i);
+			if (retval != ERROR_OK)
+				goto fail;
+		}
+		if (i < 2)
+			r->dirty = true;
+	}
+
+	for (unsigned i = 0; i < cache->num_regs; i++) {
+		struct reg *r = cache->reg_list + i;
+		struct arm_reg *arm_reg = r->arch_info;
+
+		if (r->valid || arm_reg->num < ARM_VFP_V3_D0 ||
+				arm_reg->num > ARM_VFP_V3_FPSCR)
+			continue;
+
+		retval = arm_dpm_read_reg(dpm, r, arm_reg->num);
+		if (retval != ERROR_OK)
+			goto fail;
+	}
+
+fail:
+	/* (void) */ dpm->finish(dpm);
+	return retval;
+}
+
 /* Avoid needless I/O ... leave breakpoints and watchpoints alone
  * unless they're removed, or need updating because of single-stepping
  * or running debugger code.
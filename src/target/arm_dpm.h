@@ -154,6 +154,7 @@ int arm_dpm_initialize(struct arm_dpm *dpm);
 
 int arm_dpm_read_reg(struct arm_dpm *dpm, struct reg *r, unsigned regnum);
 int arm_dpm_read_current_registers(struct arm_dpm *dpm);
+int arm_dpm_fetch_registers(struct target *target);
 int arm_dpm_modeswitch(struct arm_dpm *dpm, enum arm_mode mode);
 
 int arm_dpm_write_dirty_registers(struct arm_dpm *dpm, bool bpwp);
@@ -0,0 +1,239 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/**
+ * @file
+ * Decoder for TPIU formatter frames and ITM/DWT trace packets.
+ */
+
+/*
+ * Relevant specifications from ARM include:
+ *
+ * CoreSight(tm) Architecture Specification v3.0                 ARM IHI 0029E
+ * ARMv7-M Architecture Reference Manual                         ARM DDI 0403E
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <helper/bits.h>
+#include <helper/log.h>
+#include "arm_itm.h"
+
+/* trace source ID 0 marks padding, 0x7f is reserved */
+#define ARM_TPIU_ID_NULL			0x00
+#define ARM_TPIU_ID_RESERVED		0x7f
+
+/* full synchronization packet, 0xff 0xff 0xff 0x7f */
+#define ARM_TPIU_FULL_SYNC			0xffffff7f
+
+#define ARM_ITM_OVERFLOW			0x70
+/* last byte of a synchronization packet, after at least 47 zero bits */
+#define ARM_ITM_SYNC_END			0x80
+
+void arm_tpiu_deformatter_init(struct arm_tpiu_deformatter *d,
+		arm_tpiu_stream_cb stream, void *priv)
+{
+	memset(d, 0, sizeof(*d));
+	d->stream = stream;
+	d->priv = priv;
+}
+
+struct arm_tpiu_frame_output {
+	struct arm_tpiu_deformatter *d;
+	uint8_t data[ARM_TPIU_FRAME_SIZE];
+	size_t len;
+};
+
+static void arm_tpiu_flush(struct arm_tpiu_frame_output *out)
+{
+	struct arm_tpiu_deformatter *d = out->d;
+
+	if (out->len && d->id != ARM_TPIU_ID_NULL && d->id != ARM_TPIU_ID_RESERVED)
+		d->stream(d->id, out->data, out->len, d->priv);
+	out->len = 0;
+}
+
+static void arm_tpiu_set_id(struct arm_tpiu_frame_output *out, unsigned int id)
+{
+	if (id == out->d->id)
+		return;
+
+	arm_tpiu_flush(out);
+	out->d->id = id;
+}
+
+static void arm_tpiu_decode_frame(struct arm_tpiu_deformatter *d)
+{
+	struct arm_tpiu_frame_output out = { .d = d };
+	uint8_t aux = d->frame[15];
+
+	/*
+	 * Even bytes hold either a new trace source ID (bit 0 set) or a data
+	 * byte whose bit 0 is stored in the last byte of the frame. Odd bytes
+	 * always hold data. An auxiliary bit set for an ID means that the ID
+	 * only applies from the byte after the next one on.
+	 */
+	for (unsigned int i = 0; i < 8; i++) {
+		uint8_t b = d->frame[2 * i];
+		bool aux_bit = aux & (1 << i);
+		int delayed_id = -1;
+
+		if (b & 1) {
+			if (aux_bit && i < 7)
+				delayed_id = b >> 1;
+			else
+				arm_tpiu_set_id(&out, b >> 1);
+		} else {
+			out.data[out.len++] = (b & 0xfe) | aux_bit;
+		}
+
+		if (i == 7)
+			break;
+
+		out.data[out.len++] = d->frame[2 * i + 1];
+
+		if (delayed_id >= 0)
+			arm_tpiu_set_id(&out, delayed_id);
+	}
+
+	arm_tpiu_flush(&out);
+}
+
+void arm_tpiu_deformat(struct arm_tpiu_deformatter *d, const uint8_t *data,
+		size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		d->sync = (d->sync << 8) | data[i];
+
+		/* synchronization packets are only sent between frames */
+		if (d->sync == ARM_TPIU_FULL_SYNC) {
+			d->frame_len = 0;
+			continue;
+		}
+
+		d->frame[d->frame_len++] = data[i];
+
+		if (d->frame_len == ARM_TPIU_FRAME_SIZE) {
+			arm_tpiu_decode_frame(d);
+			d->frame_len = 0;
+		}
+	}
+}
+
+void arm_itm_decoder_init(struct arm_itm_decoder *d)
+{
+	memset(d, 0, sizeof(*d));
+}
+
+static void arm_itm_source_packet(struct arm_itm_decoder *d)
+{
+	unsigned int address = d->header >> 3;
+
+	if (!(d->header & 0x04)) {
+		if (d->stimulus)
+			d->stimulus(address, d->payload, d->payload_len, d->priv);
+		return;
+	}
+
+	if (d->hardware) {
+		uint32_t value = 0;
+		for (unsigned int i = 0; i < d->payload_len; i++)
+			value |= (uint32_t)d->payload[i] << (8 * i);
+		d->hardware(address, value, d->payload_len, d->priv);
+	}
+}
+
+void arm_itm_decode(struct arm_itm_decoder *d, const uint8_t *data,
+		size_t size)
+{
+	static const unsigned int payload_size[4] = { 0, 1, 2, 4 };
+
+	for (size_t i = 0; i < size; i++) {
+		uint8_t b = data[i];
+
+		if (d->remaining) {
+			d->payload[d->payload_len++] = b;
+			if (!--d->remaining)
+				arm_itm_source_packet(d);
+			continue;
+		}
+
+		if (d->continuation) {
+			d->continuation = b & 0x80;
+			continue;
+		}
+
+		d->header = b;
+
+		if (b & 0x03) {
+			/* software or hardware source packet */
+			d->payload_len = 0;
+			d->remaining = payload_size[b & 0x03];
+		} else if (b == ARM_ITM_OVERFLOW) {
+			d->overflows++;
+			LOG_DEBUG("ITM overflow");
+		} else if (b != 0x00 && b != ARM_ITM_SYNC_END) {
+			/*
+			 * Timestamp and extension packets, their payload ends with
+			 * the first byte that has bit 7 cleared. Synchronization
+			 * packets are skipped.
+			 */
+			d->continuation = b & 0x80;
+		}
+	}
+}
+
+int arm_itm_dwt_format(char *buf, size_t len, unsigned int discriminator,
+		uint32_t value, size_t size)
+{
+	static const char * const counters[] = {
+		"cpi", "exc", "sleep", "lsu", "fold", "cyc"
+	};
+	static const char * const functions[] = {
+		"?", "entered", "exited", "returned"
+	};
+	int n;
+
+	switch (discriminator) {
+	case ARM_ITM_DWT_EVENT_COUNTER:
+		n = snprintf(buf, len, "event");
+		for (unsigned int i = 0; i < ARRAY_SIZE(counters); i++)
+			if (value & BIT(i) && n >= 0 && (size_t)n < len)
+				n += snprintf(buf + n, len - n, " %s", counters[i]);
+		break;
+	case ARM_ITM_DWT_EXCEPTION:
+		n = snprintf(buf, len, "exception %" PRIu32 " %s", value & 0x1ff,
+				functions[(value >> 12) & 3]);
+		break;
+	case ARM_ITM_DWT_PC_SAMPLE:
+		if (size == 4)
+			n = snprintf(buf, len, "pc 0x%08" PRIx32, value);
+		else
+			n = snprintf(buf, len, "pc sleep");
+		break;
+	case 8 ... 15:
+		/* data trace PC value or address offset, comparator in bits 2:1 */
+		n = snprintf(buf, len, "data %s cmp%u 0x%0*" PRIx32,
+				discriminator & 1 ? "addr" : "pc", (discriminator >> 1) & 3,
+				(int)size * 2, value);
+		break;
+	case 16 ... 23:
+		/* data trace data value, bit 0 set for writes */
+		n = snprintf(buf, len, "data %s cmp%u 0x%0*" PRIx32,
+				discriminator & 1 ? "write" : "read", (discriminator >> 1) & 3,
+				(int)size * 2, value);
+		break;
+	default:
+		n = snprintf(buf, len, "hw%u 0x%0*" PRIx32, discriminator,
+				(int)size * 2, value);
+		break;
+	}
+
+	if (n >= 0 && (size_t)n < len)
+		n += snprintf(buf + n, len - n, "\n");
+	return n;
+}
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_ARM_ITM_H
+#define OPENOCD_TARGET_ARM_ITM_H
+
+#include <helper/types.h>
+
+/**
+ * @file
+ * Host side decoding of trace data captured from a TPIU or SWO.
+ *
+ * The TPIU deformatter splits the 16 byte frames produced by the TPIU
+ * formatter into the trace streams of the individual trace sources. The
+ * ITM decoder turns the stream of the ITM trace source into software
+ * (stimulus port) and hardware (DWT) source packets.
+ *
+ * Both work incrementally on arbitrarily sized chunks of input data, so
+ * packets and frames may be split across polls.
+ */
+
+/** TPIU frame size in bytes */
+#define ARM_TPIU_FRAME_SIZE			16
+
+/** Number of ITM stimulus ports */
+#define ARM_ITM_NUM_STIMULUS_PORTS	32
+
+/** DWT hardware source packet discriminators */
+#define ARM_ITM_DWT_EVENT_COUNTER	0
+#define ARM_ITM_DWT_EXCEPTION		1
+#define ARM_ITM_DWT_PC_SAMPLE		2
+
+typedef void (*arm_tpiu_stream_cb)(unsigned int id, const uint8_t *data,
+		size_t size, void *priv);
+
+struct arm_tpiu_deformatter {
+	uint8_t frame[ARM_TPIU_FRAME_SIZE];
+	unsigned int frame_len;
+	/** last four bytes received, to detect full synchronization packets */
+	uint32_t sync;
+	/** trace source ID of the data currently received */
+	unsigned int id;
+	arm_tpiu_stream_cb stream;
+	void *priv;
+};
+
+void arm_tpiu_deformatter_init(struct arm_tpiu_deformatter *d,
+		arm_tpiu_stream_cb stream, void *priv);
+void arm_tpiu_deformat(struct arm_tpiu_deformatter *d, const uint8_t *data,
+		size_t size);
+
+struct arm_itm_decoder {
+	/** header of the packet being received, 0 if none */
+	uint8_t header;
+	/** payload bytes still expected for a source packet */
+	unsigned int remaining;
+	unsigned int payload_len;
+	uint8_t payload[4];
+	/** skipping the continuation bytes of a protocol packet */
+	bool continuation;
+
+	/** called with the payload of each stimulus port packet */
+	void (*stimulus)(unsigned int port, const uint8_t *data, size_t size,
+			void *priv);
+	/** called for each DWT hardware source packet */
+	void (*hardware)(unsigned int discriminator, uint32_t value,
+			size_t size, void *priv);
+	void *priv;
+
+	uint64_t overflows;
+};
+
+void arm_itm_decoder_init(struct arm_itm_decoder *d);
+void arm_itm_decode(struct arm_itm_decoder *d, const uint8_t *data,
+		size_t size);
+
+/**
+ * Formats a DWT hardware source packet as a line of text, e.g.
+ * "pc 0x08000124" or "exception 15 entered", terminated by a newline.
+ * @returns the length of the text, as snprintf()
+ */
+int arm_itm_dwt_format(char *buf, size_t len, unsigned int discriminator,
+		uint32_t value, size_t size);
+
+#endif /* OPENOCD_TARGET_ARM_ITM_H */
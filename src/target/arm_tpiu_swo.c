@@ -30,12 +30,14 @@
 #include <helper/jim-nvp.h>
 #include <helper/list.h>
 #include <helper/log.h>
+#include <helper/time_support.h>
 #include <helper/types.h>
 #include <jtag/interface.h>
 #include <server/server.h>
 #include <target/arm_adi_v5.h>
 #include <target/target.h>
 #include <transport/transport.h>
+#include "arm_itm.h"
 #include "arm_tpiu_swo.h"
 
 /* START_DEPRECATED_TPIU */
@@ -87,6 +89,15 @@ struct arm_tpiu_swo_event_action {
 	struct arm_tpiu_swo_event_action *next;
 };
 
+struct arm_tpiu_swo_output {
+	FILE *file;
+	/** data was written to file since the last flush */
+	bool dirty;
+	int64_t last_flush;
+	/** track TCP connections */
+	struct list_head connections;
+};
+
 struct arm_tpiu_swo_object {
 	struct list_head lh;
 	struct adiv5_mem_ap_spot spot;
@@ -99,7 +110,6 @@ struct arm_tpiu_swo_object {
 	/** Handle to output trace data in INTERNAL capture mode */
 	/** Synchronous output port width */
 	uint32_t port_width;
-	FILE *file;
 	/** output mode */
 	unsigned int pin_protocol;
 	/** Enable formatter */
@@ -110,8 +120,18 @@ struct arm_tpiu_swo_object {
 	unsigned int swo_pin_freq;
 	/** where to dump the captured output trace data */
 	char *out_filename;
-	/** track TCP connections */
-	struct list_head connections;
+	struct arm_tpiu_swo_output output;
+	/** where to write the data of each ITM stimulus port, NULL if unused */
+	char *itm_filename[ARM_ITM_NUM_STIMULUS_PORTS];
+	struct arm_tpiu_swo_output itm_output[ARM_ITM_NUM_STIMULUS_PORTS];
+	/** where to write the decoded DWT hardware source packets, NULL if unused */
+	char *dwt_filename;
+	struct arm_tpiu_swo_output dwt_output;
+	/** whether the captured data is decoded */
+	bool decode;
+	struct arm_tpiu_deformatter deformatter;
+	struct arm_itm_decoder itm;
+	uint8_t *trace_buf;
 	/* START_DEPRECATED_TPIU */
 	bool recheck_ap_cur_target;
 	/* END_DEPRECATED_TPIU */
@@ -123,39 +143,122 @@ struct arm_tpiu_swo_connection {
 };
 
 struct arm_tpiu_swo_priv_connection {
-	struct arm_tpiu_swo_object *obj;
+	struct arm_tpiu_swo_output *output;
 };
 
 static LIST_HEAD(all_tpiu_swo);
 
-#define ARM_TPIU_SWO_TRACE_BUF_SIZE	4096
+#define ARM_TPIU_SWO_TRACE_BUF_SIZE	(64 * 1024)
+/* limit the number of adapter reads per poll to keep the event loop going */
+#define ARM_TPIU_SWO_MAX_READS		16
+/* trace data written to files is flushed at least this often, in ms */
+#define ARM_TPIU_SWO_FLUSH_INTERVAL	100
+/* trace source ID the ITM is configured with, see armv7m trace_bus_id */
+#define ARM_TPIU_SWO_ITM_ID			1
+
+static int arm_tpiu_swo_write(struct arm_tpiu_swo_output *out,
+		const uint8_t *buf, size_t size)
+{
+	struct arm_tpiu_swo_connection *c;
+
+	if (out->file) {
+		if (fwrite(buf, 1, size, out->file) != size) {
+			LOG_ERROR("Error writing to the SWO trace destination file");
+			return ERROR_FAIL;
+		}
+		out->dirty = true;
+	}
+
+	/* closed connections are detected and removed by the server loop */
+	list_for_each_entry(c, &out->connections, lh)
+		connection_write(c->connection, buf, size);
+
+	return ERROR_OK;
+}
+
+static void arm_tpiu_swo_flush(struct arm_tpiu_swo_output *out, int64_t now)
+{
+	if (!out->dirty || now - out->last_flush < ARM_TPIU_SWO_FLUSH_INTERVAL)
+		return;
+
+	fflush(out->file);
+	out->dirty = false;
+	out->last_flush = now;
+}
+
+static void arm_tpiu_swo_itm_stimulus(unsigned int port, const uint8_t *data,
+		size_t size, void *priv)
+{
+	struct arm_tpiu_swo_object *obj = priv;
+
+	if (obj->itm_filename[port])
+		arm_tpiu_swo_write(&obj->itm_output[port], data, size);
+}
+
+static void arm_tpiu_swo_itm_hardware(unsigned int discriminator,
+		uint32_t value, size_t size, void *priv)
+{
+	struct arm_tpiu_swo_object *obj = priv;
+	char line[64];
+
+	if (!obj->dwt_filename)
+		return;
+
+	int len = arm_itm_dwt_format(line, sizeof(line), discriminator, value, size);
+	if (len > 0 && (size_t)len < sizeof(line))
+		arm_tpiu_swo_write(&obj->dwt_output, (const uint8_t *)line, len);
+}
+
+static void arm_tpiu_swo_tpiu_stream(unsigned int id, const uint8_t *data,
+		size_t size, void *priv)
+{
+	struct arm_tpiu_swo_object *obj = priv;
+
+	if (id == ARM_TPIU_SWO_ITM_ID)
+		arm_itm_decode(&obj->itm, data, size);
+}
 
 static int arm_tpiu_swo_poll_trace(void *priv)
 {
 	struct arm_tpiu_swo_object *obj = priv;
-	uint8_t buf[ARM_TPIU_SWO_TRACE_BUF_SIZE];
-	size_t size = sizeof(buf);
-	struct arm_tpiu_swo_connection *c;
+	int retval;
 
-	int retval = adapter_poll_trace(buf, &size);
-	if (retval != ERROR_OK || !size)
-		return retval;
+	/*
+	 * Drain the adapter as long as it returns full buffers, data is only
+	 * flushed to files periodically so that a busy trace stream does not
+	 * cause a write to disk on every poll.
+	 */
+	for (unsigned int i = 0; i < ARM_TPIU_SWO_MAX_READS; i++) {
+		size_t size = ARM_TPIU_SWO_TRACE_BUF_SIZE;
+
+		retval = adapter_poll_trace(obj->trace_buf, &size);
+		if (retval != ERROR_OK)
+			return retval;
+		if (!size)
+			break;
 
-	target_call_trace_callbacks(/*target*/NULL, size, buf);
+		target_call_trace_callbacks(/*target*/NULL, size, obj->trace_buf);
 
-	if (obj->file) {
-		if (fwrite(buf, 1, size, obj->file) == size) {
-			fflush(obj->file);
-		} else {
-			LOG_ERROR("Error writing to the SWO trace destination file");
-			return ERROR_FAIL;
+		retval = arm_tpiu_swo_write(&obj->output, obj->trace_buf, size);
+		if (retval != ERROR_OK)
+			return retval;
+
+		if (obj->decode) {
+			if (obj->en_formatter)
+				arm_tpiu_deformat(&obj->deformatter, obj->trace_buf, size);
+			else
+				arm_itm_decode(&obj->itm, obj->trace_buf, size);
 		}
+
+		if (size < ARM_TPIU_SWO_TRACE_BUF_SIZE)
+			break;
 	}
 
-	if (obj->out_filename && obj->out_filename[0] == ':')
-		list_for_each_entry(c, &obj->connections, lh)
-			if (connection_write(c->connection, buf, size) != (int)size)
-				retval = ERROR_FAIL;
+	int64_t now = timeval_ms();
+	arm_tpiu_swo_flush(&obj->output, now);
+	for (unsigned int port = 0; port < ARM_ITM_NUM_STIMULUS_PORTS; port++)
+		arm_tpiu_swo_flush(&obj->itm_output[port], now);
+	arm_tpiu_swo_flush(&obj->dwt_output, now);
 
 	return ERROR_OK;
 }
@@ -194,64 +297,17 @@ static void arm_tpiu_swo_handle_event(struct arm_tpiu_swo_object *obj, enum arm_
 	}
 }
 
-static void arm_tpiu_swo_close_output(struct arm_tpiu_swo_object *obj)
-{
-	if (obj->file) {
-		fclose(obj->file);
-		obj->file = NULL;
-	}
-	if (obj->out_filename && obj->out_filename[0] == ':')
-		remove_service(TCP_SERVICE_NAME, &obj->out_filename[1]);
-}
-
-int arm_tpiu_swo_cleanup_all(void)
-{
-	struct arm_tpiu_swo_object *obj, *tmp;
-
-	list_for_each_entry_safe(obj, tmp, &all_tpiu_swo, lh) {
-		if (obj->enabled)
-			arm_tpiu_swo_handle_event(obj, TPIU_SWO_EVENT_PRE_DISABLE);
-
-		arm_tpiu_swo_close_output(obj);
-
-		if (obj->en_capture) {
-			target_unregister_timer_callback(arm_tpiu_swo_poll_trace, obj);
-
-			int retval = adapter_config_trace(false, 0, 0, NULL, 0, NULL);
-			if (retval != ERROR_OK)
-				LOG_ERROR("Failed to stop adapter's trace");
-		}
-
-		if (obj->enabled)
-			arm_tpiu_swo_handle_event(obj, TPIU_SWO_EVENT_POST_DISABLE);
-
-		struct arm_tpiu_swo_event_action *ea = obj->event_action;
-		while (ea) {
-			struct arm_tpiu_swo_event_action *next = ea->next;
-			Jim_DecrRefCount(ea->interp, ea->body);
-			free(ea);
-			ea = next;
-		}
-
-		free(obj->name);
-		free(obj->out_filename);
-		free(obj);
-	}
-
-	return ERROR_OK;
-}
-
 static int arm_tpiu_swo_service_new_connection(struct connection *connection)
 {
 	struct arm_tpiu_swo_priv_connection *priv = connection->service->priv;
-	struct arm_tpiu_swo_object *obj = priv->obj;
+	struct arm_tpiu_swo_output *out = priv->output;
 	struct arm_tpiu_swo_connection *c = malloc(sizeof(*c));
 	if (!c) {
 		LOG_ERROR("Out of memory");
 		return ERROR_FAIL;
 	}
 	c->connection = connection;
-	list_add(&c->lh, &obj->connections);
+	list_add(&c->lh, &out->connections);
 	return ERROR_OK;
 }
 
@@ -274,10 +330,10 @@ static int arm_tpiu_swo_service_input(struct connection *connection)
 static int arm_tpiu_swo_service_connection_closed(struct connection *connection)
 {
 	struct arm_tpiu_swo_priv_connection *priv = connection->service->priv;
-	struct arm_tpiu_swo_object *obj = priv->obj;
+	struct arm_tpiu_swo_output *out = priv->output;
 	struct arm_tpiu_swo_connection *c, *tmp;
 
-	list_for_each_entry_safe(c, tmp, &obj->connections, lh)
+	list_for_each_entry_safe(c, tmp, &out->connections, lh)
 		if (c->connection == connection) {
 			list_del(&c->lh);
 			free(c);
@@ -287,6 +343,142 @@ static int arm_tpiu_swo_service_connection_closed(struct connection *connection)
 	return ERROR_FAIL;
 }
 
+static int arm_tpiu_swo_open_one(struct arm_tpiu_swo_object *obj,
+		struct arm_tpiu_swo_output *out, const char *filename)
+{
+	out->dirty = false;
+	out->last_flush = timeval_ms();
+
+	if (filename[0] == ':') {
+		struct arm_tpiu_swo_priv_connection *priv = malloc(sizeof(*priv));
+		if (!priv) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		priv->output = out;
+		LOG_INFO("starting trace server for %s on %s", obj->name, &filename[1]);
+		int retval = add_service(TCP_SERVICE_NAME, &filename[1],
+			CONNECTION_LIMIT_UNLIMITED, arm_tpiu_swo_service_new_connection,
+			arm_tpiu_swo_service_input, arm_tpiu_swo_service_connection_closed,
+			priv);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("Can't configure trace TCP port %s", &filename[1]);
+			return retval;
+		}
+	} else if (strcmp(filename, "-")) {
+		out->file = fopen(filename, "ab");
+		if (!out->file) {
+			LOG_ERROR("Can't open trace destination file \"%s\"", filename);
+			return ERROR_FAIL;
+		}
+		setvbuf(out->file, NULL, _IOFBF, ARM_TPIU_SWO_TRACE_BUF_SIZE);
+	}
+
+	return ERROR_OK;
+}
+
+static void arm_tpiu_swo_close_one(struct arm_tpiu_swo_output *out,
+		const char *filename)
+{
+	if (out->file) {
+		fclose(out->file);
+		out->file = NULL;
+	}
+	if (filename && filename[0] == ':')
+		remove_service(TCP_SERVICE_NAME, &filename[1]);
+}
+
+static void arm_tpiu_swo_close_output(struct arm_tpiu_swo_object *obj)
+{
+	arm_tpiu_swo_close_one(&obj->output, obj->out_filename);
+
+	for (unsigned int port = 0; port < ARM_ITM_NUM_STIMULUS_PORTS; port++)
+		arm_tpiu_swo_close_one(&obj->itm_output[port], obj->itm_filename[port]);
+	arm_tpiu_swo_close_one(&obj->dwt_output, obj->dwt_filename);
+
+	free(obj->trace_buf);
+	obj->trace_buf = NULL;
+}
+
+static int arm_tpiu_swo_open_output(struct arm_tpiu_swo_object *obj)
+{
+	obj->trace_buf = malloc(ARM_TPIU_SWO_TRACE_BUF_SIZE);
+	if (!obj->trace_buf) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	int retval = arm_tpiu_swo_open_one(obj, &obj->output, obj->out_filename);
+
+	obj->decode = false;
+	for (unsigned int port = 0; port < ARM_ITM_NUM_STIMULUS_PORTS; port++) {
+		if (retval != ERROR_OK)
+			break;
+		if (!obj->itm_filename[port])
+			continue;
+		retval = arm_tpiu_swo_open_one(obj, &obj->itm_output[port],
+			obj->itm_filename[port]);
+		obj->decode = true;
+	}
+	if (retval == ERROR_OK && obj->dwt_filename) {
+		retval = arm_tpiu_swo_open_one(obj, &obj->dwt_output, obj->dwt_filename);
+		obj->decode = true;
+	}
+
+	if (retval != ERROR_OK) {
+		arm_tpiu_swo_close_output(obj);
+		return retval;
+	}
+
+	arm_tpiu_deformatter_init(&obj->deformatter, arm_tpiu_swo_tpiu_stream, obj);
+	arm_itm_decoder_init(&obj->itm);
+	obj->itm.stimulus = arm_tpiu_swo_itm_stimulus;
+	obj->itm.hardware = arm_tpiu_swo_itm_hardware;
+	obj->itm.priv = obj;
+
+	return ERROR_OK;
+}
+
+int arm_tpiu_swo_cleanup_all(void)
+{
+	struct arm_tpiu_swo_object *obj, *tmp;
+
+	list_for_each_entry_safe(obj, tmp, &all_tpiu_swo, lh) {
+		if (obj->enabled)
+			arm_tpiu_swo_handle_event(obj, TPIU_SWO_EVENT_PRE_DISABLE);
+
+		arm_tpiu_swo_close_output(obj);
+
+		if (obj->en_capture) {
+			target_unregister_timer_callback(arm_tpiu_swo_poll_trace, obj);
+
+			int retval = adapter_config_trace(false, 0, 0, NULL, 0, NULL);
+			if (retval != ERROR_OK)
+				LOG_ERROR("Failed to stop adapter's trace");
+		}
+
+		if (obj->enabled)
+			arm_tpiu_swo_handle_event(obj, TPIU_SWO_EVENT_POST_DISABLE);
+
+		struct arm_tpiu_swo_event_action *ea = obj->event_action;
+		while (ea) {
+			struct arm_tpiu_swo_event_action *next = ea->next;
+			Jim_DecrRefCount(ea->interp, ea->body);
+			free(ea);
+			ea = next;
+		}
+
+		free(obj->name);
+		free(obj->out_filename);
+		for (unsigned int port = 0; port < ARM_ITM_NUM_STIMULUS_PORTS; port++)
+			free(obj->itm_filename[port]);
+		free(obj->dwt_filename);
+		free(obj);
+	}
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_arm_tpiu_swo_event_list)
 {
 	struct arm_tpiu_swo_object *obj = CMD_DATA;
@@ -312,6 +504,8 @@ enum arm_tpiu_swo_cfg_param {
 	CFG_TRACECLKIN,
 	CFG_BITRATE,
 	CFG_OUTFILE,
+	CFG_ITM_OUTFILE,
+	CFG_DWT_OUTFILE,
 	CFG_EVENT,
 };
 
@@ -322,6 +516,8 @@ static const Jim_Nvp nvp_arm_tpiu_swo_config_opts[] = {
 	{ .name = "-traceclk",      .value = CFG_TRACECLKIN },
 	{ .name = "-pin-freq",      .value = CFG_BITRATE },
 	{ .name = "-output",        .value = CFG_OUTFILE },
+	{ .name = "-itm-output",    .value = CFG_ITM_OUTFILE },
+	{ .name = "-dwt-output",    .value = CFG_DWT_OUTFILE },
 	{ .name = "-event",         .value = CFG_EVENT },
 	/* handled by mem_ap_spot, added for Jim_GetOpt_NvpUnknown() */
 	{ .name = "-dap",           .value = -1 },
@@ -484,6 +680,83 @@ static int arm_tpiu_swo_configure(Jim_GetOptInfo *goi, struct arm_tpiu_swo_objec
 					Jim_SetResult(goi->interp, Jim_NewStringObj(goi->interp, obj->out_filename, -1));
 			}
 			break;
+		case CFG_ITM_OUTFILE:
+			{
+				jim_wide port;
+				if (goi->argc < (goi->isconfigure ? 2 : 1)) {
+					Jim_WrongNumArgs(goi->interp, goi->argc, goi->argv,
+						goi->isconfigure ? "-itm-output ?port? ?filename?" : "-itm-output ?port?");
+					return JIM_ERR;
+				}
+				e = Jim_GetOpt_Wide(goi, &port);
+				if (e != JIM_OK)
+					return e;
+				if (port < 0 || port >= ARM_ITM_NUM_STIMULUS_PORTS) {
+					Jim_SetResultString(goi->interp, "Invalid ITM stimulus port!", -1);
+					return JIM_ERR;
+				}
+				if (goi->isconfigure) {
+					const char *s;
+					e = Jim_GetOpt_String(goi, &s, NULL);
+					if (e != JIM_OK)
+						return e;
+					if (s[0] == ':') {
+						char *end;
+						long tcp_port = strtol(s + 1, &end, 0);
+						if (tcp_port <= 0 || tcp_port > UINT16_MAX || *end != '\0') {
+							Jim_SetResultFormatted(goi->interp, "Invalid TCP port \'%s\'", s + 1);
+							return JIM_ERR;
+						}
+					}
+					free(obj->itm_filename[port]);
+					obj->itm_filename[port] = NULL;
+					/* an empty name disables the output */
+					if (s[0]) {
+						obj->itm_filename[port] = strdup(s);
+						if (!obj->itm_filename[port]) {
+							LOG_ERROR("Out of memory");
+							return JIM_ERR;
+						}
+					}
+				} else {
+					if (goi->argc)
+						goto err_no_params;
+					if (obj->itm_filename[port])
+						Jim_SetResult(goi->interp, Jim_NewStringObj(goi->interp, obj->itm_filename[port], -1));
+				}
+			}
+			break;
+		case CFG_DWT_OUTFILE:
+			if (goi->isconfigure) {
+				const char *s;
+				e = Jim_GetOpt_String(goi, &s, NULL);
+				if (e != JIM_OK)
+					return e;
+				if (s[0] == ':') {
+					char *end;
+					long tcp_port = strtol(s + 1, &end, 0);
+					if (tcp_port <= 0 || tcp_port > UINT16_MAX || *end != '\0') {
+						Jim_SetResultFormatted(goi->interp, "Invalid TCP port \'%s\'", s + 1);
+						return JIM_ERR;
+					}
+				}
+				free(obj->dwt_filename);
+				obj->dwt_filename = NULL;
+				/* an empty name disables the output */
+				if (s[0]) {
+					obj->dwt_filename = strdup(s);
+					if (!obj->dwt_filename) {
+						LOG_ERROR("Out of memory");
+						return JIM_ERR;
+					}
+				}
+			} else {
+				if (goi->argc)
+					goto err_no_params;
+				if (obj->dwt_filename)
+					Jim_SetResult(goi->interp, Jim_NewStringObj(goi->interp, obj->dwt_filename, -1));
+			}
+			break;
 		case CFG_EVENT:
 			if (goi->isconfigure) {
 				if (goi->argc < 2) {
@@ -688,29 +961,8 @@ static int jim_arm_tpiu_swo_enable(Jim_Interp *interp, int argc, Jim_Obj *const
 	unsigned int swo_pin_freq = obj->swo_pin_freq; /* could be replaced */
 
 	if (obj->out_filename && strcmp(obj->out_filename, "external") && obj->out_filename[0]) {
-		if (obj->out_filename[0] == ':') {
-			struct arm_tpiu_swo_priv_connection *priv = malloc(sizeof(*priv));
-			if (!priv) {
-				LOG_ERROR("Out of memory");
-				return JIM_ERR;
-			}
-			priv->obj = obj;
-			LOG_INFO("starting trace server for %s on %s", obj->name, &obj->out_filename[1]);
-			retval = add_service("tpiu_swo_trace", &obj->out_filename[1],
-				CONNECTION_LIMIT_UNLIMITED, arm_tpiu_swo_service_new_connection,
-				arm_tpiu_swo_service_input, arm_tpiu_swo_service_connection_closed,
-				priv);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Can't configure trace TCP port %s", &obj->out_filename[1]);
-				return JIM_ERR;
-			}
-		} else if (strcmp(obj->out_filename, "-")) {
-			obj->file = fopen(obj->out_filename, "ab");
-			if (!obj->file) {
-				LOG_ERROR("Can't open trace destination file \"%s\"", obj->out_filename);
-				return JIM_ERR;
-			}
-		}
+		if (arm_tpiu_swo_open_output(obj) != ERROR_OK)
+			return JIM_ERR;
 
 		retval = adapter_config_trace(true, obj->pin_protocol, obj->port_width,
 			&swo_pin_freq, obj->traceclkin_freq, &prescaler);
@@ -909,7 +1161,10 @@ static int jim_arm_tpiu_swo_create(Jim_Interp *interp, int argc, Jim_Obj *const
 		LOG_ERROR("Out of memory");
 		return JIM_ERR;
 	}
-	INIT_LIST_HEAD(&obj->connections);
+	INIT_LIST_HEAD(&obj->output.connections);
+	for (unsigned int port = 0; port < ARM_ITM_NUM_STIMULUS_PORTS; port++)
+		INIT_LIST_HEAD(&obj->itm_output[port].connections);
+	INIT_LIST_HEAD(&obj->dwt_output.connections);
 	adiv5_mem_ap_spot_init(&obj->spot);
 	obj->spot.base = TPIU_SWO_DEFAULT_BASE;
 	obj->port_width = 1;
@@ -943,6 +1198,9 @@ static int jim_arm_tpiu_swo_create(Jim_Interp *interp, int argc, Jim_Obj *const
 err_exit:
 	free(obj->name);
 	free(obj->out_filename);
+	for (unsigned int port = 0; port < ARM_ITM_NUM_STIMULUS_PORTS; port++)
+		free(obj->itm_filename[port]);
+	free(obj->dwt_filename);
 	free(obj);
 	return JIM_ERR;
 }
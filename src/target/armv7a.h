@@ -144,10 +144,12 @@ static inline bool is_armv7a(struct armv7a_common *armv7a)
 
 /* See ARMv7a arch spec section C10.2 */
 #define CPUDBG_DIDR		0x000
+#define CPUDBG_DIDR_PCSR_IMP	(1 << 13)
 
 /* See ARMv7a arch spec section C10.3 */
 #define CPUDBG_WFAR		0x018
 /* PCSR at 0x084 -or- 0x0a0 -or- both ... based on flags in DIDR */
+#define CPUDBG_PCSR		0x084
 #define CPUDBG_DSCR		0x088
 #define CPUDBG_DRCR		0x090
 #define CPUDBG_PRCR		0x310
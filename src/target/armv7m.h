@@ -258,6 +258,8 @@ int armv7m_wait_algorithm(struct target *target,
 
 int armv7m_invalidate_core_regs(struct target *target);
 
+uint32_t armv7m_map_id_to_regsel(unsigned int arm_reg_id);
+
 int armv7m_restore_context(struct target *target);
 
 int armv7m_checksum_memory(struct target *target,
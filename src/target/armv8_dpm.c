@@ -813,6 +813,58 @@ fail:
 	return retval;
 }
 
+/**
+ * Read every invalid register available from the current EL, including the
+ * FP-SIMD registers that armv8_dpm_read_current_registers() leaves out,
+ * inside a single prepare/finish bracket.
+ */
+int armv8_dpm_fetch_registers(struct target *target)
+{
+	struct arm *arm = target_to_arm(target);
+	struct arm_dpm *dpm = arm->dpm;
+	struct reg_cache *cache = arm->core_cache;
+	bool prepared = false;
+	int retval = ERROR_OK;
+
+	if (target->state != TARGET_HALTED)
+		return ERROR_TARGET_NOT_HALTED;
+
+	for (unsigned int i = 0; i < cache->num_regs; i++) {
+		struct reg *r = armv8_reg_current(arm, i);
+		struct arm_reg *arm_reg = r->arch_info;
+
+		if (r->valid || !r->exist)
+			continue;
+
+		if (arm_reg->mode != ARM_MODE_ANY &&
+				dpm->last_el != armv8_curel_from_core_mode(arm_reg->mode))
+			continue;
+
+		/* Special case: ARM_MODE_SYS has no SPSR at EL1 */
+		if (r->number == ARMV8_SPSR_EL1 && arm->core_mode == ARM_MODE_SYS)
+			continue;
+
+		if (!prepared) {
+			retval = dpm->prepare(dpm);
+			if (retval != ERROR_OK)
+				return retval;
+			prepared = true;
+		}
+
+		retval = dpmv8_read_reg(dpm, r, i);
+		if (retval != ERROR_OK)
+			break;
+
+		/* R0 comes first; it is scratch for everything that follows */
+		if (i == ARMV8_R0)
+			r->dirty = true;
+	}
+
+	if (prepared)
+		/* (void) */ dpm->finish(dpm);
+	return retval;
+}
+
 /* Avoid needless I/O ... leave breakpoints and watchpoints alone
  * unless they're removed, or need updating because of single-stepping
  * or running debugger code.
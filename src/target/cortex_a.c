@@ -3010,6 +3010,85 @@ static int cortex_a_virt2phys(struct target *target,
 						    phys, 1);
 }
 
+/* Convert a DBGPCSR sample to the address of the sampled instruction,
+ * returns false if the sample is not valid. */
+static bool cortex_a_pcsr_to_pc(uint32_t pcsr, uint32_t *pc)
+{
+	if (pcsr == 0xffffffff)
+		return false;
+
+	/* bits 1:0 tell the instruction set, the sample is offset
+	 * like a PC read by an instruction in that state */
+	if (pcsr & 1)
+		*pc = (pcsr & ~1) - 4;	/* Thumb */
+	else if ((pcsr & 3) == 0)
+		*pc = pcsr - 8;			/* ARM */
+	else
+		return false;			/* Jazelle */
+
+	return true;
+}
+
+static int cortex_a_profiling(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+{
+	struct cortex_a_common *cortex_a = target_to_cortex_a(target);
+	struct armv7a_common *armv7a = &cortex_a->armv7a_common;
+	struct timeval timeout, now;
+	int retval = ERROR_OK;
+
+	if (!(cortex_a->didr & CPUDBG_DIDR_PCSR_IMP)) {
+		LOG_INFO("DBGPCSR sampling not supported on this processor.");
+		return target_profiling_default(target, samples, max_num_samples,
+				num_samples, seconds);
+	}
+
+	gettimeofday(&timeout, NULL);
+	timeval_add_time(&timeout, seconds, 0);
+
+	LOG_INFO("Starting Cortex-A profiling. Sampling DBGPCSR as fast as we can...");
+
+	/* Make sure the target is running */
+	target_poll(target);
+	if (target->state == TARGET_HALTED)
+		retval = target_resume(target, 1, 0, 0, 0);
+
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error while resuming target");
+		return retval;
+	}
+
+	uint32_t sample_count = 0;
+
+	while (sample_count < max_num_samples) {
+		uint32_t read_count = MIN(max_num_samples - sample_count, 1024);
+
+		retval = mem_ap_read_buf_noincr(armv7a->debug_ap,
+				(void *)&samples[sample_count], 4, read_count,
+				armv7a->debug_base + CPUDBG_PCSR);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("Error while reading DBGPCSR");
+			return retval;
+		}
+
+		uint32_t valid = 0;
+		for (uint32_t i = 0; i < read_count; i++)
+			if (cortex_a_pcsr_to_pc(samples[sample_count + i],
+					&samples[sample_count + valid]))
+				valid++;
+		sample_count += valid;
+
+		gettimeofday(&now, NULL);
+		if (timeval_compare(&now, &timeout) > 0)
+			break;
+	}
+
+	LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
+
+	*num_samples = sample_count;
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(cortex_a_handle_cache_info_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -3157,6 +3236,7 @@ struct target_type cortexa_target = {
 	/* REVISIT allow exporting VFP3 registers ... */
 	.get_gdb_arch = arm_get_gdb_arch,
 	.get_gdb_reg_list = arm_get_gdb_reg_list,
+	.fetch_registers = arm_dpm_fetch_registers,
 
 	.read_memory = cortex_a_read_memory,
 	.write_memory = cortex_a_write_memory,
@@ -3168,6 +3248,7 @@ struct target_type cortexa_target = {
 	.blank_check_memory = arm_blank_check_memory,
 
 	.run_algorithm = armv4_5_run_algorithm,
+	.profiling = cortex_a_profiling,
 
 	.add_breakpoint = cortex_a_add_breakpoint,
 	.add_context_breakpoint = cortex_a_add_context_breakpoint,
@@ -3237,6 +3318,7 @@ struct target_type cortexr4_target = {
 	/* REVISIT allow exporting VFP3 registers ... */
 	.get_gdb_arch = arm_get_gdb_arch,
 	.get_gdb_reg_list = arm_get_gdb_reg_list,
+	.fetch_registers = arm_dpm_fetch_registers,
 
 	.read_memory = cortex_a_read_phys_memory,
 	.write_memory = cortex_a_write_phys_memory,
@@ -72,6 +72,8 @@ static int cortex_m_load_core_reg_u32(struct target *target,
 			return retval;
 	}
 
+	target_to_cm(target)->single_reg_reads++;
+
 	retval = mem_ap_write_u32(armv7m->debug_ap, DCB_DCRSR, regsel);
 	if (retval != ERROR_OK)
 		return retval;
@@ -123,6 +125,28 @@ static int cortex_m_store_core_reg_u32(struct target *target,
 	return retval;
 }
 
+/* S_RESET_ST is cleared by every DHCSR read, including the ones queued
+ * while reading registers, so remember it until cortex_m_poll() has seen it */
+static inline void cortex_m_cumulate_dhcsr_sticky(struct cortex_m_common *cortex_m,
+		uint32_t dhcsr)
+{
+	cortex_m->dcb_dhcsr_cumulated_sticky |= dhcsr;
+}
+
+static int cortex_m_read_dhcsr_atomic_sticky(struct target *target)
+{
+	struct cortex_m_common *cortex_m = target_to_cm(target);
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+
+	int retval = mem_ap_read_atomic_u32(armv7m->debug_ap, DCB_DHCSR,
+				&cortex_m->dcb_dhcsr);
+	if (retval != ERROR_OK)
+		return retval;
+
+	cortex_m_cumulate_dhcsr_sticky(cortex_m, cortex_m->dcb_dhcsr);
+	return ERROR_OK;
+}
+
 static int cortex_m_write_debug_halt_mask(struct target *target,
 	uint32_t mask_on, uint32_t mask_off)
 {
@@ -306,7 +330,7 @@ static int cortex_m_endreset_event(struct target *target)
 		return retval;
 
 	/* Enable debug requests */
-	retval = mem_ap_read_atomic_u32(armv7m->debug_ap, DCB_DHCSR, &cortex_m->dcb_dhcsr);
+	retval = cortex_m_read_dhcsr_atomic_sticky(target);
 	if (retval != ERROR_OK)
 		return retval;
 	if (!(cortex_m->dcb_dhcsr & C_DEBUGEN)) {
@@ -371,7 +395,7 @@ static int cortex_m_endreset_event(struct target *target)
 	register_cache_invalidate(armv7m->arm.core_cache);
 
 	/* make sure we have latest dhcsr flags */
-	retval = mem_ap_read_atomic_u32(armv7m->debug_ap, DCB_DHCSR, &cortex_m->dcb_dhcsr);
+	retval = cortex_m_read_dhcsr_atomic_sticky(target);
 
 	return retval;
 }
@@ -478,9 +502,110 @@ static int cortex_m_examine_exception_reason(struct target *target)
 	return retval;
 }
 
+/**
+ * Read all core registers not in the cache yet with a single DAP queue run.
+ * Every DCRSR write is followed by a DHCSR read, which shows whether the
+ * transfer had completed (S_REGRDY) before DCRDR got read. If that isn't the
+ * case for every register, or the DCRDR is in use by the emulated DCC
+ * channel, the registers are read one by one instead.
+ *
+ * The FP registers are only read if @a fp is set, otherwise they're left to
+ * be read on demand.
+ */
+static int cortex_m_read_regs_queued(struct target *target, bool fp)
+{
+	struct cortex_m_common *cortex_m = target_to_cm(target);
+	struct armv7m_common *armv7m = &cortex_m->armv7m;
+	struct arm *arm = &armv7m->arm;
+	struct reg_cache *cache = arm->core_cache;
+	uint32_t value[ARMV7M_LAST_REG][2];
+	uint32_t dhcsr[ARMV7M_LAST_REG][2];
+	bool queued[ARMV7M_LAST_REG] = { false };
+	bool fast = !target->dbg_msg_enabled;
+	int retval;
+
+	assert(cache->num_regs <= ARMV7M_LAST_REG);
+
+	for (unsigned int i = 0; fast && i < cache->num_regs; i++) {
+		struct reg *r = &cache->reg_list[i];
+
+		/* packed registers are extracted from their container below */
+		if (!r->exist || r->valid || r->size <= 8)
+			continue;
+		if (!fp && i >= ARMV7M_D0)
+			continue;
+
+		uint32_t regsel = armv7m_map_id_to_regsel(i);
+		for (unsigned int w = 0; w < r->size / 32; w++) {
+			retval = mem_ap_write_u32(armv7m->debug_ap, DCB_DCRSR, regsel + w);
+			if (retval == ERROR_OK)
+				retval = mem_ap_read_u32(armv7m->debug_ap, DCB_DHCSR, &dhcsr[i][w]);
+			if (retval == ERROR_OK)
+				retval = mem_ap_read_u32(armv7m->debug_ap, DCB_DCRDR, &value[i][w]);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		queued[i] = true;
+	}
+
+	if (fast) {
+		retval = dap_run(armv7m->debug_ap->dap);
+		if (retval != ERROR_OK)
+			return retval;
+
+		for (unsigned int i = 0; i < cache->num_regs; i++) {
+			for (unsigned int w = 0; queued[i] && w < cache->reg_list[i].size / 32; w++) {
+				cortex_m_cumulate_dhcsr_sticky(cortex_m, dhcsr[i][w]);
+				if (!(dhcsr[i][w] & S_REGRDY)) {
+					LOG_DEBUG("core too slow for queued register reads");
+					fast = false;
+					break;
+				}
+			}
+		}
+	}
+
+	if (fast) {
+		cortex_m->batched_reg_reads++;
+		for (unsigned int i = 0; i < cache->num_regs; i++) {
+			struct reg *r = &cache->reg_list[i];
+			if (!queued[i])
+				continue;
+			buf_set_u32(r->value, 0, 32, value[i][0]);
+			if (r->size == 64)
+				buf_set_u32(r->value + 4, 0, 32, value[i][1]);
+			r->valid = true;
+			r->dirty = false;
+		}
+	}
+
+	/* Whatever is left, including the packed registers, is read one by one.
+	 * The latter don't need another transfer if their container was read
+	 * above. */
+	for (unsigned int i = 0; i < cache->num_regs; i++) {
+		struct reg *r = &cache->reg_list[i];
+		if (!r->exist || r->valid)
+			continue;
+		if (!fp && i >= ARMV7M_D0)
+			continue;
+		retval = arm->read_core_reg(target, r, i, ARM_MODE_ANY);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
+static int cortex_m_fetch_registers(struct target *target)
+{
+	if (target->state != TARGET_HALTED)
+		return ERROR_TARGET_NOT_HALTED;
+
+	return cortex_m_read_regs_queued(target, true);
+}
+
 static int cortex_m_debug_entry(struct target *target)
 {
-	int i;
 	uint32_t xPSR;
 	int retval;
 	struct cortex_m_common *cortex_m = target_to_cm(target);
@@ -495,7 +620,7 @@ static int cortex_m_debug_entry(struct target *target)
 	cortex_m_set_maskints_for_halt(target);
 
 	cortex_m_clear_halt(target);
-	retval = mem_ap_read_atomic_u32(armv7m->debug_ap, DCB_DHCSR, &cortex_m->dcb_dhcsr);
+	retval = cortex_m_read_dhcsr_atomic_sticky(target);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -516,14 +641,12 @@ static int cortex_m_debug_entry(struct target *target)
 	}
 
 	/* Examine target state and mode
-	 * First load register accessible through core debug port */
-	int num_regs = arm->core_cache->num_regs;
-
-	for (i = 0; i < num_regs; i++) {
-		r = &armv7m->arm.core_cache->reg_list[i];
-		if (r->exist && !r->valid)
-			arm->read_core_reg(target, r, i, ARM_MODE_ANY);
-	}
+	 * First load register accessible through core debug port, the FP
+	 * registers are only read when needed */
+	cortex_m->debug_entries++;
+	retval = cortex_m_read_regs_queued(target, false);
+	if (retval != ERROR_OK)
+		return retval;
 
 	r = arm->cpsr;
 	xPSR = buf_get_u32(r->value, 0, 32);
@@ -579,7 +702,7 @@ static int cortex_m_poll(struct target *target)
 	struct armv7m_common *armv7m = &cortex_m->armv7m;
 
 	/* Read from Debug Halting Control and Status Register */
-	retval = mem_ap_read_atomic_u32(armv7m->debug_ap, DCB_DHCSR, &cortex_m->dcb_dhcsr);
+	retval = cortex_m_read_dhcsr_atomic_sticky(target);
 	if (retval != ERROR_OK) {
 		target->state = TARGET_UNKNOWN;
 		return retval;
@@ -600,12 +723,13 @@ static int cortex_m_poll(struct target *target)
 		detected_failure = ERROR_FAIL;
 
 		/* refresh status bits */
-		retval = mem_ap_read_atomic_u32(armv7m->debug_ap, DCB_DHCSR, &cortex_m->dcb_dhcsr);
+		retval = cortex_m_read_dhcsr_atomic_sticky(target);
 		if (retval != ERROR_OK)
 			return retval;
 	}
 
-	if (cortex_m->dcb_dhcsr & S_RESET_ST) {
+	if (cortex_m->dcb_dhcsr_cumulated_sticky & S_RESET_ST) {
+		cortex_m->dcb_dhcsr_cumulated_sticky &= ~S_RESET_ST;
 		if (target->state != TARGET_RESET) {
 			target->state = TARGET_RESET;
 			LOG_INFO("%s: external reset detected", target_name(target));
@@ -1014,9 +1138,7 @@ static int cortex_m_step(struct target *target, int current,
 
 					/* Wait for pending handlers to complete or timeout */
 					do {
-						retval = mem_ap_read_atomic_u32(armv7m->debug_ap,
-								DCB_DHCSR,
-								&cortex_m->dcb_dhcsr);
+						retval = cortex_m_read_dhcsr_atomic_sticky(target);
 						if (retval != ERROR_OK) {
 							target->state = TARGET_UNKNOWN;
 							return retval;
@@ -1051,7 +1173,7 @@ static int cortex_m_step(struct target *target, int current,
 		}
 	}
 
-	retval = mem_ap_read_atomic_u32(armv7m->debug_ap, DCB_DHCSR, &cortex_m->dcb_dhcsr);
+	retval = cortex_m_read_dhcsr_atomic_sticky(target);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -1130,7 +1252,7 @@ static int cortex_m_assert_reset(struct target *target)
 
 	/* Enable debug requests */
 	int retval;
-	retval = mem_ap_read_atomic_u32(armv7m->debug_ap, DCB_DHCSR, &cortex_m->dcb_dhcsr);
+	retval = cortex_m_read_dhcsr_atomic_sticky(target);
 	/* Store important errors instead of failing and proceed to reset assert */
 
 	if (retval != ERROR_OK || !(cortex_m->dcb_dhcsr & C_DEBUGEN))
@@ -1701,9 +1823,18 @@ int cortex_m_profiling(struct target *target, uint32_t *samples,
 			retval = mem_ap_read_buf_noincr(armv7m->debug_ap,
 						(void *)&samples[sample_count],
 						4, read_count, DWT_PCSR);
-			sample_count += read_count;
+
+			/* PCSR reads as all ones when the core is halted, sleeping or
+			 * the sample isn't valid, drop those */
+			uint32_t valid = 0;
+			for (uint32_t i = 0; i < read_count; i++)
+				if (samples[sample_count + i] != 0xffffffff)
+					samples[sample_count + valid++] = samples[sample_count + i];
+			sample_count += valid;
 		} else {
-			target_read_u32(target, DWT_PCSR, &samples[sample_count++]);
+			retval = target_read_u32(target, DWT_PCSR, &samples[sample_count]);
+			if (samples[sample_count] != 0xffffffff)
+				sample_count++;
 		}
 
 		if (retval != ERROR_OK) {
@@ -2405,6 +2536,38 @@ COMMAND_HANDLER(handle_cortex_m_mask_interrupts_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_cortex_m_reg_stats_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct cortex_m_common *cortex_m = target_to_cm(target);
+	int retval;
+
+	retval = cortex_m_verify_pointer(CMD, cortex_m);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		cortex_m->debug_entries = 0;
+		cortex_m->batched_reg_reads = 0;
+		cortex_m->single_reg_reads = 0;
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "debug entries: %" PRIu64, cortex_m->debug_entries);
+	command_print(CMD, "batched register reads: %" PRIu64, cortex_m->batched_reg_reads);
+	command_print(CMD, "single register reads: %" PRIu64, cortex_m->single_reg_reads);
+	if (cortex_m->debug_entries)
+		command_print(CMD, "single register reads per debug entry: %" PRIu64,
+				cortex_m->single_reg_reads / cortex_m->debug_entries);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_cortex_m_reset_config_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -2472,6 +2635,13 @@ static const struct command_registration cortex_m_exec_command_handlers[] = {
 		.help = "configure software reset handling",
 		.usage = "['sysresetreq'|'vectreset']",
 	},
+	{
+		.name = "reg_stats",
+		.handler = handle_cortex_m_reg_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "show or reset core register read statistics",
+		.usage = "['reset']",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 static const struct command_registration cortex_m_command_handlers[] = {
@@ -2517,6 +2687,7 @@ struct target_type cortexm_target = {
 
 	.get_gdb_arch = arm_get_gdb_arch,
 	.get_gdb_reg_list = armv7m_get_gdb_reg_list,
+	.fetch_registers = cortex_m_fetch_registers,
 
 	.read_memory = cortex_m_read_memory,
 	.write_memory = cortex_m_write_memory,
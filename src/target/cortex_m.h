@@ -192,6 +192,7 @@ struct cortex_m_common {
 
 	/* Context information */
 	uint32_t dcb_dhcsr;
+	uint32_t dcb_dhcsr_cumulated_sticky;
 	uint32_t nvic_dfsr;  /* Debug Fault Status Register - shows reason for debug halt */
 	uint32_t nvic_icsr;  /* Interrupt Control State Register - shows active and pending IRQ */
 
@@ -221,6 +222,11 @@ struct cortex_m_common {
 	/* Whether this target has the erratum that makes C_MASKINTS not apply to
 	 * already pending interrupts */
 	bool maskints_erratum;
+
+	/* Core register read statistics, see cortex_m reg_stats */
+	uint64_t debug_entries;
+	uint64_t batched_reg_reads;
+	uint64_t single_reg_reads;
 };
 
 static inline struct cortex_m_common *
@@ -31,6 +31,7 @@
 
 #include "image.h"
 #include "target.h"
+#include <helper/binarybuffer.h>
 #include <helper/log.h>
 
 /* convert ELF header field to host endianness */
@@ -115,199 +116,177 @@ static int identify_image_type(struct image *image, const char *type_string, con
 	return ERROR_OK;
 }
 
+/* Decode one IHEX line into its record bytes: length, address, type, data
+ * and checksum. Comments and blank lines decode to an empty record. */
+static int image_ihex_decode_line(const char *line, uint8_t *record,
+	uint32_t *record_len)
+{
+	*record_len = 0;
+
+	if (line[0] != ':') {
+		/* skip comments and blank lines */
+		if ((line[0] == '#') || (strlen(line + strspn(line, "\n\t\r ")) == 0))
+			return ERROR_OK;
+		return ERROR_IMAGE_FORMAT_ERROR;
+	}
+
+	if (unhexify(record, line + 1, 1) != 1)
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	uint32_t len = 4 + record[0] + 1;
+	if (unhexify(record, line + 1, len) != len)
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	/* all bytes including the checksum add up to zero */
+	uint8_t sum = 0;
+	for (uint32_t i = 0; i < len; i++)
+		sum += record[i];
+	if (sum != 0) {
+		LOG_ERROR("incorrect record checksum found in IHEX file");
+		return ERROR_IMAGE_CHECKSUM;
+	}
+
+	*record_len = len;
+
+	return ERROR_OK;
+}
+
+/* Start a new section at the given address, unless the current one is still
+ * empty, in which case the address becomes its base address */
+static int image_hex_new_section(struct image *image,
+	struct imagesection *section, target_addr_t base_address)
+{
+	if (section[image->num_sections].size != 0) {
+		image->num_sections++;
+		if (image->num_sections >= IMAGE_MAX_SECTIONS) {
+			/* too many sections */
+			LOG_ERROR("Too many sections found in image file");
+			return ERROR_IMAGE_FORMAT_ERROR;
+		}
+		section[image->num_sections].size = 0x0;
+		section[image->num_sections].flags = 0;
+		section[image->num_sections].private = NULL;
+	}
+	section[image->num_sections].base_address = base_address;
+
+	return ERROR_OK;
+}
+
 static int image_ihex_buffer_complete_inner(struct image *image,
 	char *lpszLine,
-	struct imagesection *section)
+	struct imagesection *section,
+	size_t *section_offsets)
 {
 	struct image_ihex *ihex = image->type_private;
 	struct fileio *fileio = ihex->fileio;
+	uint8_t record[IMAGE_RECORD_MAX_BYTES];
+	uint32_t record_len;
 	uint32_t full_address;
-	uint32_t cooked_bytes;
+	size_t line_offset;
 	bool end_rec = false;
+	int retval;
 
 	/* we can't determine the number of sections that we'll have to create ahead of time,
 	 * so we locally hold them until parsing is finished */
 
-	size_t filesize;
-	int retval;
-	retval = fileio_size(fileio, &filesize);
-	if (retval != ERROR_OK)
-		return retval;
-
-	ihex->buffer = malloc(filesize >> 1);
-	cooked_bytes = 0x0;
 	image->num_sections = 0;
 
 	while (!fileio_feof(fileio)) {
 		full_address = 0x0;
-		section[image->num_sections].private = &ihex->buffer[cooked_bytes];
+		section[image->num_sections].private = NULL;
 		section[image->num_sections].base_address = 0x0;
 		section[image->num_sections].size = 0x0;
 		section[image->num_sections].flags = 0;
 
-		while (fileio_fgets(fileio, 1023, lpszLine) == ERROR_OK) {
-			uint32_t count;
-			uint32_t address;
-			uint32_t record_type;
-			uint32_t checksum;
-			uint8_t cal_checksum = 0;
-			size_t bytes_read = 0;
-
-			/* skip comments and blank lines */
-			if ((lpszLine[0] == '#') || (strlen(lpszLine + strspn(lpszLine, "\n\t\r ")) == 0))
+		while (fileio_tell(fileio, &line_offset) == ERROR_OK &&
+				fileio_fgets(fileio, 1023, lpszLine) == ERROR_OK) {
+			retval = image_ihex_decode_line(lpszLine, record, &record_len);
+			if (retval != ERROR_OK)
+				return retval;
+			if (record_len == 0)
 				continue;
 
-			if (sscanf(&lpszLine[bytes_read], ":%2" SCNx32 "%4" SCNx32 "%2" SCNx32, &count,
-				&address, &record_type) != 3)
-				return ERROR_IMAGE_FORMAT_ERROR;
-			bytes_read += 9;
-
-			cal_checksum += (uint8_t)count;
-			cal_checksum += (uint8_t)(address >> 8);
-			cal_checksum += (uint8_t)address;
-			cal_checksum += (uint8_t)record_type;
+			uint32_t count = record[0];
+			uint32_t address = be_to_h_u16(&record[1]);
+			uint32_t record_type = record[3];
+			const uint8_t *data = &record[4];
 
 			if (record_type == 0) {	/* Data Record */
 				if ((full_address & 0xffff) != address) {
-					/* we encountered a nonconsecutive location, create a new section,
-					 * unless the current section has zero size, in which case this specifies
-					 * the current section's base address
-					 */
-					if (section[image->num_sections].size != 0) {
-						image->num_sections++;
-						if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-							/* too many sections */
-							LOG_ERROR("Too many sections found in IHEX file");
-							return ERROR_IMAGE_FORMAT_ERROR;
-						}
-						section[image->num_sections].size = 0x0;
-						section[image->num_sections].flags = 0;
-						section[image->num_sections].private =
-							&ihex->buffer[cooked_bytes];
-					}
-					section[image->num_sections].base_address =
-						(full_address & 0xffff0000) | address;
+					/* we encountered a nonconsecutive location */
 					full_address = (full_address & 0xffff0000) | address;
+					retval = image_hex_new_section(image, section, full_address);
+					if (retval != ERROR_OK)
+						return retval;
 				}
 
-				while (count-- > 0) {
-					unsigned value;
-					sscanf(&lpszLine[bytes_read], "%2x", &value);
-					ihex->buffer[cooked_bytes] = (uint8_t)value;
-					cal_checksum += (uint8_t)ihex->buffer[cooked_bytes];
-					bytes_read += 2;
-					cooked_bytes += 1;
-					section[image->num_sections].size += 1;
-					full_address++;
-				}
+				/* the data is decoded again when the section is read */
+				if (section[image->num_sections].size == 0)
+					section_offsets[image->num_sections] = line_offset;
+
+				section[image->num_sections].size += count;
+				full_address += count;
 			} else if (record_type == 1) {	/* End of File Record */
 				/* finish the current section */
 				image->num_sections++;
 
 				/* copy section information */
+				free(image->sections);
+				free(ihex->reader.section_offsets);
 				image->sections = malloc(sizeof(struct imagesection) * image->num_sections);
+				ihex->reader.section_offsets = malloc(sizeof(size_t) * image->num_sections);
+				if (!image->sections || !ihex->reader.section_offsets) {
+					LOG_ERROR("Out of memory");
+					return ERROR_FAIL;
+				}
 				for (unsigned int i = 0; i < image->num_sections; i++) {
 					image->sections[i].private = section[i].private;
 					image->sections[i].base_address = section[i].base_address;
 					image->sections[i].size = section[i].size;
 					image->sections[i].flags = section[i].flags;
+					ihex->reader.section_offsets[i] = section_offsets[i];
 				}
 
 				end_rec = true;
 				break;
 			} else if (record_type == 2) {	/* Linear Address Record */
-				uint16_t upper_address;
-
-				sscanf(&lpszLine[bytes_read], "%4hx", &upper_address);
-				cal_checksum += (uint8_t)(upper_address >> 8);
-				cal_checksum += (uint8_t)upper_address;
-				bytes_read += 4;
+				if (count < 2)
+					return ERROR_IMAGE_FORMAT_ERROR;
+				uint16_t upper_address = be_to_h_u16(data);
 
 				if ((full_address >> 4) != upper_address) {
-					/* we encountered a nonconsecutive location, create a new section,
-					 * unless the current section has zero size, in which case this specifies
-					 * the current section's base address
-					 */
-					if (section[image->num_sections].size != 0) {
-						image->num_sections++;
-						if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-							/* too many sections */
-							LOG_ERROR("Too many sections found in IHEX file");
-							return ERROR_IMAGE_FORMAT_ERROR;
-						}
-						section[image->num_sections].size = 0x0;
-						section[image->num_sections].flags = 0;
-						section[image->num_sections].private =
-							&ihex->buffer[cooked_bytes];
-					}
-					section[image->num_sections].base_address =
-						(full_address & 0xffff) | (upper_address << 4);
+					/* we encountered a nonconsecutive location */
 					full_address = (full_address & 0xffff) | (upper_address << 4);
+					retval = image_hex_new_section(image, section, full_address);
+					if (retval != ERROR_OK)
+						return retval;
 				}
 			} else if (record_type == 3) {	/* Start Segment Address Record */
-				uint32_t dummy;
-
 				/* "Start Segment Address Record" will not be supported
 				 * but we must consume it, and do not create an error.  */
-				while (count-- > 0) {
-					sscanf(&lpszLine[bytes_read], "%2" SCNx32, &dummy);
-					cal_checksum += (uint8_t)dummy;
-					bytes_read += 2;
-				}
 			} else if (record_type == 4) {	/* Extended Linear Address Record */
-				uint16_t upper_address;
-
-				sscanf(&lpszLine[bytes_read], "%4hx", &upper_address);
-				cal_checksum += (uint8_t)(upper_address >> 8);
-				cal_checksum += (uint8_t)upper_address;
-				bytes_read += 4;
+				if (count < 2)
+					return ERROR_IMAGE_FORMAT_ERROR;
+				uint16_t upper_address = be_to_h_u16(data);
 
 				if ((full_address >> 16) != upper_address) {
-					/* we encountered a nonconsecutive location, create a new section,
-					 * unless the current section has zero size, in which case this specifies
-					 * the current section's base address
-					 */
-					if (section[image->num_sections].size != 0) {
-						image->num_sections++;
-						if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-							/* too many sections */
-							LOG_ERROR("Too many sections found in IHEX file");
-							return ERROR_IMAGE_FORMAT_ERROR;
-						}
-						section[image->num_sections].size = 0x0;
-						section[image->num_sections].flags = 0;
-						section[image->num_sections].private =
-							&ihex->buffer[cooked_bytes];
-					}
-					section[image->num_sections].base_address =
-						(full_address & 0xffff) | (upper_address << 16);
+					/* we encountered a nonconsecutive location */
 					full_address = (full_address & 0xffff) | (upper_address << 16);
+					retval = image_hex_new_section(image, section, full_address);
+					if (retval != ERROR_OK)
+						return retval;
 				}
 			} else if (record_type == 5) {	/* Start Linear Address Record */
-				uint32_t start_address;
-
-				sscanf(&lpszLine[bytes_read], "%8" SCNx32, &start_address);
-				cal_checksum += (uint8_t)(start_address >> 24);
-				cal_checksum += (uint8_t)(start_address >> 16);
-				cal_checksum += (uint8_t)(start_address >> 8);
-				cal_checksum += (uint8_t)start_address;
-				bytes_read += 8;
+				if (count < 4)
+					return ERROR_IMAGE_FORMAT_ERROR;
 
 				image->start_address_set = true;
-				image->start_address = be_to_h_u32((uint8_t *)&start_address);
+				image->start_address = be_to_h_u32(data);
 			} else {
 				LOG_ERROR("unhandled IHEX record type: %i", (int)record_type);
 				return ERROR_IMAGE_FORMAT_ERROR;
 			}
 
-			sscanf(&lpszLine[bytes_read], "%2" SCNx32, &checksum);
-
-			if ((uint8_t)checksum != (uint8_t)(~cal_checksum + 1)) {
-				/* checksum failed */
-				LOG_ERROR("incorrect record checksum found in IHEX file");
-				return ERROR_IMAGE_CHECKSUM;
-			}
-
 			if (end_rec) {
 				end_rec = false;
 				LOG_WARNING("continuing after end-of-file record: %.40s", lpszLine);
@@ -329,23 +308,22 @@ static int image_ihex_buffer_complete_inner(struct image *image,
  */
 static int image_ihex_buffer_complete(struct image *image)
 {
-	char *lpszLine = malloc(1023);
-	if (lpszLine == NULL) {
-		LOG_ERROR("Out of memory");
-		return ERROR_FAIL;
-	}
+	struct image_ihex *ihex = image->type_private;
 	struct imagesection *section = malloc(sizeof(struct imagesection) * IMAGE_MAX_SECTIONS);
-	if (section == NULL) {
-		free(lpszLine);
+	size_t *section_offsets = malloc(sizeof(size_t) * IMAGE_MAX_SECTIONS);
+	if (section == NULL || section_offsets == NULL) {
+		free(section);
+		free(section_offsets);
 		LOG_ERROR("Out of memory");
 		return ERROR_FAIL;
 	}
 	int retval;
 
-	retval = image_ihex_buffer_complete_inner(image, lpszLine, section);
+	retval = image_ihex_buffer_complete_inner(image, ihex->reader.line,
+			section, section_offsets);
 
+	free(section_offsets);
 	free(section);
-	free(lpszLine);
 
 	return retval;
 }
@@ -421,12 +399,21 @@ static int image_elf_read_headers(struct image *image)
 	}
 
 	/* count useful segments (loadable), ignore BSS section */
+	size_t filesize;
+	fileio_size(elf->fileio, &filesize);
 	image->num_sections = 0;
 	for (i = 0; i < elf->segment_count; i++)
 		if ((field32(elf,
 			elf->segments[i].p_type) == PT_LOAD) &&
-			(field32(elf, elf->segments[i].p_filesz) != 0))
+			(field32(elf, elf->segments[i].p_filesz) != 0)) {
+			uint32_t p_offset = field32(elf, elf->segments[i].p_offset);
+			uint32_t p_filesz = field32(elf, elf->segments[i].p_filesz);
+			if (p_offset > filesize || p_filesz > filesize - p_offset) {
+				LOG_ERROR("ELF segment %" PRIu32 " content beyond end of file", i);
+				return ERROR_IMAGE_FORMAT_ERROR;
+			}
 			image->num_sections++;
+		}
 
 	assert(image->num_sections > 0);
 
@@ -476,6 +463,198 @@ static int image_elf_read_headers(struct image *image)
 	return ERROR_OK;
 }
 
+/* read count bytes at offset of an ELF file into a newly allocated buffer */
+static int image_elf_read_alloc(struct image_elf *elf, uint32_t offset,
+	uint32_t count, uint8_t **buffer)
+{
+	size_t filesize, really_read;
+	int retval;
+
+	fileio_size(elf->fileio, &filesize);
+	if (offset > filesize || count > filesize - offset) {
+		LOG_ERROR("ELF file truncated");
+		return ERROR_IMAGE_FORMAT_ERROR;
+	}
+
+	*buffer = malloc(count);
+	if (!*buffer) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	if (elf->data) {
+		memcpy(*buffer, elf->data + offset, count);
+		return ERROR_OK;
+	}
+
+	retval = fileio_seek(elf->fileio, offset);
+	if (retval == ERROR_OK)
+		retval = fileio_read(elf->fileio, count, *buffer, &really_read);
+	if (retval == ERROR_OK && really_read != count)
+		retval = ERROR_FILEIO_OPERATION_FAILED;
+	if (retval != ERROR_OK) {
+		free(*buffer);
+		*buffer = NULL;
+	}
+
+	return retval;
+}
+
+/* Called for every defined symbol, returns true to stop the iteration. */
+typedef bool (*image_elf_symbol_cb)(const char *name, uint32_t value,
+		uint32_t size, uint8_t info, void *priv);
+
+static int image_elf_for_each_symbol(struct image *image,
+	image_elf_symbol_cb cb, void *priv)
+{
+	struct image_elf *elf = image->type_private;
+	uint32_t shnum = field16(elf, elf->header->e_shnum);
+	uint32_t shentsize = field16(elf, elf->header->e_shentsize);
+	uint8_t *shdrs = NULL;
+	bool stop = false;
+	int retval;
+
+	if (shnum == 0 || shentsize < sizeof(Elf32_Shdr))
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	retval = image_elf_read_alloc(elf, field32(elf, elf->header->e_shoff),
+			shnum * shentsize, &shdrs);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (uint32_t i = 0; i < shnum && !stop; i++) {
+		Elf32_Shdr *symtab = (Elf32_Shdr *)(shdrs + i * shentsize);
+		if (field32(elf, symtab->sh_type) != SHT_SYMTAB)
+			continue;
+
+		uint32_t link = field32(elf, symtab->sh_link);
+		if (link >= shnum)
+			continue;
+		Elf32_Shdr *strtab = (Elf32_Shdr *)(shdrs + link * shentsize);
+
+		uint8_t *syms, *strs;
+		uint32_t syms_size = field32(elf, symtab->sh_size);
+		uint32_t strs_size = field32(elf, strtab->sh_size);
+		if (image_elf_read_alloc(elf, field32(elf, symtab->sh_offset),
+				syms_size, &syms) != ERROR_OK)
+			continue;
+		if (image_elf_read_alloc(elf, field32(elf, strtab->sh_offset),
+				strs_size, &strs) != ERROR_OK) {
+			free(syms);
+			continue;
+		}
+
+		uint32_t entsize = field32(elf, symtab->sh_entsize);
+		if (entsize < sizeof(Elf32_Sym))
+			entsize = sizeof(Elf32_Sym);
+
+		for (uint32_t off = 0; off + sizeof(Elf32_Sym) <= syms_size && !stop; off += entsize) {
+			Elf32_Sym *sym = (Elf32_Sym *)(syms + off);
+			uint32_t st_name = field32(elf, sym->st_name);
+
+			/* skip undefined symbols and names not terminated in the table */
+			if (field16(elf, sym->st_shndx) == SHN_UNDEF ||
+					st_name >= strs_size ||
+					!memchr(strs + st_name, 0, strs_size - st_name))
+				continue;
+
+			stop = cb((const char *)strs + st_name, field32(elf, sym->st_value),
+					field32(elf, sym->st_size), sym->st_info, priv);
+		}
+
+		free(strs);
+		free(syms);
+	}
+
+	free(shdrs);
+
+	return ERROR_OK;
+}
+
+struct image_elf_find_symbol_ctx {
+	const char *name;
+	target_addr_t address;
+	bool found;
+};
+
+static bool image_elf_find_symbol_cb(const char *name, uint32_t value,
+		uint32_t size, uint8_t info, void *priv)
+{
+	struct image_elf_find_symbol_ctx *ctx = priv;
+
+	if (strcmp(name, ctx->name))
+		return false;
+
+	ctx->address = value;
+	ctx->found = true;
+	return true;
+}
+
+static int image_elf_find_symbol(struct image *image, const char *name,
+	target_addr_t *address)
+{
+	struct image_elf_find_symbol_ctx ctx = { .name = name };
+
+	int retval = image_elf_for_each_symbol(image, image_elf_find_symbol_cb, &ctx);
+	if (retval != ERROR_OK)
+		return retval;
+	if (!ctx.found)
+		return ERROR_FAIL;
+
+	*address = ctx.address;
+	return ERROR_OK;
+}
+
+struct image_elf_functions_ctx {
+	struct image_symbol *symbols;
+	unsigned int count;
+	unsigned int allocated;
+	int retval;
+};
+
+static bool image_elf_functions_cb(const char *name, uint32_t value,
+		uint32_t size, uint8_t info, void *priv)
+{
+	struct image_elf_functions_ctx *ctx = priv;
+
+	if (ELF32_ST_TYPE(info) != STT_FUNC || !*name)
+		return false;
+
+	if (ctx->count == ctx->allocated) {
+		unsigned int allocated = ctx->allocated ? ctx->allocated * 2 : 256;
+		struct image_symbol *symbols = realloc(ctx->symbols,
+				allocated * sizeof(*symbols));
+		if (!symbols) {
+			ctx->retval = ERROR_FAIL;
+			return true;
+		}
+		ctx->symbols = symbols;
+		ctx->allocated = allocated;
+	}
+
+	struct image_symbol *sym = &ctx->symbols[ctx->count];
+	sym->name = strdup(name);
+	if (!sym->name) {
+		ctx->retval = ERROR_FAIL;
+		return true;
+	}
+	/* bit 0 of ARM function symbols marks Thumb code */
+	sym->address = value & ~1u;
+	sym->size = size;
+	ctx->count++;
+
+	return false;
+}
+
+static int image_symbol_compare(const void *a, const void *b)
+{
+	const struct image_symbol *sa = a, *sb = b;
+
+	if (sa->address != sb->address)
+		return sa->address < sb->address ? -1 : 1;
+	return 0;
+}
+
 static int image_elf_read_section(struct image *image,
 	int section,
 	uint32_t offset,
@@ -499,6 +678,19 @@ static int image_elf_read_section(struct image *image,
 		LOG_DEBUG("read elf: size = 0x%zx at 0x%" PRIx32 "", read_size,
 			field32(elf, segment->p_offset) + offset);
 		/* read initialized area of the segment */
+		if (elf->data) {
+			size_t filesize, p_offset = field32(elf, segment->p_offset);
+			fileio_size(elf->fileio, &filesize);
+			/* no sums that could wrap, p_offset comes from the file */
+			if (p_offset > filesize || offset > filesize - p_offset ||
+					read_size > filesize - p_offset - offset) {
+				LOG_ERROR("ELF segment content beyond end of file");
+				return ERROR_IMAGE_FORMAT_ERROR;
+			}
+			memcpy(buffer, elf->data + p_offset + offset, read_size);
+			*size_read += read_size;
+			return ERROR_OK;
+		}
 		retval = fileio_seek(elf->fileio, field32(elf, segment->p_offset) + offset);
 		if (retval != ERROR_OK) {
 			LOG_ERROR("cannot find ELF segment content, seek failed");
@@ -519,148 +711,127 @@ static int image_elf_read_section(struct image *image,
 	return ERROR_OK;
 }
 
+/* Decode one S-record line into its type and record bytes: length,
+ * address, data and checksum. Comments and blank lines decode to an empty
+ * record. */
+static int image_mot_decode_line(const char *line, uint32_t *record_type,
+	uint8_t *record, uint32_t *record_len)
+{
+	*record_len = 0;
+
+	if (line[0] != 'S') {
+		/* skip comments and blank lines */
+		if ((line[0] == '#') || (strlen(line + strspn(line, "\n\t\r ")) == 0))
+			return ERROR_OK;
+		return ERROR_IMAGE_FORMAT_ERROR;
+	}
+
+	*record_type = hex_digit_value(line[1]);
+	if (*record_type > 0xf || unhexify(record, line + 2, 1) != 1)
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	/* the length byte counts address, data and checksum */
+	uint32_t len = 1 + record[0];
+	if (record[0] == 0 || unhexify(record, line + 2, len) != len)
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	/* all bytes including the checksum add up to 0xff */
+	uint8_t sum = 0;
+	for (uint32_t i = 0; i < len; i++)
+		sum += record[i];
+	if (sum != 0xff) {
+		LOG_ERROR("incorrect record checksum found in S19 file");
+		return ERROR_IMAGE_CHECKSUM;
+	}
+
+	*record_len = len;
+
+	return ERROR_OK;
+}
+
 static int image_mot_buffer_complete_inner(struct image *image,
 	char *lpszLine,
-	struct imagesection *section)
+	struct imagesection *section,
+	size_t *section_offsets)
 {
 	struct image_mot *mot = image->type_private;
 	struct fileio *fileio = mot->fileio;
+	uint8_t record[IMAGE_RECORD_MAX_BYTES];
+	uint32_t record_len;
+	uint32_t record_type;
 	uint32_t full_address;
-	uint32_t cooked_bytes;
+	size_t line_offset;
 	bool end_rec = false;
+	int retval;
 
 	/* we can't determine the number of sections that we'll have to create ahead of time,
 	 * so we locally hold them until parsing is finished */
 
-	int retval;
-	size_t filesize;
-	retval = fileio_size(fileio, &filesize);
-	if (retval != ERROR_OK)
-		return retval;
-
-	mot->buffer = malloc(filesize >> 1);
-	cooked_bytes = 0x0;
 	image->num_sections = 0;
 
 	while (!fileio_feof(fileio)) {
 		full_address = 0x0;
-		section[image->num_sections].private = &mot->buffer[cooked_bytes];
+		section[image->num_sections].private = NULL;
 		section[image->num_sections].base_address = 0x0;
 		section[image->num_sections].size = 0x0;
 		section[image->num_sections].flags = 0;
 
-		while (fileio_fgets(fileio, 1023, lpszLine) == ERROR_OK) {
-			uint32_t count;
-			uint32_t address;
-			uint32_t record_type;
-			uint32_t checksum;
-			uint8_t cal_checksum = 0;
-			uint32_t bytes_read = 0;
-
-			/* skip comments and blank lines */
-			if ((lpszLine[0] == '#') || (strlen(lpszLine + strspn(lpszLine, "\n\t\r ")) == 0))
+		while (fileio_tell(fileio, &line_offset) == ERROR_OK &&
+				fileio_fgets(fileio, 1023, lpszLine) == ERROR_OK) {
+			retval = image_mot_decode_line(lpszLine, &record_type, record, &record_len);
+			if (retval != ERROR_OK)
+				return retval;
+			if (record_len == 0)
 				continue;
 
-			/* get record type and record length */
-			if (sscanf(&lpszLine[bytes_read], "S%1" SCNx32 "%2" SCNx32, &record_type,
-				&count) != 2)
-				return ERROR_IMAGE_FORMAT_ERROR;
-
-			bytes_read += 4;
-			cal_checksum += (uint8_t)count;
-
-			/* skip checksum byte */
-			count -= 1;
-
 			if (record_type == 0) {
 				/* S0 - starting record (optional) */
-				int iValue;
-
-				while (count-- > 0) {
-					sscanf(&lpszLine[bytes_read], "%2x", &iValue);
-					cal_checksum += (uint8_t)iValue;
-					bytes_read += 2;
-				}
 			} else if (record_type >= 1 && record_type <= 3) {
-				switch (record_type) {
-					case 1:
-						/* S1 - 16 bit address data record */
-						sscanf(&lpszLine[bytes_read], "%4" SCNx32, &address);
-						cal_checksum += (uint8_t)(address >> 8);
-						cal_checksum += (uint8_t)address;
-						bytes_read += 4;
-						count -= 2;
-						break;
-
-					case 2:
-						/* S2 - 24 bit address data record */
-						sscanf(&lpszLine[bytes_read], "%6" SCNx32, &address);
-						cal_checksum += (uint8_t)(address >> 16);
-						cal_checksum += (uint8_t)(address >> 8);
-						cal_checksum += (uint8_t)address;
-						bytes_read += 6;
-						count -= 3;
-						break;
-
-					case 3:
-						/* S3 - 32 bit address data record */
-						sscanf(&lpszLine[bytes_read], "%8" SCNx32, &address);
-						cal_checksum += (uint8_t)(address >> 24);
-						cal_checksum += (uint8_t)(address >> 16);
-						cal_checksum += (uint8_t)(address >> 8);
-						cal_checksum += (uint8_t)address;
-						bytes_read += 8;
-						count -= 4;
-						break;
+				/* S1, S2, S3 - data record with 16, 24 and 32 bit address */
+				uint32_t address_len = record_type + 1;
+				if (record_len < 1 + address_len + 1)
+					return ERROR_IMAGE_FORMAT_ERROR;
 
-				}
+				uint32_t address = 0;
+				for (uint32_t i = 0; i < address_len; i++)
+					address = (address << 8) | record[1 + i];
+				uint32_t count = record_len - address_len - 2;
 
 				if (full_address != address) {
-					/* we encountered a nonconsecutive location, create a new section,
-					 * unless the current section has zero size, in which case this specifies
-					 * the current section's base address
-					 */
-					if (section[image->num_sections].size != 0) {
-						image->num_sections++;
-						section[image->num_sections].size = 0x0;
-						section[image->num_sections].flags = 0;
-						section[image->num_sections].private =
-							&mot->buffer[cooked_bytes];
-					}
-					section[image->num_sections].base_address = address;
+					/* we encountered a nonconsecutive location */
+					retval = image_hex_new_section(image, section, address);
+					if (retval != ERROR_OK)
+						return retval;
 					full_address = address;
 				}
 
-				while (count-- > 0) {
-					unsigned value;
-					sscanf(&lpszLine[bytes_read], "%2x", &value);
-					mot->buffer[cooked_bytes] = (uint8_t)value;
-					cal_checksum += (uint8_t)mot->buffer[cooked_bytes];
-					bytes_read += 2;
-					cooked_bytes += 1;
-					section[image->num_sections].size += 1;
-					full_address++;
-				}
+				/* the data is decoded again when the section is read */
+				if (section[image->num_sections].size == 0)
+					section_offsets[image->num_sections] = line_offset;
+
+				section[image->num_sections].size += count;
+				full_address += count;
 			} else if (record_type == 5 || record_type == 6) {
 				/* S5 and S6 are the data count records, we ignore them */
-				uint32_t dummy;
-
-				while (count-- > 0) {
-					sscanf(&lpszLine[bytes_read], "%2" SCNx32, &dummy);
-					cal_checksum += (uint8_t)dummy;
-					bytes_read += 2;
-				}
 			} else if (record_type >= 7 && record_type <= 9) {
 				/* S7, S8, S9 - ending records for 32, 24 and 16bit */
 				image->num_sections++;
 
 				/* copy section information */
+				free(image->sections);
+				free(mot->reader.section_offsets);
 				image->sections = malloc(sizeof(struct imagesection) * image->num_sections);
+				mot->reader.section_offsets = malloc(sizeof(size_t) * image->num_sections);
+				if (!image->sections || !mot->reader.section_offsets) {
+					LOG_ERROR("Out of memory");
+					return ERROR_FAIL;
+				}
 				for (unsigned int i = 0; i < image->num_sections; i++) {
 					image->sections[i].private = section[i].private;
 					image->sections[i].base_address = section[i].base_address;
 					image->sections[i].size = section[i].size;
 					image->sections[i].flags = section[i].flags;
+					mot->reader.section_offsets[i] = section_offsets[i];
 				}
 
 				end_rec = true;
@@ -670,16 +841,6 @@ static int image_mot_buffer_complete_inner(struct image *image,
 				return ERROR_IMAGE_FORMAT_ERROR;
 			}
 
-			/* account for checksum, will always be 0xFF */
-			sscanf(&lpszLine[bytes_read], "%2" SCNx32, &checksum);
-			cal_checksum += (uint8_t)checksum;
-
-			if (cal_checksum != 0xFF) {
-				/* checksum failed */
-				LOG_ERROR("incorrect record checksum found in S19 file");
-				return ERROR_IMAGE_CHECKSUM;
-			}
-
 			if (end_rec) {
 				end_rec = false;
 				LOG_WARNING("continuing after end-of-file record: %.40s", lpszLine);
@@ -701,27 +862,126 @@ static int image_mot_buffer_complete_inner(struct image *image,
  */
 static int image_mot_buffer_complete(struct image *image)
 {
-	char *lpszLine = malloc(1023);
-	if (lpszLine == NULL) {
-		LOG_ERROR("Out of memory");
-		return ERROR_FAIL;
-	}
+	struct image_mot *mot = image->type_private;
 	struct imagesection *section = malloc(sizeof(struct imagesection) * IMAGE_MAX_SECTIONS);
-	if (section == NULL) {
-		free(lpszLine);
+	size_t *section_offsets = malloc(sizeof(size_t) * IMAGE_MAX_SECTIONS);
+	if (section == NULL || section_offsets == NULL) {
+		free(section);
+		free(section_offsets);
 		LOG_ERROR("Out of memory");
 		return ERROR_FAIL;
 	}
 	int retval;
 
-	retval = image_mot_buffer_complete_inner(image, lpszLine, section);
+	retval = image_mot_buffer_complete_inner(image, mot->reader.line,
+			section, section_offsets);
 
+	free(section_offsets);
 	free(section);
-	free(lpszLine);
 
 	return retval;
 }
 
+/* Decode the payload of an IHEX data record, other records yield no data */
+static int image_ihex_record_data(const char *line, uint8_t *data, uint32_t *len)
+{
+	uint32_t record_len;
+	int retval;
+
+	*len = 0;
+
+	retval = image_ihex_decode_line(line, data, &record_len);
+	if (retval != ERROR_OK || record_len == 0 || data[3] != 0)
+		return retval;
+
+	*len = data[0];
+	memmove(data, &data[4], *len);
+
+	return ERROR_OK;
+}
+
+/* Decode the payload of an S1, S2 or S3 record, other records yield no data */
+static int image_mot_record_data(const char *line, uint8_t *data, uint32_t *len)
+{
+	uint32_t record_type, record_len;
+	int retval;
+
+	*len = 0;
+
+	retval = image_mot_decode_line(line, &record_type, data, &record_len);
+	if (retval != ERROR_OK || record_len == 0 || record_type < 1 || record_type > 3)
+		return retval;
+
+	/* length byte, address, checksum */
+	uint32_t header = 1 + record_type + 1;
+	if (record_len < header + 1)
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	*len = record_len - header - 1;
+	memmove(data, &data[header], *len);
+
+	return ERROR_OK;
+}
+
+/* Read section data of a hex or S-record file by decoding its records
+ * again. The records of a section are consecutive by construction, so the
+ * data records are simply concatenated starting at the section's first one. */
+static int image_record_read_section(struct fileio *fileio,
+	struct image_record_reader *reader,
+	int (*record_data)(const char *line, uint8_t *data, uint32_t *len),
+	int section, uint32_t offset, uint32_t size,
+	uint8_t *buffer, size_t *size_read)
+{
+	int retval;
+
+	*size_read = 0;
+
+	/* rewind unless this continues from where the last read left off */
+	if (reader->section != section || offset < reader->offset) {
+		retval = fileio_seek(fileio, reader->section_offsets[section]);
+		if (retval != ERROR_OK)
+			return retval;
+		reader->section = section;
+		reader->offset = 0;
+		reader->record_len = 0;
+		reader->record_pos = 0;
+	}
+
+	while (*size_read < size) {
+		if (reader->record_pos == reader->record_len) {
+			if (fileio_fgets(fileio, sizeof(reader->line), reader->line) != ERROR_OK) {
+				LOG_ERROR("unexpected end of image file");
+				reader->section = -1;
+				return ERROR_IMAGE_FORMAT_ERROR;
+			}
+			retval = record_data(reader->line, reader->record, &reader->record_len);
+			if (retval != ERROR_OK) {
+				reader->section = -1;
+				return retval;
+			}
+			reader->record_pos = 0;
+			continue;
+		}
+
+		uint32_t avail = reader->record_len - reader->record_pos;
+		if (reader->offset < offset) {
+			/* skip data before the requested offset */
+			uint32_t skip = MIN(avail, offset - reader->offset);
+			reader->record_pos += skip;
+			reader->offset += skip;
+			continue;
+		}
+
+		uint32_t chunk = MIN(avail, size - *size_read);
+		memcpy(buffer + *size_read, reader->record + reader->record_pos, chunk);
+		reader->record_pos += chunk;
+		reader->offset += chunk;
+		*size_read += chunk;
+	}
+
+	return ERROR_OK;
+}
+
 int image_open(struct image *image, const char *url, const char *type_string)
 {
 	int retval = ERROR_OK;
@@ -733,7 +993,7 @@ int image_open(struct image *image, const char *url, const char *type_string)
 	if (image->type == IMAGE_BINARY) {
 		struct image_binary *image_binary;
 
-		image_binary = image->type_private = malloc(sizeof(struct image_binary));
+		image_binary = image->type_private = calloc(1, sizeof(struct image_binary));
 
 		retval = fileio_open(&image_binary->fileio, url, FILEIO_READ, FILEIO_BINARY);
 		if (retval != ERROR_OK)
@@ -745,6 +1005,10 @@ int image_open(struct image *image, const char *url, const char *type_string)
 			return retval;
 		}
 
+		/* not mapping the file is fine, sections are read from it then */
+		if (fileio_map(image_binary->fileio, &image_binary->data) != ERROR_OK)
+			image_binary->data = NULL;
+
 		image->num_sections = 1;
 		image->sections = malloc(sizeof(struct imagesection));
 		image->sections[0].base_address = 0x0;
@@ -753,7 +1017,8 @@ int image_open(struct image *image, const char *url, const char *type_string)
 	} else if (image->type == IMAGE_IHEX) {
 		struct image_ihex *image_ihex;
 
-		image_ihex = image->type_private = malloc(sizeof(struct image_ihex));
+		image_ihex = image->type_private = calloc(1, sizeof(struct image_ihex));
+		image_ihex->reader.section = -1;
 
 		retval = fileio_open(&image_ihex->fileio, url, FILEIO_READ, FILEIO_TEXT);
 		if (retval != ERROR_OK)
@@ -764,12 +1029,17 @@ int image_open(struct image *image, const char *url, const char *type_string)
 			LOG_ERROR(
 				"failed buffering IHEX image, check server output for additional information");
 			fileio_close(image_ihex->fileio);
+			free(image_ihex->reader.section_offsets);
+			free(image->sections);
+			image->sections = NULL;
+			free(image_ihex);
+			image->type_private = NULL;
 			return retval;
 		}
 	} else if (image->type == IMAGE_ELF) {
 		struct image_elf *image_elf;
 
-		image_elf = image->type_private = malloc(sizeof(struct image_elf));
+		image_elf = image->type_private = calloc(1, sizeof(struct image_elf));
 
 		retval = fileio_open(&image_elf->fileio, url, FILEIO_READ, FILEIO_BINARY);
 		if (retval != ERROR_OK)
@@ -780,6 +1050,9 @@ int image_open(struct image *image, const char *url, const char *type_string)
 			fileio_close(image_elf->fileio);
 			return retval;
 		}
+
+		if (fileio_map(image_elf->fileio, &image_elf->data) != ERROR_OK)
+			image_elf->data = NULL;
 	} else if (image->type == IMAGE_MEMORY) {
 		struct target *target = get_target(url);
 
@@ -804,7 +1077,8 @@ int image_open(struct image *image, const char *url, const char *type_string)
 	} else if (image->type == IMAGE_SRECORD) {
 		struct image_mot *image_mot;
 
-		image_mot = image->type_private = malloc(sizeof(struct image_mot));
+		image_mot = image->type_private = calloc(1, sizeof(struct image_mot));
+		image_mot->reader.section = -1;
 
 		retval = fileio_open(&image_mot->fileio, url, FILEIO_READ, FILEIO_TEXT);
 		if (retval != ERROR_OK)
@@ -815,13 +1089,20 @@ int image_open(struct image *image, const char *url, const char *type_string)
 			LOG_ERROR(
 				"failed buffering S19 image, check server output for additional information");
 			fileio_close(image_mot->fileio);
+			free(image_mot->reader.section_offsets);
+			free(image->sections);
+			image->sections = NULL;
+			free(image_mot);
+			image->type_private = NULL;
 			return retval;
 		}
 	} else if (image->type == IMAGE_BUILDER) {
 		image->num_sections = 0;
 		image->base_address_set = false;
 		image->sections = NULL;
-		image->type_private = NULL;
+		image->type_private = calloc(1, sizeof(struct image_builder));
+		if (!image->type_private)
+			return ERROR_FAIL;
 	}
 
 	if (image->base_address_set) {
@@ -864,6 +1145,12 @@ int image_read_section(struct image *image,
 		if (section != 0)
 			return ERROR_COMMAND_SYNTAX_ERROR;
 
+		if (image_binary->data) {
+			memcpy(buffer, image_binary->data + offset, size);
+			*size_read = size;
+			return ERROR_OK;
+		}
+
 		/* seek to offset */
 		retval = fileio_seek(image_binary->fileio, offset);
 		if (retval != ERROR_OK)
@@ -874,10 +1161,11 @@ int image_read_section(struct image *image,
 		if (retval != ERROR_OK)
 			return retval;
 	} else if (image->type == IMAGE_IHEX) {
-		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
-		*size_read = size;
+		struct image_ihex *image_ihex = image->type_private;
 
-		return ERROR_OK;
+		return image_record_read_section(image_ihex->fileio,
+				&image_ihex->reader, image_ihex_record_data,
+				section, offset, size, buffer, size_read);
 	} else if (image->type == IMAGE_ELF)
 		return image_elf_read_section(image, section, offset, size, buffer, size_read);
 	else if (image->type == IMAGE_MEMORY) {
@@ -919,10 +1207,11 @@ int image_read_section(struct image *image,
 			address += (size_in_cache > size) ? size : size_in_cache;
 		}
 	} else if (image->type == IMAGE_SRECORD) {
-		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
-		*size_read = size;
+		struct image_mot *image_mot = image->type_private;
 
-		return ERROR_OK;
+		return image_record_read_section(image_mot->fileio,
+				&image_mot->reader, image_mot_record_data,
+				section, offset, size, buffer, size_read);
 	} else if (image->type == IMAGE_BUILDER) {
 		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
 		*size_read = size;
@@ -933,8 +1222,87 @@ int image_read_section(struct image *image,
 	return ERROR_OK;
 }
 
+/**
+ * Look up the address of a symbol in the symbol table of an ELF image.
+ *
+ * @returns ERROR_OK if the symbol was found, ERROR_FAIL if it was not, or
+ * another error code if the image has no usable symbol table.
+ */
+int image_find_symbol(struct image *image, const char *name,
+	target_addr_t *address)
+{
+	if (image->type != IMAGE_ELF) {
+		LOG_ERROR("symbols can only be looked up in ELF images");
+		return ERROR_IMAGE_TYPE_UNKNOWN;
+	}
+
+	return image_elf_find_symbol(image, name, address);
+}
+
+int image_get_functions(struct image *image, struct image_symbol **symbols,
+	unsigned int *count)
+{
+	struct image_elf_functions_ctx ctx = { .retval = ERROR_OK };
+
+	*symbols = NULL;
+	*count = 0;
+
+	if (image->type != IMAGE_ELF) {
+		LOG_ERROR("symbols can only be read from ELF images");
+		return ERROR_IMAGE_TYPE_UNKNOWN;
+	}
+
+	int retval = image_elf_for_each_symbol(image, image_elf_functions_cb, &ctx);
+	if (retval == ERROR_OK)
+		retval = ctx.retval;
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Out of memory");
+		image_free_symbols(ctx.symbols, ctx.count);
+		return retval;
+	}
+
+	qsort(ctx.symbols, ctx.count, sizeof(*ctx.symbols), image_symbol_compare);
+
+	*symbols = ctx.symbols;
+	*count = ctx.count;
+	return ERROR_OK;
+}
+
+const struct image_symbol *image_symbol_lookup(const struct image_symbol *symbols,
+	unsigned int count, target_addr_t address)
+{
+	unsigned int lo = 0, hi = count;
+
+	/* find the last symbol starting at or below address */
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (symbols[mid].address <= address)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == 0)
+		return NULL;
+
+	/* a symbol without size extends up to the next one */
+	const struct image_symbol *sym = &symbols[lo - 1];
+	if (sym->size ? address - sym->address >= sym->size : lo == count)
+		return NULL;
+
+	return sym;
+}
+
+void image_free_symbols(struct image_symbol *symbols, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++)
+		free(symbols[i].name);
+	free(symbols);
+}
+
 int image_add_section(struct image *image, uint32_t base, uint32_t size, int flags, uint8_t const *data)
 {
+	struct image_builder *image_builder = image->type_private;
 	struct imagesection *section;
 
 	/* only image builder supports adding sections */
@@ -949,7 +1317,18 @@ int image_add_section(struct image *image, uint32_t base, uint32_t size, int fla
 		 * adding data to previous sections or merging is not supported */
 		if (((section->base_address + section->size) == base) &&
 			(section->flags == flags)) {
-			section->private = realloc(section->private, section->size + size);
+			/* GDB sends a large download as a stream of small contiguous
+			 * chunks, grow geometrically to avoid a realloc per chunk */
+			if (section->size + size > image_builder->capacity) {
+				uint32_t capacity = MAX(image_builder->capacity * 2, section->size + size);
+				void *private = realloc(section->private, capacity);
+				if (!private) {
+					LOG_ERROR("Out of memory");
+					return ERROR_FAIL;
+				}
+				section->private = private;
+				image_builder->capacity = capacity;
+			}
 			memcpy((uint8_t *)section->private + section->size, data, size);
 			section->size += size;
 			return ERROR_OK;
@@ -957,15 +1336,25 @@ int image_add_section(struct image *image, uint32_t base, uint32_t size, int fla
 	}
 
 	/* allocate new section */
+	struct imagesection *sections = realloc(image->sections,
+			sizeof(struct imagesection) * (image->num_sections + 1));
+	if (!sections) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	image->sections = sections;
+	section = &image->sections[image->num_sections];
+	section->private = malloc(sizeof(uint8_t) * size);
+	if (!section->private) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 	image->num_sections++;
-	image->sections =
-		realloc(image->sections, sizeof(struct imagesection) * image->num_sections);
-	section = &image->sections[image->num_sections - 1];
 	section->base_address = base;
 	section->size = size;
 	section->flags = flags;
-	section->private = malloc(sizeof(uint8_t) * size);
 	memcpy((uint8_t *)section->private, data, size);
+	image_builder->capacity = size;
 
 	return ERROR_OK;
 }
@@ -981,8 +1370,8 @@ void image_close(struct image *image)
 
 		fileio_close(image_ihex->fileio);
 
-		free(image_ihex->buffer);
-		image_ihex->buffer = NULL;
+		free(image_ihex->reader.section_offsets);
+		image_ihex->reader.section_offsets = NULL;
 	} else if (image->type == IMAGE_ELF) {
 		struct image_elf *image_elf = image->type_private;
 
@@ -1003,8 +1392,8 @@ void image_close(struct image *image)
 
 		fileio_close(image_mot->fileio);
 
-		free(image_mot->buffer);
-		image_mot->buffer = NULL;
+		free(image_mot->reader.section_offsets);
+		image_mot->reader.section_offsets = NULL;
 	} else if (image->type == IMAGE_BUILDER) {
 		for (unsigned int i = 0; i < image->num_sections; i++) {
 			free(image->sections[i].private);
@@ -1019,36 +1408,71 @@ void image_close(struct image *image)
 	image->sections = NULL;
 }
 
-int image_calculate_checksum(const uint8_t *buffer, uint32_t nbytes, uint32_t *checksum)
+/* CRC-32 as used by GDB (polynomial 0x04c11db7, MSB first, no reflection).
+ * Table k holds the CRC of byte i followed by k zero bytes, which allows
+ * folding eight input bytes per step (slicing-by-8). */
+static uint32_t crc32_table[8][256];
+
+static void image_crc32_init(void)
 {
-	uint32_t crc = 0xffffffff;
-	LOG_DEBUG("Calculating checksum");
+	static bool first_init;
 
-	static uint32_t crc32_table[256];
+	if (first_init)
+		return;
 
-	static bool first_init;
-	if (!first_init) {
-		/* Initialize the CRC table and the decoding table.  */
-		unsigned int i, j, c;
-		for (i = 0; i < 256; i++) {
-			/* as per gdb */
-			for (c = i << 24, j = 8; j > 0; --j)
-				c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
-			crc32_table[i] = c;
-		}
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t c = i << 24;
+		/* as per gdb */
+		for (unsigned int j = 8; j > 0; --j)
+			c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
+		crc32_table[0][i] = c;
+	}
+
+	for (unsigned int k = 1; k < 8; k++)
+		for (unsigned int i = 0; i < 256; i++)
+			crc32_table[k][i] = (crc32_table[k - 1][i] << 8)
+				^ crc32_table[0][crc32_table[k - 1][i] >> 24];
+
+	first_init = true;
+}
+
+static uint32_t image_crc32_update(uint32_t crc, const uint8_t *buffer, uint32_t nbytes)
+{
+	while (nbytes >= 8) {
+		uint32_t hi = crc ^ be_to_h_u32(buffer);
+		uint32_t lo = be_to_h_u32(buffer + 4);
+
+		crc = crc32_table[7][hi >> 24] ^ crc32_table[6][(hi >> 16) & 0xff]
+			^ crc32_table[5][(hi >> 8) & 0xff] ^ crc32_table[4][hi & 0xff]
+			^ crc32_table[3][lo >> 24] ^ crc32_table[2][(lo >> 16) & 0xff]
+			^ crc32_table[1][(lo >> 8) & 0xff] ^ crc32_table[0][lo & 0xff];
+
+		buffer += 8;
+		nbytes -= 8;
+	}
 
-		first_init = true;
+	while (nbytes--) {
+		/* as per gdb */
+		crc = (crc << 8) ^ crc32_table[0][((crc >> 24) ^ *buffer++) & 255];
 	}
 
+	return crc;
+}
+
+int image_calculate_checksum(const uint8_t *buffer, uint32_t nbytes, uint32_t *checksum)
+{
+	uint32_t crc = 0xffffffff;
+	LOG_DEBUG("Calculating checksum");
+
+	image_crc32_init();
+
 	while (nbytes > 0) {
-		int run = nbytes;
-		if (run > 32768)
-			run = 32768;
+		uint32_t run = nbytes;
+		if (run > 256 * 1024)
+			run = 256 * 1024;
+		crc = image_crc32_update(crc, buffer, run);
+		buffer += run;
 		nbytes -= run;
-		while (run--) {
-			/* as per gdb */
-			crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *buffer++) & 255];
-		}
 		keep_alive();
 	}
 
@@ -36,6 +36,9 @@
 
 #define IMAGE_MEMORY_CACHE_SIZE		(2048)
 
+/* largest decoded IHEX or S-record record, including its header bytes */
+#define IMAGE_RECORD_MAX_BYTES		(260)
+
 enum image_type {
 	IMAGE_BINARY,	/* plain binary */
 	IMAGE_IHEX,		/* intel hex-record format */
@@ -65,11 +68,26 @@ struct image {
 
 struct image_binary {
 	struct fileio *fileio;
+	const uint8_t *data;	/* mapped file contents, NULL if not mapped */
+};
+
+/* Hex and S-record files are not decoded into memory at open time. Opening
+ * only validates the records and notes where each section starts in the
+ * file; section data is decoded when read. Reads are normally sequential,
+ * so the position of the previous read is kept to continue from there. */
+struct image_record_reader {
+	size_t *section_offsets;	/* file offset of each section's first data record */
+	int section;		/* section of the current position, -1 if none */
+	uint32_t offset;	/* section offset of the next byte in record[] */
+	uint8_t record[IMAGE_RECORD_MAX_BYTES];	/* data of the record being consumed */
+	uint32_t record_len;
+	uint32_t record_pos;
+	char line[1023];
 };
 
 struct image_ihex {
 	struct fileio *fileio;
-	uint8_t *buffer;
+	struct image_record_reader reader;
 };
 
 struct image_memory {
@@ -80,6 +98,7 @@ struct image_memory {
 
 struct image_elf {
 	struct fileio *fileio;
+	const uint8_t *data;	/* mapped file contents, NULL if not mapped */
 	Elf32_Ehdr *header;
 	Elf32_Phdr *segments;
 	uint32_t segment_count;
@@ -88,7 +107,11 @@ struct image_elf {
 
 struct image_mot {
 	struct fileio *fileio;
-	uint8_t *buffer;
+	struct image_record_reader reader;
+};
+
+struct image_builder {
+	uint32_t capacity;	/* bytes allocated for the last section's data */
 };
 
 int image_open(struct image *image, const char *url, const char *type_string);
@@ -96,6 +119,22 @@ int image_read_section(struct image *image, int section, uint32_t offset,
 		uint32_t size, uint8_t *buffer, size_t *size_read);
 void image_close(struct image *image);
 
+int image_find_symbol(struct image *image, const char *name,
+		target_addr_t *address);
+
+struct image_symbol {
+	char *name;
+	target_addr_t address;
+	uint32_t size;		/* 0 if unknown */
+};
+
+/* Read all function symbols of an ELF image, sorted by address. */
+int image_get_functions(struct image *image, struct image_symbol **symbols,
+		unsigned int *count);
+const struct image_symbol *image_symbol_lookup(const struct image_symbol *symbols,
+		unsigned int count, target_addr_t address);
+void image_free_symbols(struct image_symbol *symbols, unsigned int count);
+
 int image_add_section(struct image *image, uint32_t base, uint32_t size,
 		int flags, uint8_t const *data);
 
@@ -0,0 +1,466 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <helper/command.h>
+
+#include "target.h"
+#include "memcache.h"
+
+#define MEMCACHE_DEFAULT_LINE_SIZE	64
+#define MEMCACHE_DEFAULT_NUM_LINES	256
+#define MEMCACHE_MAX_LINE_SIZE		4096
+
+static struct memcache *memcache_get(struct target *target)
+{
+	struct memcache *cache = target->memcache;
+
+	if (cache)
+		return cache;
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache) {
+		LOG_ERROR("Out of memory");
+		return NULL;
+	}
+
+	cache->line_size = MEMCACHE_DEFAULT_LINE_SIZE;
+	cache->num_lines = MEMCACHE_DEFAULT_NUM_LINES;
+	cache->epoch = 1;
+	target->memcache = cache;
+
+	return cache;
+}
+
+static void memcache_release_lines(struct memcache *cache)
+{
+	free(cache->lines);
+	cache->lines = NULL;
+	free(cache->data);
+	cache->data = NULL;
+}
+
+static int memcache_alloc_lines(struct memcache *cache)
+{
+	memcache_release_lines(cache);
+
+	cache->lines = calloc(cache->num_lines, sizeof(*cache->lines));
+	cache->data = malloc((size_t)cache->num_lines * cache->line_size);
+	if (!cache->lines || !cache->data) {
+		memcache_release_lines(cache);
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	cache->epoch = 1;
+
+	return ERROR_OK;
+}
+
+static bool memcache_is_cacheable(const struct memcache *cache,
+		target_addr_t address, uint32_t size)
+{
+	if (!cache->num_regions)
+		return true;
+
+	for (unsigned int i = 0; i < cache->num_regions; i++) {
+		const struct memcache_region *region = &cache->regions[i];
+
+		if (address >= region->start
+				&& address + size - 1 <= region->start + region->size - 1)
+			return true;
+	}
+
+	return false;
+}
+
+static unsigned int memcache_index(const struct memcache *cache,
+		target_addr_t line_address)
+{
+	return (line_address / cache->line_size) % cache->num_lines;
+}
+
+/* Returns the cached copy of the line at line_address, filling it from the
+ * target on a miss. NULL means the line could not be read as a whole. */
+static const uint8_t *memcache_get_line(struct target *target,
+		struct memcache *cache, target_addr_t line_address)
+{
+	unsigned int index = memcache_index(cache, line_address);
+	struct memcache_line *line = &cache->lines[index];
+	uint8_t *data = cache->data + (size_t)index * cache->line_size;
+
+	if (line->epoch == cache->epoch && line->address == line_address) {
+		cache->hits++;
+		return data;
+	}
+
+	cache->misses++;
+
+	/* drop the slot before refilling so a failed read leaves nothing stale */
+	line->epoch = 0;
+	if (target_read_buffer(target, line_address, cache->line_size, data) != ERROR_OK)
+		return NULL;
+
+	line->address = line_address;
+	line->epoch = cache->epoch;
+
+	return data;
+}
+
+/**
+ * Read target memory, serving whole cache lines from the host copy while the
+ * target stays halted. Behaves like target_read_buffer() otherwise.
+ */
+int memcache_read_buffer(struct target *target, target_addr_t address,
+		uint32_t size, uint8_t *buffer)
+{
+	struct memcache *cache = target->memcache;
+
+	if (!cache || !cache->enabled || !cache->lines
+			|| target->state != TARGET_HALTED
+			|| size == 0 || (address + size - 1) < address)
+		return target_read_buffer(target, address, size, buffer);
+
+	const target_addr_t line_mask = ~(target_addr_t)(cache->line_size - 1);
+
+	while (size > 0) {
+		target_addr_t line_address = address & line_mask;
+		uint32_t offset = address - line_address;
+		uint32_t chunk = MIN(size, cache->line_size - offset);
+		int retval;
+
+		if (!memcache_is_cacheable(cache, line_address, cache->line_size)) {
+			/* pass consecutive uncacheable lines through as one read */
+			while (chunk < size && !memcache_is_cacheable(cache,
+						address + chunk, cache->line_size))
+				chunk += MIN(size - chunk, cache->line_size);
+
+			cache->bypassed++;
+			retval = target_read_buffer(target, address, chunk, buffer);
+			if (retval != ERROR_OK)
+				return retval;
+		} else {
+			const uint8_t *data = memcache_get_line(target, cache, line_address);
+
+			if (data) {
+				memcpy(buffer, data + offset, chunk);
+			} else {
+				/* the line may reach into unreadable memory, retry just our part */
+				retval = target_read_buffer(target, address, chunk, buffer);
+				if (retval != ERROR_OK)
+					return retval;
+			}
+		}
+
+		address += chunk;
+		buffer += chunk;
+		size -= chunk;
+	}
+
+	return ERROR_OK;
+}
+
+/** Start a new halt epoch, dropping every cached line. */
+void memcache_invalidate(struct target *target)
+{
+	struct memcache *cache = target->memcache;
+
+	if (!cache || !cache->lines)
+		return;
+
+	cache->invalidations++;
+
+	if (++cache->epoch == 0) {
+		/* epoch wrapped, make sure no old line becomes valid again */
+		for (unsigned int i = 0; i < cache->num_lines; i++)
+			cache->lines[i].epoch = 0;
+		cache->epoch = 1;
+	}
+}
+
+/** Drop the cached lines overlapping [address, address + size). */
+void memcache_invalidate_range(struct target *target, target_addr_t address,
+		uint32_t size)
+{
+	struct memcache *cache = target->memcache;
+
+	if (!cache || !cache->lines || size == 0)
+		return;
+
+	target_addr_t first = address & ~(target_addr_t)(cache->line_size - 1);
+	target_addr_t last = (address + size - 1) & ~(target_addr_t)(cache->line_size - 1);
+
+	if (last < first || (last - first) / cache->line_size >= cache->num_lines) {
+		memcache_invalidate(target);
+		return;
+	}
+
+	for (target_addr_t line_address = first; ; line_address += cache->line_size) {
+		struct memcache_line *line = &cache->lines[memcache_index(cache, line_address)];
+
+		if (line->address == line_address)
+			line->epoch = 0;
+
+		if (line_address == last)
+			break;
+	}
+}
+
+void memcache_free(struct target *target)
+{
+	struct memcache *cache = target->memcache;
+
+	if (!cache)
+		return;
+
+	memcache_release_lines(cache);
+	free(cache->regions);
+	free(cache);
+	target->memcache = NULL;
+}
+
+COMMAND_HANDLER(handle_memcache_enable_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct memcache *cache = memcache_get(target);
+
+	if (!cache)
+		return ERROR_FAIL;
+
+	if (CMD_ARGC)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!cache->lines) {
+		int retval = memcache_alloc_lines(cache);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	cache->enabled = true;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_disable_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct memcache *cache = target->memcache;
+
+	if (CMD_ARGC)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (cache) {
+		memcache_release_lines(cache);
+		cache->enabled = false;
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_geometry_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct memcache *cache = memcache_get(target);
+	uint32_t line_size, num_lines;
+
+	if (!cache)
+		return ERROR_FAIL;
+
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "%" PRIu32 " lines of %" PRIu32 " bytes",
+				cache->num_lines, cache->line_size);
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], line_size);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], num_lines);
+
+	if (line_size < 4 || line_size > MEMCACHE_MAX_LINE_SIZE
+			|| (line_size & (line_size - 1))) {
+		command_print(CMD, "line size must be a power of 2 between 4 and %d",
+				MEMCACHE_MAX_LINE_SIZE);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	if (num_lines == 0) {
+		command_print(CMD, "number of lines must be at least 1");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	cache->line_size = line_size;
+	cache->num_lines = num_lines;
+
+	if (cache->enabled)
+		return memcache_alloc_lines(cache);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_region_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct memcache *cache = memcache_get(target);
+
+	if (!cache)
+		return ERROR_FAIL;
+
+	if (CMD_ARGC == 0) {
+		if (!cache->num_regions)
+			command_print(CMD, "all memory is cacheable");
+
+		for (unsigned int i = 0; i < cache->num_regions; i++)
+			command_print(CMD, TARGET_ADDR_FMT " size " TARGET_ADDR_FMT,
+					cache->regions[i].start, cache->regions[i].size);
+
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC == 1 && !strcmp(CMD_ARGV[0], "clear")) {
+		free(cache->regions);
+		cache->regions = NULL;
+		cache->num_regions = 0;
+		memcache_invalidate(target);
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 3 || strcmp(CMD_ARGV[0], "add"))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct memcache_region region;
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[1], region.start);
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[2], region.size);
+
+	if (region.size == 0)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	struct memcache_region *regions = realloc(cache->regions,
+			(cache->num_regions + 1) * sizeof(*regions));
+	if (!regions) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	regions[cache->num_regions++] = region;
+	cache->regions = regions;
+
+	/* lines outside the previous region set may now be cached, start over */
+	memcache_invalidate(target);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_flush_command)
+{
+	if (CMD_ARGC)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	memcache_invalidate(get_current_target(CMD_CTX));
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_stats_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct memcache *cache = target->memcache;
+
+	if (CMD_ARGC > 1 || (CMD_ARGC == 1 && strcmp(CMD_ARGV[0], "reset")))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!cache) {
+		command_print(CMD, "memory cache not configured");
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC == 1) {
+		cache->hits = 0;
+		cache->misses = 0;
+		cache->bypassed = 0;
+		cache->invalidations = 0;
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "memory cache %s", cache->enabled ? "enabled" : "disabled");
+	command_print(CMD, "hits: %" PRIu64 ", misses: %" PRIu64
+			", bypassed: %" PRIu64 ", invalidations: %" PRIu64,
+			cache->hits, cache->misses, cache->bypassed, cache->invalidations);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration memcache_subcommand_handlers[] = {
+	{
+		.name = "enable",
+		.handler = handle_memcache_enable_command,
+		.mode = COMMAND_ANY,
+		.help = "enable caching of memory read by GDB",
+		.usage = "",
+	},
+	{
+		.name = "disable",
+		.handler = handle_memcache_disable_command,
+		.mode = COMMAND_ANY,
+		.help = "disable caching of memory read by GDB",
+		.usage = "",
+	},
+	{
+		.name = "geometry",
+		.handler = handle_memcache_geometry_command,
+		.mode = COMMAND_ANY,
+		.help = "set line size in bytes and number of cache lines",
+		.usage = "[line_size num_lines]",
+	},
+	{
+		.name = "region",
+		.handler = handle_memcache_region_command,
+		.mode = COMMAND_ANY,
+		.help = "list, add or clear cacheable address ranges",
+		.usage = "['add' address size | 'clear']",
+	},
+	{
+		.name = "flush",
+		.handler = handle_memcache_flush_command,
+		.mode = COMMAND_EXEC,
+		.help = "drop all cached memory contents",
+		.usage = "",
+	},
+	{
+		.name = "stats",
+		.handler = handle_memcache_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "display or reset the memory cache counters",
+		.usage = "['reset']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+const struct command_registration memcache_target_command_handlers[] = {
+	{
+		.name = "memcache",
+		.mode = COMMAND_ANY,
+		.help = "host side cache of target memory read by GDB",
+		.usage = "",
+		.chain = memcache_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,74 @@
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_TARGET_MEMCACHE_H
+#define OPENOCD_TARGET_MEMCACHE_H
+
+#include <helper/types.h>
+
+struct target;
+struct command_registration;
+
+/**
+ * @file
+ * Host side cache of target memory contents.
+ *
+ * The cache is only used while the target is halted. Every line is tagged
+ * with the halt epoch it was filled in; anything that may change target
+ * memory behind our back (resume, step, reset, running an algorithm, any
+ * target event) starts a new epoch and thereby drops all lines at once.
+ * Memory writes done through the target layer only drop the affected lines.
+ */
+
+struct memcache_region {
+	target_addr_t start;
+	target_addr_t size;
+};
+
+struct memcache_line {
+	target_addr_t address;
+	uint32_t epoch;
+};
+
+struct memcache {
+	bool enabled;
+	uint32_t line_size;
+	uint32_t num_lines;
+	/** current halt epoch, lines filled in a different epoch are stale */
+	uint32_t epoch;
+	struct memcache_line *lines;
+	uint8_t *data;
+
+	/** cacheable address ranges; if none are given everything is cacheable */
+	struct memcache_region *regions;
+	unsigned int num_regions;
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t bypassed;
+	uint64_t invalidations;
+};
+
+int memcache_read_buffer(struct target *target, target_addr_t address,
+		uint32_t size, uint8_t *buffer);
+void memcache_invalidate(struct target *target);
+void memcache_invalidate_range(struct target *target, target_addr_t address,
+		uint32_t size);
+void memcache_free(struct target *target);
+
+extern const struct command_registration memcache_target_command_handlers[];
+
+#endif /* OPENOCD_TARGET_MEMCACHE_H */
@@ -15,6 +15,14 @@
 #define DMI_SCAN_MAX_BIT_LENGTH (DTM_DMI_MAX_ADDRESS_LENGTH + DTM_DMI_DATA_LENGTH + DTM_DMI_OP_LENGTH)
 #define DMI_SCAN_BUF_SIZE (DIV_ROUND_UP(DMI_SCAN_MAX_BIT_LENGTH, 8))
 
+/* TCK cycles a batch should take at most, and the range of scans in a batch. */
+#define BATCH_MAX_CYCLES	65536
+#define BATCH_MIN_SCANS		32
+#define BATCH_MAX_SCANS		1024
+
+/* TAP state transitions from Run-Test/Idle through a DR scan and back */
+#define DR_SCAN_OVERHEAD	5
+
 static void dump_field(int idle, const struct scan_field *field);
 
 struct riscv_batch *riscv_batch_alloc(struct target *target, size_t scans, size_t idle)
@@ -60,6 +68,18 @@ error0:
 	return NULL;
 }
 
+size_t riscv_batch_size(struct target *target, size_t idle)
+{
+	size_t cycles = riscv_dmi_write_u64_bits(target) + DR_SCAN_OVERHEAD + idle;
+	size_t scans = BATCH_MAX_CYCLES / cycles;
+
+	if (scans < BATCH_MIN_SCANS)
+		return BATCH_MIN_SCANS;
+	if (scans > BATCH_MAX_SCANS)
+		return BATCH_MAX_SCANS;
+	return scans;
+}
+
 void riscv_batch_free(struct riscv_batch *batch)
 {
 	free(batch->data_in);
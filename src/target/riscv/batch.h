@@ -52,6 +52,12 @@ struct riscv_batch {
 struct riscv_batch *riscv_batch_alloc(struct target *target, size_t scans, size_t idle);
 void riscv_batch_free(struct riscv_batch *batch);
 
+/* Returns a good number of scans for a batch of DMI accesses with "idle" idle
+ * cycles between scans. Larger batches amortize the per-queue overhead of the
+ * adapter, but the batch is kept short enough in TCK cycles that a busy
+ * response doesn't waste too much work. */
+size_t riscv_batch_size(struct target *target, size_t idle);
+
 /* Checks to see if this batch is full. */
 bool riscv_batch_full(struct riscv_batch *batch);
 
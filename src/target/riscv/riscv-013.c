@@ -41,6 +41,7 @@ static void riscv013_clear_abstract_error(struct target *target);
 static int riscv013_get_register(struct target *target,
 		riscv_reg_t *value, int hid, int rid);
 static int riscv013_set_register(struct target *target, int hartid, int regid, uint64_t value);
+static int riscv013_fetch_registers(struct target *target);
 static int riscv013_select_current_hart(struct target *target);
 static int riscv013_halt_prep(struct target *target);
 static int riscv013_halt_go(struct target *target);
@@ -2015,6 +2016,7 @@ static int init_target(struct command_context *cmd_ctx,
 
 	generic_info->get_register = &riscv013_get_register;
 	generic_info->set_register = &riscv013_set_register;
+	generic_info->fetch_registers = &riscv013_fetch_registers;
 	generic_info->get_register_buf = &riscv013_get_register_buf;
 	generic_info->set_register_buf = &riscv013_set_register_buf;
 	generic_info->select_current_hart = &riscv013_select_current_hart;
@@ -2738,14 +2740,20 @@ static int write_memory_abstract(struct target *target, target_addr_t address,
 /**
  * Read the requested memory, taking care to execute every read exactly once,
  * even if cmderr=busy is encountered.
+ *
+ * On failure *words_read tells how many words at the start of buffer have
+ * been read successfully anyway.
  */
 static int read_memory_progbuf_inner(struct target *target, target_addr_t address,
-		uint32_t size, uint32_t count, uint8_t *buffer, uint32_t increment)
+		uint32_t size, uint32_t count, uint8_t *buffer, uint32_t increment,
+		uint32_t *words_read)
 {
 	RISCV013_INFO(info);
 
 	int result = ERROR_OK;
 
+	*words_read = 0;
+
 	/* Write address to S0. */
 	result = register_write_direct(target, GDB_REGNO_S0, address);
 	if (result != ERROR_OK)
@@ -2794,8 +2802,9 @@ static int read_memory_progbuf_inner(struct target *target, target_addr_t addres
 		 * dm_data0 contains[read_addr-size*2]
 		 */
 
-		struct riscv_batch *batch = riscv_batch_alloc(target, 32,
-				info->dmi_busy_delay + info->ac_busy_delay);
+		size_t idle = info->dmi_busy_delay + info->ac_busy_delay;
+		struct riscv_batch *batch = riscv_batch_alloc(target,
+				riscv_batch_size(target, idle), idle);
 		if (!batch)
 			return ERROR_FAIL;
 
@@ -2810,14 +2819,26 @@ static int read_memory_progbuf_inner(struct target *target, target_addr_t addres
 				break;
 		}
 
-		batch_run(target, batch);
+		/* Read abstractcs as part of the batch, which saves a round trip
+		 * per batch unless DMI got busy somewhere in the batch. */
+		size_t abstractcs_key = riscv_batch_add_dmi_read(batch, DM_ABSTRACTCS);
+
+		if (batch_run(target, batch) != ERROR_OK) {
+			riscv_batch_free(batch);
+			result = ERROR_FAIL;
+			goto error;
+		}
 
 		/* Wait for the target to finish performing the last abstract command,
 		 * and update our copy of cmderr. If we see that DMI is busy here,
 		 * dmi_busy_delay will be incremented. */
 		uint32_t abstractcs;
-		if (dmi_read(target, &abstractcs, DM_ABSTRACTCS) != ERROR_OK)
+		if (riscv_batch_get_dmi_read_op(batch, abstractcs_key) == DMI_STATUS_SUCCESS) {
+			abstractcs = riscv_batch_get_dmi_read_data(batch, abstractcs_key);
+		} else if (dmi_read(target, &abstractcs, DM_ABSTRACTCS) != ERROR_OK) {
+			riscv_batch_free(batch);
 			return ERROR_FAIL;
+		}
 		while (get_field(abstractcs, DM_ABSTRACTCS_BUSY))
 			if (dmi_read(target, &abstractcs, DM_ABSTRACTCS) != ERROR_OK)
 				return ERROR_FAIL;
@@ -2936,6 +2957,8 @@ static int read_memory_progbuf_inner(struct target *target, target_addr_t addres
 			riscv_addr_t offset = j * size;
 			buf_set_u64(buffer + offset, 0, 8 * size, value);
 			log_memory_access(address + j * increment, value, size, true);
+			if (j == *words_read)
+				(*words_read)++;
 		}
 
 		index = next_index;
@@ -3124,7 +3147,22 @@ static int read_memory_progbuf(struct target *target, target_addr_t address,
 	if (riscv_program_write(&program) != ERROR_OK)
 		return ERROR_FAIL;
 
-	result = read_memory_progbuf_inner(target, address, size, count, buffer, increment);
+	uint32_t words_read;
+	result = read_memory_progbuf_inner(target, address, size, count, buffer,
+			increment, &words_read);
+
+	/* A DMI busy response loses the read in flight, but everything before
+	 * it is good. Replay just the remaining words, as long as that makes
+	 * progress (dmi_busy_delay has been increased in the meantime). */
+	while (result != ERROR_OK && words_read > 0 && words_read < count) {
+		address += words_read * increment;
+		buffer += words_read * size;
+		count -= words_read;
+		LOG_DEBUG("retrying read of the remaining %d words from 0x%" TARGET_PRIxADDR,
+				count, address);
+		result = read_memory_progbuf_inner(target, address, size, count, buffer,
+				increment, &words_read);
+	}
 
 	if (result != ERROR_OK) {
 		/* The full read did not succeed, so we will try to read each word individually. */
@@ -3138,7 +3176,8 @@ static int read_memory_progbuf(struct target *target, target_addr_t address,
 			keep_alive();
 			/* TODO: This is much slower than it needs to be because we end up
 			 * writing the address to read for every word we read. */
-			result = read_memory_progbuf_inner(target, address_i, size, count_i, buffer_i, increment);
+			result = read_memory_progbuf_inner(target, address_i, size, count_i, buffer_i,
+					increment, &words_read);
 
 			/* The read of a single word failed, so we will just return 0 for that instead */
 			if (result != ERROR_OK) {
@@ -3267,10 +3306,9 @@ static int write_memory_bus_v1(struct target *target, target_addr_t address,
 		LOG_DEBUG("transferring burst starting at address 0x%" TARGET_PRIxADDR,
 				next_address);
 
-		struct riscv_batch *batch = riscv_batch_alloc(
-				target,
-				32,
-				info->dmi_busy_delay + info->bus_master_write_delay);
+		size_t idle = info->dmi_busy_delay + info->bus_master_write_delay;
+		struct riscv_batch *batch = riscv_batch_alloc(target,
+				riscv_batch_size(target, idle), idle);
 		if (!batch)
 			return ERROR_FAIL;
 
@@ -3440,10 +3478,9 @@ static int write_memory_progbuf(struct target *target, target_addr_t address,
 		LOG_DEBUG("transferring burst starting at address 0x%016" PRIx64,
 				cur_addr);
 
-		struct riscv_batch *batch = riscv_batch_alloc(
-				target,
-				32,
-				info->dmi_busy_delay + info->ac_busy_delay);
+		size_t idle = info->dmi_busy_delay + info->ac_busy_delay;
+		struct riscv_batch *batch = riscv_batch_alloc(target,
+				riscv_batch_size(target, idle), idle);
 		if (!batch)
 			goto error;
 
@@ -3498,21 +3535,32 @@ static int write_memory_progbuf(struct target *target, target_addr_t address,
 			}
 		}
 
+		/* Read abstractcs as part of the batch, which saves a round trip
+		 * per batch unless DMI got busy somewhere in the batch. */
+		size_t abstractcs_key = riscv_batch_add_dmi_read(batch, DM_ABSTRACTCS);
+
 		result = batch_run(target, batch);
-		riscv_batch_free(batch);
-		if (result != ERROR_OK)
+		if (result != ERROR_OK) {
+			riscv_batch_free(batch);
 			goto error;
+		}
 
 		/* Note that if the scan resulted in a Busy DMI response, it
 		 * is this read to abstractcs that will cause the dmi_busy_delay
 		 * to be incremented if necessary. */
 
 		uint32_t abstractcs;
-		bool dmi_busy_encountered;
-		result = dmi_op(target, &abstractcs, &dmi_busy_encountered,
-				DMI_OP_READ, DM_ABSTRACTCS, 0, false, true);
-		if (result != ERROR_OK)
-			goto error;
+		bool dmi_busy_encountered = false;
+		if (riscv_batch_get_dmi_read_op(batch, abstractcs_key) == DMI_STATUS_SUCCESS) {
+			abstractcs = riscv_batch_get_dmi_read_data(batch, abstractcs_key);
+			riscv_batch_free(batch);
+		} else {
+			riscv_batch_free(batch);
+			result = dmi_op(target, &abstractcs, &dmi_busy_encountered,
+					DMI_OP_READ, DM_ABSTRACTCS, 0, false, true);
+			if (result != ERROR_OK)
+				goto error;
+		}
 		while (get_field(abstractcs, DM_ABSTRACTCS_BUSY))
 			if (dmi_read(target, &abstractcs, DM_ABSTRACTCS) != ERROR_OK)
 				return ERROR_FAIL;
@@ -3636,6 +3684,107 @@ static int riscv013_get_register(struct target *target,
 	return result;
 }
 
+/*
+ * Read all invalid GPRs of the current hart with abstract commands queued in a
+ * single batch, instead of waiting for each command to complete.  If the DM
+ * reports busy or any other error, the registers are left invalid and get
+ * read one by one (with the longer delay learned here) when they're needed.
+ */
+static int riscv013_fetch_registers(struct target *target)
+{
+	RISCV013_INFO(info);
+	unsigned xlen = riscv_xlen(target);
+	enum gdb_regno regs[GDB_REGNO_XPR31 + 1];
+	size_t lo_keys[GDB_REGNO_XPR31 + 1];
+	size_t hi_keys[GDB_REGNO_XPR31 + 1];
+	unsigned count = 0;
+
+	for (enum gdb_regno number = GDB_REGNO_ZERO + 1; number <= GDB_REGNO_XPR31; number++) {
+		struct reg *reg = &target->reg_cache->reg_list[number];
+		if (!reg->exist || reg->valid)
+			continue;
+		if (number > GDB_REGNO_XPR15 &&
+				riscv_supports_extension(target, riscv_current_hartid(target), 'E'))
+			continue;
+		regs[count++] = number;
+	}
+	if (count == 0)
+		return ERROR_OK;
+
+	/* command write, one or two data reads per register, then abstractcs */
+	struct riscv_batch *batch = riscv_batch_alloc(target,
+			count * (xlen > 32 ? 3 : 2) + 1,
+			info->dmi_busy_delay + info->ac_busy_delay);
+	if (!batch)
+		return ERROR_FAIL;
+
+	for (unsigned i = 0; i < count; i++) {
+		riscv_batch_add_dmi_write(batch, DM_COMMAND,
+				access_register_command(target, regs[i], xlen,
+					AC_ACCESS_REGISTER_TRANSFER));
+		lo_keys[i] = riscv_batch_add_dmi_read(batch, DM_DATA0);
+		if (xlen > 32)
+			hi_keys[i] = riscv_batch_add_dmi_read(batch, DM_DATA1);
+	}
+	size_t abstractcs_key = riscv_batch_add_dmi_read(batch, DM_ABSTRACTCS);
+
+	if (batch_run(target, batch) != ERROR_OK) {
+		riscv_batch_free(batch);
+		return ERROR_FAIL;
+	}
+
+	/* Every read key is checked; a busy response on a write makes all the
+	 * following reads fail as well. */
+	unsigned status = DMI_STATUS_SUCCESS;
+	for (size_t key = 0; key <= abstractcs_key && status == DMI_STATUS_SUCCESS; key++)
+		status = riscv_batch_get_dmi_read_op(batch, key);
+	if (status == DMI_STATUS_BUSY)
+		increase_dmi_busy_delay(target);
+	else if (status != DMI_STATUS_SUCCESS)
+		dtmcontrol_scan(target, DTM_DTMCS_DMIRESET);
+
+	uint32_t abstractcs;
+	if (status == DMI_STATUS_SUCCESS) {
+		abstractcs = riscv_batch_get_dmi_read_data(batch, abstractcs_key);
+	} else if (dmi_read(target, &abstractcs, DM_ABSTRACTCS) != ERROR_OK) {
+		riscv_batch_free(batch);
+		return ERROR_FAIL;
+	}
+	while (get_field(abstractcs, DM_ABSTRACTCS_BUSY)) {
+		if (dmi_read(target, &abstractcs, DM_ABSTRACTCS) != ERROR_OK) {
+			riscv_batch_free(batch);
+			return ERROR_FAIL;
+		}
+	}
+	info->cmderr = get_field(abstractcs, DM_ABSTRACTCS_CMDERR);
+	if (info->cmderr != CMDERR_NONE) {
+		if (info->cmderr == CMDERR_BUSY)
+			increase_ac_busy_delay(target);
+		riscv013_clear_abstract_error(target);
+	}
+
+	if (status != DMI_STATUS_SUCCESS || info->cmderr != CMDERR_NONE) {
+		LOG_DEBUG("batched GPR read failed (dmi status %d, cmderr %d), "
+				"falling back to single reads", status, info->cmderr);
+		riscv_batch_free(batch);
+		return ERROR_OK;
+	}
+
+	for (unsigned i = 0; i < count; i++) {
+		struct reg *reg = &target->reg_cache->reg_list[regs[i]];
+		uint64_t value = riscv_batch_get_dmi_read_data(batch, lo_keys[i]);
+		if (xlen > 32)
+			value |= (uint64_t)riscv_batch_get_dmi_read_data(batch, hi_keys[i]) << 32;
+		buf_set_u64(reg->value, 0, reg->size, value);
+		/* GPRs are plain data stores, see gdb_regno_cacheable() */
+		reg->valid = true;
+	}
+	LOG_DEBUG("read %u GPRs in one batch", count);
+
+	riscv_batch_free(batch);
+	return ERROR_OK;
+}
+
 static int riscv013_set_register(struct target *target, int hid, int rid, uint64_t value)
 {
 	LOG_DEBUG("[%d] writing 0x%" PRIx64 " to register %s on hart %d",
@@ -269,6 +269,7 @@ virt2phys_info_t sv48 = {
 };
 
 static int riscv_resume_go_all_harts(struct target *target);
+static void riscv_tlb_flush(struct target *target);
 
 void select_dmi_via_bscan(struct target *target)
 {
@@ -953,6 +954,7 @@ static int old_or_new_riscv_step(struct target *target, int current,
 {
 	RISCV_INFO(r);
 	LOG_DEBUG("handle_breakpoints=%d", handle_breakpoints);
+	riscv_tlb_flush(target);
 	if (r->is_halted == NULL)
 		return oldriscv_step(target, current, address, handle_breakpoints);
 	else
@@ -1129,6 +1131,7 @@ static int riscv_assert_reset(struct target *target)
 	LOG_DEBUG("[%d]", target->coreid);
 	struct target_type *tt = get_target_type(target);
 	riscv_invalidate_register_cache(target);
+	riscv_tlb_flush(target);
 	return tt->assert_reset(target);
 }
 
@@ -1299,6 +1302,7 @@ static int resume_go(struct target *target, int current,
 {
 	riscv_info_t *r = riscv_info(target);
 	int result;
+	riscv_tlb_flush(target);
 	if (r->is_halted == NULL) {
 		struct target_type *tt = get_target_type(target);
 		result = tt->resume(target, current, address, handle_breakpoints,
@@ -1437,6 +1441,59 @@ static int riscv_mmu(struct target *target, int *enabled)
 	return ERROR_OK;
 }
 
+static void riscv_tlb_flush(struct target *target)
+{
+	RISCV_INFO(r);
+
+	for (unsigned i = 0; i < RISCV_TLB_ENTRIES; i++)
+		r->tlb[i].valid = false;
+	r->tlb_flushes++;
+}
+
+/* Memory written through one hart may hold the page tables of any other. */
+static void riscv_tlb_flush_smp(struct target *target)
+{
+	if (target->smp) {
+		for (struct target_list *tlist = target->head; tlist; tlist = tlist->next)
+			riscv_tlb_flush(tlist->target);
+	} else {
+		riscv_tlb_flush(target);
+	}
+}
+
+static riscv_tlb_entry_t *riscv_tlb_lookup(struct target *target, int hartid,
+		riscv_reg_t satp, target_addr_t virtual)
+{
+	RISCV_INFO(r);
+
+	for (unsigned i = 0; i < RISCV_TLB_ENTRIES; i++) {
+		riscv_tlb_entry_t *entry = &r->tlb[i];
+		if (entry->valid && entry->hartid == hartid && entry->satp == satp &&
+				(virtual >> entry->page_shift) == (entry->virtual >> entry->page_shift))
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void riscv_tlb_insert(struct target *target, int hartid,
+		riscv_reg_t satp, target_addr_t virtual, target_addr_t physical,
+		unsigned page_shift)
+{
+	RISCV_INFO(r);
+	target_addr_t page_mask = ((target_addr_t)1 << page_shift) - 1;
+	riscv_tlb_entry_t *entry = &r->tlb[r->tlb_next];
+
+	entry->valid = true;
+	entry->hartid = hartid;
+	entry->satp = satp;
+	entry->virtual = virtual & ~page_mask;
+	entry->physical = physical & ~page_mask;
+	entry->page_shift = page_shift;
+
+	r->tlb_next = (r->tlb_next + 1) % RISCV_TLB_ENTRIES;
+}
+
 static int riscv_address_translate(struct target *target,
 		target_addr_t virtual, target_addr_t *physical)
 {
@@ -1488,6 +1545,18 @@ static int riscv_address_translate(struct target *target,
 		return ERROR_FAIL;
 	}
 
+	riscv_tlb_entry_t *entry = riscv_tlb_lookup(target, r->current_hartid,
+			satp_value, virtual);
+	if (entry) {
+		r->tlb_hits++;
+		*physical = entry->physical |
+			(virtual & (((target_addr_t)1 << entry->page_shift) - 1));
+		LOG_DEBUG("0x%" TARGET_PRIxADDR " -> 0x%" TARGET_PRIxADDR " (cached)",
+				virtual, *physical);
+		return ERROR_OK;
+	}
+	r->tlb_misses++;
+
 	ppn_value = get_field(satp_value, RISCV_SATP_PPN(xlen));
 	table_address = ppn_value << RISCV_PGSHIFT;
 	i = info->level - 1;
@@ -1529,6 +1598,10 @@ static int riscv_address_translate(struct target *target,
 		return ERROR_FAIL;
 	}
 
+	/* The leaf PTE maps a page (or megapage, gigapage, ...) which covers all
+	 * bits below the VPN field of its level. */
+	unsigned page_shift = info->vpn_shift[i];
+
 	/* Make sure to clear out the high bits that may be set. */
 	*physical = virtual & (((target_addr_t)1 << info->va_bits) - 1);
 
@@ -1543,6 +1616,9 @@ static int riscv_address_translate(struct target *target,
 	LOG_DEBUG("0x%" TARGET_PRIxADDR " -> 0x%" TARGET_PRIxADDR, virtual,
 			*physical);
 
+	riscv_tlb_insert(target, r->current_hartid, satp_value, virtual,
+			*physical, page_shift);
+
 	return ERROR_OK;
 }
 
@@ -1593,6 +1669,7 @@ static int riscv_write_phys_memory(struct target *target, target_addr_t phys_add
 {
 	if (riscv_select_current_hart(target) != ERROR_OK)
 		return ERROR_FAIL;
+	riscv_tlb_flush_smp(target);
 	struct target_type *tt = get_target_type(target);
 	return tt->write_memory(target, phys_address, size, count, buffer);
 }
@@ -1612,10 +1689,25 @@ static int riscv_write_memory(struct target *target, target_addr_t address,
 	if (target->type->virt2phys(target, address, &physical_addr) == ERROR_OK)
 		address = physical_addr;
 
+	riscv_tlb_flush_smp(target);
 	struct target_type *tt = get_target_type(target);
 	return tt->write_memory(target, address, size, count, buffer);
 }
 
+static int riscv_fetch_registers(struct target *target)
+{
+	RISCV_INFO(r);
+
+	if (target->state != TARGET_HALTED)
+		return ERROR_TARGET_NOT_HALTED;
+	if (!r->fetch_registers)
+		return ERROR_OK;
+
+	if (riscv_select_current_hart(target) != ERROR_OK)
+		return ERROR_FAIL;
+	return r->fetch_registers(target);
+}
+
 static int riscv_get_gdb_reg_list_internal(struct target *target,
 		struct reg **reg_list[], int *reg_list_size,
 		enum target_register_class reg_class, bool read)
@@ -1644,6 +1736,11 @@ static int riscv_get_gdb_reg_list_internal(struct target *target,
 			return ERROR_FAIL;
 	}
 
+	/* whatever this doesn't read is read one by one below */
+	if (read && target->state == TARGET_HALTED &&
+			riscv_fetch_registers(target) != ERROR_OK)
+		return ERROR_FAIL;
+
 	*reg_list = calloc(*reg_list_size, sizeof(struct reg *));
 	if (!*reg_list)
 		return ERROR_FAIL;
@@ -2580,6 +2677,25 @@ COMMAND_HANDLER(riscv_set_enable_virt2phys)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(riscv_tlb_stats)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+	RISCV_INFO(r);
+
+	unsigned valid = 0;
+	for (unsigned i = 0; i < RISCV_TLB_ENTRIES; i++)
+		if (r->tlb[i].valid)
+			valid++;
+
+	command_print(CMD, "entries: %u/%u, hits: %" PRIu64 ", misses: %" PRIu64
+			", flushes: %" PRIu64, valid, RISCV_TLB_ENTRIES, r->tlb_hits,
+			r->tlb_misses, r->tlb_flushes);
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(riscv_set_ebreakm)
 {
 	if (CMD_ARGC != 1) {
@@ -2753,6 +2869,13 @@ static const struct command_registration riscv_exec_command_handlers[] = {
 		.help = "When on (default), enable translation from virtual address to "
 			"physical address."
 	},
+	{
+		.name = "tlb_stats",
+		.handler = riscv_tlb_stats,
+		.mode = COMMAND_EXEC,
+		.usage = "",
+		.help = "Show statistics of the virtual to physical translation cache."
+	},
 	{
 		.name = "set_ebreakm",
 		.handler = riscv_set_ebreakm,
@@ -2847,6 +2970,7 @@ struct target_type riscv_target = {
 
 	.get_gdb_reg_list = riscv_get_gdb_reg_list,
 	.get_gdb_reg_list_noread = riscv_get_gdb_reg_list_noread,
+	.fetch_registers = riscv_fetch_registers,
 
 	.add_breakpoint = riscv_add_breakpoint,
 	.remove_breakpoint = riscv_remove_breakpoint,
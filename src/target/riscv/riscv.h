@@ -26,6 +26,9 @@ struct riscv_program;
 
 # define PG_MAX_LEVEL 4
 
+/* Number of entries in the virtual to physical translation cache. */
+#define RISCV_TLB_ENTRIES 64
+
 extern struct target_type riscv011_target;
 extern struct target_type riscv013_target;
 
@@ -51,6 +54,18 @@ typedef struct {
 	unsigned custom_number;
 } riscv_reg_info_t;
 
+typedef struct {
+	bool valid;
+	int hartid;
+	/* satp the translation was made with, which covers the mode, ASID and
+	 * root page table. */
+	riscv_reg_t satp;
+	/* Virtual and physical base address of the (possibly large) page. */
+	target_addr_t virtual;
+	target_addr_t physical;
+	unsigned page_shift;
+} riscv_tlb_entry_t;
+
 typedef struct {
 	unsigned dtm_version;
 
@@ -116,6 +131,8 @@ typedef struct {
 		riscv_reg_t *value, int hid, int rid);
 	int (*set_register)(struct target *target, int hartid, int regid,
 			uint64_t value);
+	/* Optional: read the invalid registers of the current hart in one go. */
+	int (*fetch_registers)(struct target *target);
 	int (*get_register_buf)(struct target *target, uint8_t *buf, int regno);
 	int (*set_register_buf)(struct target *target, int regno,
 			const uint8_t *buf);
@@ -179,6 +196,15 @@ typedef struct {
 	/* Set when trigger registers are changed by the user. This indicates we eed
 	 * to beware that we may hit a trigger that we didn't realize had been set. */
 	bool manual_hwbp_set;
+
+	/* Recent virtual to physical translations. Flushed whenever the harts
+	 * run, are reset, or memory is written through the debugger, as any of
+	 * those may change the page tables. */
+	riscv_tlb_entry_t tlb[RISCV_TLB_ENTRIES];
+	unsigned tlb_next;
+	uint64_t tlb_hits;
+	uint64_t tlb_misses;
+	uint64_t tlb_flushes;
 } riscv_info_t;
 
 typedef struct {
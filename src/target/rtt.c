@@ -24,6 +24,21 @@
 
 #include "target.h"
 
+/* Maximum number of bytes read from a single up-channel per poll. */
+#define RTT_READ_MAX_LENGTH	(64 * 1024)
+
+static void parse_rtt_channel(const uint8_t *buf, target_addr_t address,
+		struct rtt_channel *channel)
+{
+	channel->address = address;
+	channel->name_addr = buf_get_u32(buf + 0, 0, 32);
+	channel->buffer_addr = buf_get_u32(buf + 4, 0, 32);
+	channel->size = buf_get_u32(buf + 8, 0, 32);
+	channel->write_pos = buf_get_u32(buf + 12, 0, 32);
+	channel->read_pos = buf_get_u32(buf + 16, 0, 32);
+	channel->flags = buf_get_u32(buf + 20, 0, 32);
+}
+
 static int read_rtt_channel(struct target *target,
 		const struct rtt_control *ctrl, unsigned int channel_index,
 		enum rtt_channel_type type, struct rtt_channel *channel)
@@ -42,13 +57,7 @@ static int read_rtt_channel(struct target *target,
 	if (ret != ERROR_OK)
 		return ret;
 
-	channel->address = address;
-	channel->name_addr = buf_get_u32(buf + 0, 0, 32);
-	channel->buffer_addr = buf_get_u32(buf + 4, 0, 32);
-	channel->size = buf_get_u32(buf + 8, 0, 32);
-	channel->write_pos = buf_get_u32(buf + 12, 0, 32);
-	channel->read_pos = buf_get_u32(buf + 16, 0, 32);
-	channel->flags = buf_get_u32(buf + 20, 0, 32);
+	parse_rtt_channel(buf, address, channel);
 
 	return ERROR_OK;
 }
@@ -244,54 +253,81 @@ int target_rtt_read_control_block(struct target *target,
 	return ERROR_OK;
 }
 
+/* Size of the chunks read from the target while searching for the control block. */
+#define RTT_SEARCH_CHUNK_SIZE	(32 * 1024)
+
 int target_rtt_find_control_block(struct target *target,
 		target_addr_t *address, size_t size, const char *id, bool *found,
 		void *user_data)
 {
-	uint8_t buf[1024];
+	uint8_t *buf;
+	size_t fail[RTT_CB_MAX_ID_LENGTH];
+	const size_t id_length = strlen(id);
+	int ret = ERROR_OK;
 
 	*found = false;
 
-	size_t j = 0;
-	size_t cb_offset = 0;
-	const size_t id_length = strlen(id);
+	if (!id_length || id_length >= RTT_CB_MAX_ID_LENGTH)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	buf = malloc(MIN(size, RTT_SEARCH_CHUNK_SIZE));
+
+	if (!buf)
+		return ERROR_FAIL;
+
+	/*
+	 * Knuth-Morris-Pratt failure function, fail[i] is the length of the
+	 * longest proper prefix of id[0..i] that is also a suffix of it.
+	 */
+	fail[0] = 0;
+
+	for (size_t i = 1, k = 0; i < id_length; i++) {
+		while (k > 0 && id[i] != id[k])
+			k = fail[k - 1];
+
+		if (id[i] == id[k])
+			k++;
+
+		fail[i] = k;
+	}
 
 	LOG_INFO("rtt: Searching for control block '%s'", id);
 
-	for (target_addr_t addr = 0; addr < size; addr = addr + sizeof(buf)) {
-		int ret;
+	/*
+	 * The number of matched characters is kept across chunks so that an
+	 * identifier which straddles a chunk boundary is found as well.
+	 */
+	size_t j = 0;
+
+	for (target_addr_t addr = 0; addr < size; addr += RTT_SEARCH_CHUNK_SIZE) {
+		const size_t buf_size = MIN(RTT_SEARCH_CHUNK_SIZE, size - addr);
 
-		const size_t buf_size = MIN(sizeof(buf), size - addr);
 		ret = target_read_buffer(target, *address + addr, buf_size, buf);
 
 		if (ret != ERROR_OK)
-			return ret;
-
-		size_t start = 0;
-		size_t i = 0;
+			break;
 
-		while (i < buf_size) {
-			if (buf[i] != id[j]) {
-				start++;
-				cb_offset++;
-				i = start;
-				j = 0;
-
-				continue;
-			}
+		for (size_t i = 0; i < buf_size; i++) {
+			while (j > 0 && buf[i] != (uint8_t)id[j])
+				j = fail[j - 1];
 
-			i++;
-			j++;
+			if (buf[i] == (uint8_t)id[j])
+				j++;
 
 			if (j == id_length) {
-				*address = *address + cb_offset;
+				*address = *address + addr + i + 1 - id_length;
 				*found = true;
+				free(buf);
 				return ERROR_OK;
 			}
 		}
+
+		keep_alive();
 	}
 
-	return ERROR_OK;
+	free(buf);
+
+	return ret;
 }
 
 int target_rtt_read_channel_info(struct target *target,
@@ -377,26 +413,47 @@ static int read_from_channel(struct target *target,
 
 int target_rtt_read_callback(struct target *target,
 		const struct rtt_control *ctrl, struct rtt_sink_list **sinks,
-		size_t num_channels, void *user_data)
+		size_t num_channels, size_t *received, void *user_data)
 {
+	int ret;
+	uint8_t *descriptors;
+	uint8_t *buffer = NULL;
+	size_t buffer_size = 0;
+
+	*received = 0;
 	num_channels = MIN(num_channels, ctrl->num_up_channels);
 
+	/* Only the descriptors up to the last channel with a sink are needed. */
+	while (num_channels > 0 && !sinks[num_channels - 1])
+		num_channels--;
+
+	if (!num_channels)
+		return ERROR_OK;
+
+	descriptors = malloc(num_channels * RTT_CHANNEL_SIZE);
+
+	if (!descriptors)
+		return ERROR_FAIL;
+
+	/* Fetch all up-channel descriptors with a single transfer. */
+	ret = target_read_buffer(target, ctrl->address + RTT_CB_SIZE,
+		num_channels * RTT_CHANNEL_SIZE, descriptors);
+
+	if (ret != ERROR_OK) {
+		LOG_ERROR("rtt: Failed to read up-channel descriptions");
+		free(descriptors);
+		return ret;
+	}
+
 	for (size_t i = 0; i < num_channels; i++) {
-		int ret;
 		struct rtt_channel channel;
-		uint8_t buffer[1024];
 		size_t length;
 
 		if (!sinks[i])
 			continue;
 
-		ret = read_rtt_channel(target, ctrl, i, RTT_CHANNEL_TYPE_UP,
-			&channel);
-
-		if (ret != ERROR_OK) {
-			LOG_ERROR("rtt: Failed to read up-channel %zu description", i);
-			return ret;
-		}
+		parse_rtt_channel(descriptors + i * RTT_CHANNEL_SIZE,
+			ctrl->address + RTT_CB_SIZE + i * RTT_CHANNEL_SIZE, &channel);
 
 		if (!channel_is_active(&channel)) {
 			LOG_WARNING("rtt: Up-channel %zu is not active", i);
@@ -408,17 +465,47 @@ int target_rtt_read_callback(struct target *target,
 			continue;
 		}
 
-		length = sizeof(buffer);
+		if (channel.read_pos >= channel.size ||
+				channel.write_pos >= channel.size) {
+			LOG_WARNING("rtt: Up-channel %zu has invalid offsets", i);
+			continue;
+		}
+
+		/* Nothing was written since the last read, skip the data transfer. */
+		if (channel.read_pos == channel.write_pos)
+			continue;
+
+		length = (channel.write_pos - channel.read_pos + channel.size)
+			% channel.size;
+		length = MIN(length, RTT_READ_MAX_LENGTH);
+
+		if (length > buffer_size) {
+			uint8_t *tmp = realloc(buffer, length);
+
+			if (!tmp) {
+				ret = ERROR_FAIL;
+				break;
+			}
+
+			buffer = tmp;
+			buffer_size = length;
+		}
+
 		ret = read_from_channel(target, &channel, buffer, &length);
 
 		if (ret != ERROR_OK) {
 			LOG_ERROR("rtt: Failed to read from up-channel %zu", i);
-			return ret;
+			break;
 		}
 
+		*received += length;
+
 		for (struct rtt_sink_list *sink = sinks[i]; sink; sink = sink->next)
 			sink->read(i, buffer, length, sink->user_data);
 	}
 
-	return ERROR_OK;
+	free(buffer);
+	free(descriptors);
+
+	return ret;
 }
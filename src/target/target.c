@@ -55,10 +55,14 @@
 #include "rtos/rtos.h"
 #include "transport/transport.h"
 #include "arm_cti.h"
+#include "memcache.h"
 
 /* default halt wait timeout (ms) */
 #define DEFAULT_HALT_TIMEOUT 5000
 
+/* host buffer size used by load_image to stream sections to the target */
+#define LOAD_IMAGE_CHUNK_SIZE (64 * 1024)
+
 static int target_read_buffer_default(struct target *target, target_addr_t address,
 		uint32_t count, uint8_t *buffer);
 static int target_write_buffer_default(struct target *target, target_addr_t address,
@@ -154,6 +158,7 @@ static struct target_type *target_types[] = {
 struct target *all_targets;
 static struct target_event_callback *target_event_callbacks;
 static struct target_timer_callback *target_timer_callbacks;
+static int64_t target_timer_next_event_value;
 static LIST_HEAD(target_reset_callback_list);
 static LIST_HEAD(target_trace_callback_list);
 static const int polling_interval = 100;
@@ -847,6 +852,7 @@ int target_run_algorithm(struct target *target,
 			num_reg_params, reg_param,
 			entry_point, exit_point, timeout_ms, arch_info);
 	target->running_alg = false;
+	memcache_invalidate(target);
 
 done:
 	return retval;
@@ -887,6 +893,7 @@ int target_start_algorithm(struct target *target,
 	}
 
 	target->running_alg = true;
+	memcache_invalidate(target);
 	retval = target->type->start_algorithm(target,
 			num_mem_params, mem_params,
 			num_reg_params, reg_params,
@@ -932,6 +939,7 @@ int target_wait_algorithm(struct target *target,
 			exit_point, timeout_ms, arch_info);
 	if (retval != ERROR_TARGET_TIMEOUT)
 		target->running_alg = false;
+	memcache_invalidate(target);
 
 done:
 	return retval;
@@ -1024,26 +1032,37 @@ int target_run_flash_async_algorithm(struct target *target,
 		return retval;
 	}
 
+	/* The target only ever advances rp, so free space computed from an old
+	 * value is never overestimated. Only fetch rp once that space is used
+	 * up; this saves a round trip e.g. for the first chunk and after the
+	 * write pointer wrapped around. */
+	bool rp_stale = false;
+
 	while (count > 0) {
+		bool rp_fetched = false;
 
-		retval = target_read_u32(target, rp_addr, &rp);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("failed to get read pointer");
-			break;
-		}
+		if (rp_stale) {
+			retval = target_read_u32(target, rp_addr, &rp);
+			if (retval != ERROR_OK) {
+				LOG_ERROR("failed to get read pointer");
+				break;
+			}
+			rp_stale = false;
+			rp_fetched = true;
 
-		LOG_DEBUG("offs 0x%zx count 0x%" PRIx32 " wp 0x%" PRIx32 " rp 0x%" PRIx32,
-			(size_t) (buffer - buffer_orig), count, wp, rp);
+			LOG_DEBUG("offs 0x%zx count 0x%" PRIx32 " wp 0x%" PRIx32 " rp 0x%" PRIx32,
+				(size_t) (buffer - buffer_orig), count, wp, rp);
 
-		if (rp == 0) {
-			LOG_ERROR("flash write algorithm aborted by target");
-			retval = ERROR_FLASH_OPERATION_FAILED;
-			break;
-		}
+			if (rp == 0) {
+				LOG_ERROR("flash write algorithm aborted by target");
+				retval = ERROR_FLASH_OPERATION_FAILED;
+				break;
+			}
 
-		if (((rp - fifo_start_addr) & (block_size - 1)) || rp < fifo_start_addr || rp >= fifo_end_addr) {
-			LOG_ERROR("corrupted fifo read pointer 0x%" PRIx32, rp);
-			break;
+			if (((rp - fifo_start_addr) & (block_size - 1)) || rp < fifo_start_addr || rp >= fifo_end_addr) {
+				LOG_ERROR("corrupted fifo read pointer 0x%" PRIx32, rp);
+				break;
+			}
 		}
 
 		/* Count the number of bytes available in the fifo without
@@ -1058,6 +1077,10 @@ int target_run_flash_async_algorithm(struct target *target,
 			thisrun_bytes = fifo_end_addr - wp - block_size;
 
 		if (thisrun_bytes == 0) {
+			rp_stale = true;
+			if (!rp_fetched)
+				continue;
+
 			/* Throttle polling a bit if transfer is (much) faster than flash
 			 * programming. The exact delay shouldn't matter as long as it's
 			 * less than buffer size / flash speed. This is very unlikely to
@@ -1133,6 +1156,52 @@ int target_run_flash_async_algorithm(struct target *target,
 	return retval;
 }
 
+int target_alloc_flash_algorithm(struct target *target,
+		const uint8_t *code, uint32_t code_size,
+		uint32_t data_size, int block_size,
+		uint32_t min_fifo_size, uint32_t max_fifo_size,
+		struct working_area **code_area, struct working_area **fifo_area)
+{
+	/* the fifo data area must hold whole blocks, keep it word aligned too */
+	uint32_t align = MAX(block_size, 4);
+	int retval;
+
+	retval = target_alloc_working_area_try(target, code_size, code_area);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = target_write_buffer(target, (*code_area)->address, code_size, code);
+	if (retval != ERROR_OK) {
+		target_free_working_area(target, *code_area);
+		return retval;
+	}
+
+	/* No need to reserve (and back up) more than the data plus the
+	 * read/write pointers and the block that always stays empty */
+	uint64_t fifo_size = 8 + (uint64_t)data_size + align;
+	fifo_size = MIN(fifo_size, max_fifo_size);
+	fifo_size &= ~(uint64_t)(align - 1);
+	/* a small write is fine with a small fifo */
+	min_fifo_size = MIN(min_fifo_size, fifo_size);
+	fifo_size = MIN(fifo_size, target_get_working_area_avail(target) & ~(align - 1));
+
+	for (;;) {
+		if (fifo_size < min_fifo_size || fifo_size <= 8) {
+			target_free_working_area(target, *code_area);
+			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		}
+		if (target_alloc_working_area_try(target, fifo_size, fifo_area) == ERROR_OK)
+			break;
+		fifo_size /= 2;
+		fifo_size &= ~(uint64_t)(align - 1);
+	}
+
+	LOG_DEBUG("flash algorithm at " TARGET_ADDR_FMT ", %" PRIu32 " bytes fifo at " TARGET_ADDR_FMT,
+			(*code_area)->address, (*fifo_area)->size, (*fifo_area)->address);
+
+	return ERROR_OK;
+}
+
 int target_run_read_async_algorithm(struct target *target,
 		uint8_t *buffer, uint32_t count, int block_size,
 		int num_mem_params, struct mem_param *mem_params,
@@ -1322,6 +1391,7 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	memcache_invalidate_range(target, address, size * count);
 	return target->type->write_memory(target, address, size, count, buffer);
 }
 
@@ -1336,6 +1406,8 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	/* physical and virtual addresses may differ, drop everything */
+	memcache_invalidate(target);
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1447,6 +1519,13 @@ int target_get_gdb_reg_list_noread(struct target *target,
 	return target_get_gdb_reg_list(target, reg_list, reg_list_size, reg_class);
 }
 
+int target_fetch_registers(struct target *target)
+{
+	if (!target->type->fetch_registers)
+		return ERROR_OK;
+	return target->type->fetch_registers(target);
+}
+
 bool target_supports_gdb_connection(struct target *target)
 {
 	/*
@@ -1706,6 +1785,11 @@ int target_register_trace_callback(int (*callback)(struct target *target,
 	return ERROR_OK;
 }
 
+static int64_t timeval_to_ms(const struct timeval *tv)
+{
+	return (int64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+}
+
 int target_register_timer_callback(int (*callback)(void *priv),
 		unsigned int time_ms, enum target_timer_type type, void *priv)
 {
@@ -1732,6 +1816,10 @@ int target_register_timer_callback(int (*callback)(void *priv),
 	(*callbacks_p)->priv = priv;
 	(*callbacks_p)->next = NULL;
 
+	int64_t when_ms = timeval_to_ms(&(*callbacks_p)->when);
+	if (when_ms < target_timer_next_event_value)
+		target_timer_next_event_value = when_ms;
+
 	return ERROR_OK;
 }
 
@@ -1803,6 +1891,9 @@ int target_unregister_timer_callback(int (*callback)(void *priv), void *priv)
 
 	for (struct target_timer_callback *c = target_timer_callbacks;
 	     c; c = c->next) {
+		/* skip entries which are only waiting to be freed */
+		if (c->removed)
+			continue;
 		if ((c->callback == callback) && (c->priv == priv)) {
 			c->removed = true;
 			return ERROR_OK;
@@ -1826,6 +1917,9 @@ int target_call_event_callbacks(struct target *target, enum target_event event)
 			Jim_Nvp_value2name_simple(nvp_target_event, event)->name,
 			target_name(target));
 
+	/* any state change may alter memory, start a new cache epoch */
+	memcache_invalidate(target);
+
 	target_handle_event(target, event);
 
 	while (callback) {
@@ -1876,7 +1970,8 @@ static int target_call_timer_callback(struct target_timer_callback *cb,
 	if (cb->type == TARGET_TIMER_TYPE_PERIODIC)
 		return target_timer_callback_periodic_restart(cb, now);
 
-	return target_unregister_timer_callback(cb->callback, cb->priv);
+	cb->removed = true;
+	return ERROR_OK;
 }
 
 static int target_call_timer_callbacks_check_time(int checktime)
@@ -1894,6 +1989,9 @@ static int target_call_timer_callbacks_check_time(int checktime)
 	struct timeval now;
 	gettimeofday(&now, NULL);
 
+	/* recomputed below; callbacks registered meanwhile lower it further */
+	target_timer_next_event_value = INT64_MAX;
+
 	/* Store an address of the place containing a pointer to the
 	 * next item; initially, that's a standalone "root of the
 	 * list" variable. */
@@ -1913,6 +2011,12 @@ static int target_call_timer_callbacks_check_time(int checktime)
 		if (call_it)
 			target_call_timer_callback(*callback, &now);
 
+		if (!(*callback)->removed) {
+			int64_t when_ms = timeval_to_ms(&(*callback)->when);
+			if (when_ms < target_timer_next_event_value)
+				target_timer_next_event_value = when_ms;
+		}
+
 		callback = &(*callback)->next;
 	}
 
@@ -1920,6 +2024,13 @@ static int target_call_timer_callbacks_check_time(int checktime)
 	return ERROR_OK;
 }
 
+/* Returns the time, in the time base of timeval_ms(), at which the next
+ * timer callback is due. Callbacks may also run earlier. */
+int64_t target_timer_next_event(void)
+{
+	return target_timer_next_event_value;
+}
+
 int target_call_timer_callbacks(void)
 {
 	return target_call_timer_callbacks_check_time(1);
@@ -2253,6 +2364,7 @@ static void target_destroy(struct target *target)
 	}
 
 	rtos_destroy(target);
+	memcache_free(target);
 
 	free(target->gdb_port_override);
 	free(target->type);
@@ -2395,6 +2507,7 @@ int target_write_buffer(struct target *target, target_addr_t address, uint32_t s
 		return ERROR_FAIL;
 	}
 
+	memcache_invalidate_range(target, address, size);
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
@@ -3633,56 +3746,65 @@ COMMAND_HANDLER(handle_load_image_command)
 	if (image_open(&image, CMD_ARGV[0], (CMD_ARGC >= 3) ? CMD_ARGV[2] : NULL) != ERROR_OK)
 		return ERROR_FAIL;
 
+	/* Sections are transferred in chunks, so host memory use does not grow
+	 * with the image and each chunk goes out as soon as it is decoded. */
+	buffer = malloc(LOAD_IMAGE_CHUNK_SIZE);
+	if (buffer == NULL) {
+		command_print(CMD, "error allocating buffer for image");
+		image_close(&image);
+		return ERROR_FAIL;
+	}
+
 	image_size = 0x0;
 	retval = ERROR_OK;
 	for (unsigned int i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (buffer == NULL) {
-			command_print(CMD,
-						  "error allocating buffer for section (%d bytes)",
-						  (int)(image.sections[i].size));
-			retval = ERROR_FAIL;
-			break;
-		}
-
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
-		}
-
+		target_addr_t base = image.sections[i].base_address;
 		uint32_t offset = 0;
-		uint32_t length = buf_cnt;
+		uint32_t length = image.sections[i].size;
 
 		/* DANGER!!! beware of unsigned comparison here!!! */
 
-		if ((image.sections[i].base_address + buf_cnt >= min_address) &&
-				(image.sections[i].base_address < max_address)) {
+		if ((base + length < min_address) || (base >= max_address))
+			continue;
 
-			if (image.sections[i].base_address < min_address) {
-				/* clip addresses below */
-				offset += min_address-image.sections[i].base_address;
-				length -= offset;
-			}
+		if (base < min_address) {
+			/* clip addresses below */
+			offset += min_address - base;
+			length -= offset;
+		}
 
-			if (image.sections[i].base_address + buf_cnt > max_address)
-				length -= (image.sections[i].base_address + buf_cnt)-max_address;
+		if (base + image.sections[i].size > max_address)
+			length -= (base + image.sections[i].size) - max_address;
 
-			retval = target_write_buffer(target,
-					image.sections[i].base_address + offset, length, buffer + offset);
-			if (retval != ERROR_OK) {
-				free(buffer);
+		uint32_t done = 0;
+		while (done < length) {
+			uint32_t chunk = MIN(length - done, LOAD_IMAGE_CHUNK_SIZE);
+
+			retval = image_read_section(&image, i, offset + done, chunk,
+					buffer, &buf_cnt);
+			if (retval != ERROR_OK)
+				break;
+
+			retval = target_write_buffer(target, base + offset + done,
+					buf_cnt, buffer);
+			if (retval != ERROR_OK)
+				break;
+			done += buf_cnt;
+
+			/* section data may end early, as for ELF .bss */
+			if (buf_cnt < chunk)
 				break;
-			}
-			image_size += length;
-			command_print(CMD, "%u bytes written at address " TARGET_ADDR_FMT "",
-					(unsigned int)length,
-					image.sections[i].base_address + offset);
 		}
+		if (retval != ERROR_OK)
+			break;
 
-		free(buffer);
+		image_size += done;
+		command_print(CMD, "%u bytes written at address " TARGET_ADDR_FMT "",
+				(unsigned int)done, base + offset);
 	}
 
+	free(buffer);
+
 	if ((ERROR_OK == retval) && (duration_measure(&bench) == ERROR_OK)) {
 		command_print(CMD, "downloaded %" PRIu32 " bytes "
 				"in %fs (%0.3f KiB/s)", image_size,
@@ -4269,24 +4391,108 @@ static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filena
 	fclose(f);
 }
 
+struct profile_bucket {
+	const char *name;
+	uint32_t count;
+};
+
+static int profile_bucket_compare(const void *a, const void *b)
+{
+	const struct profile_bucket *ba = a, *bb = b;
+
+	if (ba->count != bb->count)
+		return ba->count > bb->count ? -1 : 1;
+	return strcmp(ba->name, bb->name);
+}
+
+/* Write the samples in folded stack format ("function count" per line), as
+ * understood by flame graph tools, bucketed by the functions of an ELF file. */
+static int write_folded(uint32_t *samples, uint32_t sample_num, const char *filename,
+		const char *elf_filename, bool with_range, uint32_t start_address,
+		uint32_t end_address)
+{
+	struct image image;
+	struct image_symbol *symbols;
+	unsigned int num_symbols;
+
+	int retval = image_open(&image, elf_filename, "elf");
+	if (retval != ERROR_OK)
+		return retval;
+	retval = image_get_functions(&image, &symbols, &num_symbols);
+	image_close(&image);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* one bucket per function, plus one for samples outside of any */
+	struct profile_bucket *buckets = calloc(num_symbols + 1, sizeof(*buckets));
+	if (!buckets) {
+		image_free_symbols(symbols, num_symbols);
+		return ERROR_FAIL;
+	}
+	for (unsigned int i = 0; i < num_symbols; i++)
+		buckets[i].name = symbols[i].name;
+	buckets[num_symbols].name = "[unknown]";
+
+	for (uint32_t i = 0; i < sample_num; i++) {
+		if (with_range && (samples[i] < start_address || samples[i] >= end_address))
+			continue;
+		const struct image_symbol *sym = image_symbol_lookup(symbols, num_symbols,
+				samples[i]);
+		buckets[sym ? (unsigned int)(sym - symbols) : num_symbols].count++;
+	}
+
+	qsort(buckets, num_symbols + 1, sizeof(*buckets), profile_bucket_compare);
+
+	FILE *f = fopen(filename, "w");
+	if (f) {
+		for (unsigned int i = 0; i <= num_symbols && buckets[i].count; i++)
+			fprintf(f, "%s %" PRIu32 "\n", buckets[i].name, buckets[i].count);
+		if (fclose(f) != 0)
+			retval = ERROR_FAIL;
+	} else {
+		LOG_ERROR("Can't open %s", filename);
+		retval = ERROR_FAIL;
+	}
+
+	free(buckets);
+	image_free_symbols(symbols, num_symbols);
+	return retval;
+}
+
 /* profiling samples the CPU PC as quickly as OpenOCD is able,
  * which will be used as a random sampling of PC */
 COMMAND_HANDLER(handle_profile_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
+	uint32_t max_samples = 1000000;
+	const char *folded_elf = NULL;
+	unsigned int argi = 0;
+
+	/* options come first */
+	while (CMD_ARGC - argi >= 2 && CMD_ARGV[argi][0] == '-') {
+		if (!strcmp(CMD_ARGV[argi], "-samples")) {
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[argi + 1], max_samples);
+			if (max_samples == 0)
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+		} else if (!strcmp(CMD_ARGV[argi], "-folded")) {
+			folded_elf = CMD_ARGV[argi + 1];
+		} else {
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+		argi += 2;
+	}
 
-	if ((CMD_ARGC != 2) && (CMD_ARGC != 4))
+	if ((CMD_ARGC - argi != 2) && (CMD_ARGC - argi != 4))
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	const uint32_t MAX_PROFILE_SAMPLE_NUM = 10000;
 	uint32_t offset;
 	uint32_t num_of_samples;
 	int retval = ERROR_OK;
 	bool halted_before_profiling = target->state == TARGET_HALTED;
 
-	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], offset);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[argi], offset);
 
-	uint32_t *samples = malloc(sizeof(uint32_t) * MAX_PROFILE_SAMPLE_NUM);
+	uint32_t *samples = malloc(sizeof(uint32_t) * max_samples);
 	if (samples == NULL) {
 		LOG_ERROR("No memory to store samples.");
 		return ERROR_FAIL;
@@ -4298,7 +4504,7 @@ COMMAND_HANDLER(handle_profile_command)
 	 * annoying halt/resume step; for example, ARMv7 PCSR.
 	 * Provide a way to use that more efficient mechanism.
 	 */
-	retval = target_profiling(target, samples, MAX_PROFILE_SAMPLE_NUM,
+	retval = target_profiling(target, samples, max_samples,
 				&num_of_samples, offset);
 	if (retval != ERROR_OK) {
 		free(samples);
@@ -4306,7 +4512,7 @@ COMMAND_HANDLER(handle_profile_command)
 	}
 	uint32_t duration_ms = timeval_ms() - timestart_ms;
 
-	assert(num_of_samples <= MAX_PROFILE_SAMPLE_NUM);
+	assert(num_of_samples <= max_samples);
 
 	retval = target_poll(target);
 	if (retval != ERROR_OK) {
@@ -4341,15 +4547,25 @@ COMMAND_HANDLER(handle_profile_command)
 	uint32_t start_address = 0;
 	uint32_t end_address = 0;
 	bool with_range = false;
-	if (CMD_ARGC == 4) {
+	if (CMD_ARGC - argi == 4) {
 		with_range = true;
-		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], start_address);
-		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[3], end_address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[argi + 2], start_address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[argi + 3], end_address);
 	}
 
-	write_gmon(samples, num_of_samples, CMD_ARGV[1],
-		   with_range, start_address, end_address, target, duration_ms);
-	command_print(CMD, "Wrote %s", CMD_ARGV[1]);
+	const char *filename = CMD_ARGV[argi + 1];
+	if (num_of_samples == 0) {
+		command_print(CMD, "No samples taken");
+	} else if (folded_elf) {
+		retval = write_folded(samples, num_of_samples, filename, folded_elf,
+				with_range, start_address, end_address);
+	} else {
+		write_gmon(samples, num_of_samples, filename,
+			   with_range, start_address, end_address, target, duration_ms);
+	}
+	if (retval == ERROR_OK && num_of_samples)
+		command_print(CMD, "Wrote %s, %" PRIu32 " samples in %" PRIu32 " ms",
+				filename, num_of_samples, duration_ms);
 
 	free(samples);
 	return retval;
@@ -5655,6 +5871,9 @@ static const struct command_registration target_instance_command_handlers[] = {
 		.help = "invoke handler for specified event",
 		.usage = "event_name",
 	},
+	{
+		.chain = memcache_target_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -6470,7 +6689,7 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.name = "profile",
 		.handler = handle_profile_command,
 		.mode = COMMAND_EXEC,
-		.usage = "seconds filename [start end]",
+		.usage = "['-samples' count] ['-folded' elf_file] seconds filename [start end]",
 		.help = "profiling samples the CPU PC",
 	},
 	/** @todo don't register virt2phys() unless target supports it */
@@ -44,6 +44,7 @@ struct mem_param;
 struct reg_param;
 struct target_list;
 struct gdb_fileio_info;
+struct memcache;
 
 /*
  * TARGET_UNKNOWN = 0: we don't know anything about the target yet
@@ -215,6 +216,9 @@ struct target {
 
 	/* The semihosting information, extracted from the target. */
 	struct semihosting *semihosting;
+
+	/* Host side copy of memory read while halted, see memcache.h */
+	struct memcache *memcache;
 };
 
 struct target_list {
@@ -400,6 +404,7 @@ int target_register_timer_callback(int (*callback)(void *priv),
 		unsigned int time_ms, enum target_timer_type type, void *priv);
 int target_unregister_timer_callback(int (*callback)(void *priv), void *priv);
 int target_call_timer_callbacks(void);
+int64_t target_timer_next_event(void);
 /**
  * Invoke this to ensure that e.g. polling timer callbacks happen before
  * a synchronous command completes.
@@ -518,6 +523,14 @@ int target_get_gdb_reg_list_noread(struct target *target,
 		struct reg **reg_list[], int *reg_list_size,
 		enum target_register_class reg_class);
 
+/**
+ * Fill the register cache of a halted target in one go, if the target
+ * supports it. Registers still invalid afterwards are read on demand.
+ *
+ * This routine is a wrapper for target->type->fetch_registers.
+ */
+int target_fetch_registers(struct target *target);
+
 /**
  * Check if @a target allows GDB connections.
  *
@@ -577,6 +590,22 @@ int target_run_flash_async_algorithm(struct target *target,
 		uint32_t entry_point, uint32_t exit_point,
 		void *arch_info);
 
+/**
+ * Loads the code of a flash algorithm into the working area and allocates
+ * a FIFO for target_run_flash_async_algorithm() next to it.
+ *
+ * The FIFO is sized to hold @a data_size bytes plus the read and write
+ * pointers, limited to @a max_fifo_size bytes, and halved until it fits
+ * into the working area. Nothing is allocated (and
+ * ERROR_TARGET_RESOURCE_NOT_AVAILABLE is returned) if less than
+ * @a min_fifo_size bytes would be left for it.
+ */
+int target_alloc_flash_algorithm(struct target *target,
+		const uint8_t *code, uint32_t code_size,
+		uint32_t data_size, int block_size,
+		uint32_t min_fifo_size, uint32_t max_fifo_size,
+		struct working_area **code_area, struct working_area **fifo_area);
+
 /**
  * This routine is a wrapper for asynchronous algorithms.
  *
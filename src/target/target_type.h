@@ -117,6 +117,14 @@ struct target_type {
 			struct reg **reg_list[], int *reg_list_size,
 			enum target_register_class reg_class);
 
+	/**
+	 * Read all registers not in the register cache yet, in as few
+	 * transactions as possible. Optional; without it registers are read
+	 * one by one when they are used. Do @b not call this function
+	 * directly, use target_fetch_registers() instead.
+	 */
+	int (*fetch_registers)(struct target *target);
+
 	/* target memory access
 	* size: 1 = byte (8bit), 2 = half-word (16bit), 4 = word (32bit)
 	* count: number of items of <size>
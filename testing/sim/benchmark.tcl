@@ -0,0 +1,43 @@
+# Throughput benchmark for the simulated target, see README.txt
+
+if { [info exists IMAGE_SIZE] } {
+	set _IMAGE_SIZE $IMAGE_SIZE
+} else {
+	set _IMAGE_SIZE 0x8000
+}
+
+if { [info exists IMAGE] } {
+	set _IMAGE $IMAGE
+} else {
+	set _IMAGE sim_benchmark.bin
+}
+
+proc sim_benchmark {name script} {
+	sim stats reset
+	set start [ms]
+	uplevel 1 $script
+	set elapsed [expr {[ms] - $start}]
+	echo "=== $name: $elapsed ms"
+	echo [sim stats]
+}
+
+init
+reset halt
+
+# create a test image with a known pattern from the simulated RAM
+set words [expr {$_IMAGE_SIZE / 4}]
+for {set i 0} {$i < $words} {incr i} {
+	set image_data($i) [expr {($i * 0x01010101 + 0x12345678) & 0xffffffff}]
+}
+array2mem image_data 32 0x20000000 $words
+dump_image $_IMAGE 0x20000000 $_IMAGE_SIZE
+mww 0x20000000 0 $words
+
+sim_benchmark "load_image" { load_image $_IMAGE 0x20000000 bin }
+sim_benchmark "verify_image" { verify_image $_IMAGE 0x20000000 bin }
+sim_benchmark "mdw" { mdw 0x20000000 $words }
+sim_benchmark "flash write_image" { flash write_image erase $_IMAGE 0x08000000 bin }
+sim_benchmark "flash verify_image" { verify_image $_IMAGE 0x08000000 bin }
+
+file delete $_IMAGE
+shutdown